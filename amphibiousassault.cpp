@@ -0,0 +1,161 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "amphibiousassault.h"
+
+#include "combatscheduler.h"
+
+struct SimulateAssault {
+    typedef void result_type;
+
+    struct Chunk {
+        int assaults;
+        int seed;
+        AssaultStatistics statistics;
+    };
+
+    SimulateAssault(const AmphibiousAssault& assault)
+        : assault(assault)
+    {}
+
+    void operator()(Chunk& chunk) {
+        if (assault._seaSettings.narrowUnits)
+            simulate<UnitLayoutNarrow>(chunk);
+        else
+            simulate<UnitLayoutWide>(chunk);
+    }
+
+    template <typename Layout>
+    void simulate(Chunk& chunk) {
+        // the bombarding units of every assault are appended to the land units and removed again
+        Batallion landAttacker = assault._landAttacker;
+        int landUnits = landAttacker.size();
+        bool hasSeaBattle = !assault._seaDefender.isEmpty();
+
+        DiceGenerator seeds(chunk.seed);
+        for (int i = 0; i < chunk.assaults; ++i) {
+            quint32 seaSeed = seeds.next();
+            quint32 landSeed = seeds.next();
+            ++chunk.statistics.assaults;
+
+            if (hasSeaBattle) {
+                BasicBattle<Layout> sea(assault._fleet, assault._seaDefender, assault._seaSettings, seaSeed);
+                sea.run();
+                chunk.statistics.sea.addResult(sea);
+                // the transports are part of the fleet, so nothing lands if both fleets sank
+                if (!sea.defender().isEmpty() || sea.attacker().isEmpty())
+                    continue;
+                // only one battle can exist per thread, so the survivors are copied before the land battle
+                foreach (const BasicUnitLite<Layout>& unit, sea.attacker()) {
+                    if (unit.canBombard())
+                        landAttacker.append(UnitLite(unit));
+                }
+            }
+            else {
+                foreach (const UnitLite& unit, assault._fleet) {
+                    if (unit.canBombard())
+                        landAttacker.append(unit);
+                }
+            }
+
+            ++chunk.statistics.landings;
+            chunk.statistics.bombardingUnitsLeft += landAttacker.size() - landUnits;
+            BasicBattle<Layout> land(landAttacker, assault._landDefender, assault._landSettings, landSeed);
+            land.run();
+            chunk.statistics.land.addResult(land);
+            landAttacker.erase(landAttacker.begin() + landUnits, landAttacker.end());
+        }
+    }
+
+    const AmphibiousAssault& assault;
+};
+
+AssaultStatistics::AssaultStatistics()
+    : assaults(0)
+    , landings(0)
+    , bombardingUnitsLeft(0)
+{}
+
+void AssaultStatistics::merge(const AssaultStatistics& other) {
+    assaults += other.assaults;
+    landings += other.landings;
+    bombardingUnitsLeft += other.bombardingUnitsLeft;
+    sea.merge(other.sea);
+    land.merge(other.land);
+}
+
+float AssaultStatistics::landingProbability() const {
+    return (assaults > 0) ? static_cast<float>(landings) / assaults : 0.f;
+}
+
+float AssaultStatistics::captureProbability() const {
+    return (assaults > 0) ? static_cast<float>(land.attackerWins) / assaults : 0.f;
+}
+
+float AssaultStatistics::bombardingUnits() const {
+    return (landings > 0) ? static_cast<float>(bombardingUnitsLeft) / landings : 0.f;
+}
+
+float AssaultStatistics::attackerIPCLoss() const {
+    return (assaults > 0) ? static_cast<float>(sea.attackerIPCLoss + land.attackerIPCLoss) / assaults : 0.f;
+}
+
+float AssaultStatistics::defenderIPCLoss() const {
+    return (assaults > 0) ? static_cast<float>(sea.defenderIPCLoss + land.defenderIPCLoss) / assaults : 0.f;
+}
+
+AmphibiousAssault::AmphibiousAssault(const Batallion& fleet, const Batallion& seaDefender, const Batallion& landAttacker,
+                                     const Batallion& landDefender, const CombatSettings& settings)
+    : _fleet(fleet)
+    , _seaDefender(seaDefender)
+    , _landAttacker(landAttacker)
+    , _landDefender(landDefender)
+    , _seaSettings(settings)
+    , _landSettings(settings)
+{
+    _seaSettings.isLandBattle = false;
+    _seaSettings.isAmphibiousCombat = false;
+    _seaSettings.landUnitMustLive = false;
+    _landSettings.isLandBattle = true;
+    _landSettings.isAmphibiousCombat = true;
+}
+
+void AmphibiousAssault::simulate(int assaults) {
+    int nChunks = CombatScheduler::instance()->threadCount() * 4;
+    QList<SimulateAssault::Chunk> chunks;
+    for (int i = 0; i < nChunks; ++i) {
+        SimulateAssault::Chunk chunk;
+        chunk.assaults = assaults / nChunks + ((i < assaults % nChunks) ? 1 : 0);
+        chunk.seed = qrand();
+        chunks.append(chunk);
+    }
+    blockingCombatMap(chunks, SimulateAssault(*this), CombatPriorityInteractive);
+
+    _statistics = AssaultStatistics();
+    foreach (const SimulateAssault::Chunk& chunk, chunks)
+        _statistics.merge(chunk.statistics);
+}
+
+const AssaultStatistics& AmphibiousAssault::statistics() const {
+    return _statistics;
+}
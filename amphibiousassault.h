@@ -0,0 +1,76 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_AMPHIBIOUSASSAULT_H
+#define BOCK_AMPHIBIOUSASSAULT_H
+
+#include "combatthread.h"
+
+// Joint outcome of amphibious assaults. The land statistics only contain the assaults in which
+// the units could land, so their battles are fewer than the assaults
+struct AssaultStatistics {
+    AssaultStatistics();
+
+    void merge(const AssaultStatistics& other);
+
+    float landingProbability() const;
+    float captureProbability() const; //< of winning both the sea and the land battle
+    float bombardingUnits() const; //< average over the landings
+    // averages over all assaults of both battles, in multiples of the map's ipc factor
+    float attackerIPCLoss() const;
+    float defenderIPCLoss() const;
+
+    int assaults;
+    int landings;
+    qint64 bombardingUnitsLeft; //< sum over the landings
+    CombatStatistics sea;
+    CombatStatistics land;
+};
+
+// A sea battle followed by an amphibious land battle. The units land once no defending unit is
+// left in the sea zone and some of the fleet survived, and the bombarding units of the fleet that survived the sea battle
+// support the landing. Every sample fights the sea battle and then the land battle with its
+// survivors, so an assault costs about as much as the two battles on their own. Without a
+// defending fleet every bombarding unit of the fleet takes part in the land battle
+class AmphibiousAssault {
+public:
+    // 'settings' are the ones of the land battle; the sea battle uses the same order of loss
+    AmphibiousAssault(const Batallion& fleet, const Batallion& seaDefender, const Batallion& landAttacker, const Batallion& landDefender,
+        const CombatSettings& settings);
+
+    void simulate(int assaults);
+    const AssaultStatistics& statistics() const;
+
+private:
+    friend struct SimulateAssault;
+
+    Batallion _fleet;
+    Batallion _seaDefender;
+    Batallion _landAttacker;
+    Batallion _landDefender;
+    CombatSettings _seaSettings;
+    CombatSettings _landSettings;
+    AssaultStatistics _statistics;
+};
+
+#endif
@@ -0,0 +1,244 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "battletrace.h"
+
+#include "combatrules.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadStorage>
+#include <QtEndian>
+
+namespace {
+    const char MAGIC[4] = { 'A', 'A', 'C', 'T' };
+    const quint16 VERSION = 1;
+    const int FLUSHSIZE = 1 << 20; // bytes
+
+    QAtomicInt enabled;
+
+    QMutex& registryMutex() {
+        static QMutex mutex;
+        return mutex;
+    }
+
+    // guarded by registryMutex
+    QList<QSharedPointer<TraceBuffer> >& registry() {
+        static QList<QSharedPointer<TraceBuffer> > buffers;
+        return buffers;
+    }
+
+    QElapsedTimer& timer() {
+        static QElapsedTimer timer;
+        return timer;
+    }
+
+    QList<TraceBuffer*> buffers() {
+        QMutexLocker lock(&registryMutex());
+        QList<TraceBuffer*> result;
+        for (int i = 0; i < registry().size(); ++i)
+            result.append(registry()[i].data());
+        return result;
+    }
+
+    template <typename T>
+    void append(QByteArray& data, T value) {
+        int size = data.size();
+        data.resize(size + sizeof(T));
+        qToLittleEndian<T>(value, reinterpret_cast<uchar*>(data.data() + size));
+    }
+
+    QByteArray eventName(const BattleEvent& event) {
+        const char* side = (event.side == CombatStep::SideAttacker) ? "Attacker" : "Defender";
+        switch (event.type) {
+        case BattleEvent::TypeAAFire:
+            return "AA fire";
+        case BattleEvent::TypeBombardment:
+            return "Bombardment";
+        case BattleEvent::TypeFire: {
+            const char* units[] = { "", " (subs)", " (non-subs)", " (air)", " (land)", " (sea)" };
+            return QByteArray(side) + " fires" + units[qBound(0, static_cast<int>(event.units), 5)];
+        }
+        case BattleEvent::TypeCasualties:
+            return QByteArray(side) + " casualties";
+        case BattleEvent::TypeBattle:
+            return event.isLandBattle ? "Land battle" : "Sea battle";
+        }
+        return "Unknown";
+    }
+
+    bool write(QFile& file, QByteArray& data) {
+        bool success = (file.write(data) == data.size());
+        data.clear();
+        return success;
+    }
+}
+
+TraceBuffer::TraceBuffer(int thread)
+    : _thread(thread)
+    , _events(Capacity)
+    , _head(0)
+    , _start(0)
+{}
+
+int TraceBuffer::thread() const {
+    return _thread;
+}
+
+void TraceBuffer::append(const BattleEvent& event) {
+    int head = _head;
+    _events[head & (Capacity - 1)] = event;
+    _head.fetchAndStoreRelease(head + 1);
+}
+
+QVector<BattleEvent> TraceBuffer::events() const {
+    int head = const_cast<QAtomicInt&>(_head).fetchAndAddAcquire(0);
+    int first = qMax(const_cast<QAtomicInt&>(_start).fetchAndAddAcquire(0), head - Capacity);
+    QVector<BattleEvent> result;
+    result.reserve(head - first);
+    for (int i = first; i < head; ++i)
+        result.append(_events.at(i & (Capacity - 1)));
+
+    // the owning thread might have overwritten the oldest events while they were copied
+    int overwritten = const_cast<QAtomicInt&>(_head).fetchAndAddAcquire(0) - Capacity + 1 - first;
+    if (overwritten > 0)
+        result.remove(0, qMin(overwritten, result.size()));
+    return result;
+}
+
+void TraceBuffer::clear() {
+    _start.fetchAndStoreRelease(_head.fetchAndAddAcquire(0));
+}
+
+void BattleTrace::setEnabled(bool enable) {
+    if (enable && (enabled == 0)) {
+        QMutexLocker lock(&registryMutex());
+        if (!timer().isValid())
+            timer().start();
+    }
+    enabled.fetchAndStoreOrdered(enable ? 1 : 0);
+}
+
+bool BattleTrace::isEnabled() {
+    return enabled != 0;
+}
+
+qint64 BattleTrace::elapsed() {
+    return timer().nsecsElapsed();
+}
+
+TraceBuffer* BattleTrace::localBuffer() {
+    // the registry shares the buffers, so that they can still be exported after their thread ended
+    static QThreadStorage<QSharedPointer<TraceBuffer>*> buffers;
+    if (!buffers.hasLocalData()) {
+        QMutexLocker lock(&registryMutex());
+        QSharedPointer<TraceBuffer> buffer(new TraceBuffer(registry().size() + 1));
+        registry().append(buffer);
+        buffers.setLocalData(new QSharedPointer<TraceBuffer>(buffer));
+    }
+    return buffers.localData()->data();
+}
+
+void BattleTrace::clear() {
+    foreach (TraceBuffer* buffer, buffers())
+        buffer->clear();
+}
+
+bool BattleTrace::exportBinary(const QString& fileName) {
+    QList<QVector<BattleEvent> > events;
+    QList<int> threads;
+    quint32 count = 0;
+    foreach (TraceBuffer* buffer, buffers()) {
+        events.append(buffer->events());
+        threads.append(buffer->thread());
+        count += events.last().size();
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray data(MAGIC, sizeof(MAGIC));
+    append<quint16>(data, VERSION);
+    append<quint32>(data, count);
+    bool success = true;
+    for (int i = 0; i < events.size(); ++i) {
+        foreach (const BattleEvent& event, events[i]) {
+            append<quint16>(data, threads[i]);
+            append<qint64>(data, event.time);
+            append<quint32>(data, event.duration);
+            append<quint32>(data, event.battle);
+            append<quint32>(data, event.dice);
+            append<quint32>(data, event.hits);
+            append<quint16>(data, event.round);
+            append<quint16>(data, event.casualties);
+            append<quint16>(data, event.damaged);
+            append<quint8>(data, event.type);
+            append<quint8>(data, event.side);
+            append<quint8>(data, event.units);
+            append<quint8>(data, event.isLandBattle);
+            if (data.size() >= FLUSHSIZE)
+                success = write(file, data) && success;
+        }
+    }
+    return write(file, data) && success;
+}
+
+bool BattleTrace::exportChromeTrace(const QString& fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    const char* outcomes[] = { "attacker wins", "defender wins", "draw" };
+    QByteArray data = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool isFirst = true;
+    bool success = true;
+    foreach (TraceBuffer* buffer, buffers()) {
+        QByteArray thread = QByteArray::number(buffer->thread());
+        foreach (const BattleEvent& event, buffer->events()) {
+            if (!isFirst)
+                data += ",";
+            isFirst = false;
+            // the times of the format are in microseconds
+            data += "\n{\"name\":\"" + eventName(event) + "\",\"cat\":\"" + (event.type == BattleEvent::TypeBattle ? "battle" : "step") +
+                "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + thread +
+                ",\"ts\":" + QByteArray::number(event.time / 1000.0, 'f', 3) +
+                ",\"dur\":" + QByteArray::number(event.duration / 1000.0, 'f', 3) +
+                ",\"args\":{\"battle\":" + QByteArray::number(event.battle) +
+                ",\"round\":" + QByteArray::number(event.round) +
+                ",\"dice\":" + QByteArray::number(event.dice) +
+                ",\"hits\":" + QByteArray::number(event.hits) +
+                ",\"casualties\":" + QByteArray::number(event.casualties) +
+                ",\"damaged\":" + QByteArray::number(event.damaged);
+            if (event.type == BattleEvent::TypeBattle)
+                data += QByteArray(",\"outcome\":\"") + outcomes[qMin(static_cast<int>(event.side), 2)] + "\"";
+            data += "}}";
+            if (data.size() >= FLUSHSIZE)
+                success = write(file, data) && success;
+        }
+    }
+    data += "\n]}\n";
+    return write(file, data) && success;
+}
@@ -0,0 +1,92 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_BATTLETRACE_H
+#define BOCK_BATTLETRACE_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QVector>
+
+// What happened in one combat step of a traced battle, or in the whole battle
+struct BattleEvent {
+    enum Type {
+        TypeAAFire,         //< the first four are the CombatStep types
+        TypeBombardment,
+        TypeFire,
+        TypeCasualties,
+        TypeBattle          //< spans all steps of a battle
+    };
+
+    qint64 time;            //< ns since tracing was enabled
+    quint32 duration;       //< ns
+    quint32 battle;         //< seed of the battle
+    quint32 dice;
+    quint32 hits;           //< scored for fire steps, taken for casualty steps
+    quint16 round;          //< 0 for the opening steps; the number of rounds for TypeBattle
+    quint16 casualties;
+    quint16 damaged;        //< two-hit units that took their first hit
+    quint8 type;
+    quint8 side;            //< CombatStep::Side; the BattleOutcome for TypeBattle
+    quint8 units;           //< CombatStep::Units of a fire step
+    quint8 isLandBattle;
+};
+
+// Events of the battles fought in one thread. Only the owning thread appends; the oldest events
+// are overwritten once the buffer is full. Other threads can read it at any time without locking
+class TraceBuffer {
+public:
+    enum { Capacity = 1 << 16 };
+
+    TraceBuffer(int thread);
+
+    int thread() const;
+    void append(const BattleEvent& event);
+    QVector<BattleEvent> events() const; //< oldest first
+    void clear();
+
+private:
+    int _thread;
+    QVector<BattleEvent> _events;
+    QAtomicInt _head;   //< number of events ever appended
+    QAtomicInt _start;  //< value of _head when the buffer was cleared
+};
+
+// Optional tracing of the steps of every battle. While it is disabled, a battle only checks
+// once whether it is traced; the untraced battle loop is a separate instantiation that contains
+// no tracing code at all
+class BattleTrace {
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static qint64 elapsed(); //< ns since tracing was enabled
+    static TraceBuffer* localBuffer(); //< of the calling thread
+
+    static void clear();
+    // compact little-endian file of all events: magic, version, event count and the events
+    static bool exportBinary(const QString& fileName);
+    // JSON for chrome://tracing and similar viewers
+    static bool exportChromeTrace(const QString& fileName);
+};
+
+#endif
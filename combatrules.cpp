@@ -0,0 +1,276 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "combatrules.h"
+
+namespace {
+    CombatStep fire(CombatStep::Side side, CombatStep::Units units, CombatStep::Hits hits, bool artillerySupport, bool marineBonus) {
+        CombatStep step;
+        step.type = CombatStep::TypeFire;
+        step.side = side;
+        step.units = units;
+        step.hits = hits;
+        step.artillerySupport = artillerySupport;
+        step.marineBonus = marineBonus;
+        return step;
+    }
+
+    CombatStep casualties(CombatStep::Side side, CombatStep::Hits hits, CombatStep::Selection selection, bool ifNoDestroyer) {
+        CombatStep step;
+        step.type = CombatStep::TypeCasualties;
+        step.side = side;
+        step.hits = hits;
+        step.selection = selection;
+        step.ifNoDestroyer = ifNoDestroyer;
+        return step;
+    }
+
+    CombatStep opening(CombatStep::Type type) {
+        CombatStep step;
+        step.type = type;
+        return step;
+    }
+
+    bool toBool(const QString& value) {
+        return (value == "true") || (value == "1");
+    }
+
+    bool parseStep(const QDomElement& element, CombatStep& step, QString& error) {
+        QString name = element.nodeName();
+        if (name == "AAFire") {
+            step.type = CombatStep::TypeAAFire;
+            return true;
+        }
+        if (name == "Bombardment") {
+            step.type = CombatStep::TypeBombardment;
+            return true;
+        }
+        if (name == "Fire")
+            step.type = CombatStep::TypeFire;
+        else if (name == "Casualties")
+            step.type = CombatStep::TypeCasualties;
+        else {
+            error = "Unknown combat step '" + name + "'";
+            return false;
+        }
+
+        QString side = element.attribute("side");
+        if (side == "attacker")
+            step.side = CombatStep::SideAttacker;
+        else if (side == "defender")
+            step.side = CombatStep::SideDefender;
+        else {
+            error = "'" + name + "' needs side=\"attacker\" or side=\"defender\"";
+            return false;
+        }
+
+        QString hits = element.attribute("hits", "regular");
+        if (hits == "regular")
+            step.hits = CombatStep::HitsRegular;
+        else if (hits == "sub")
+            step.hits = CombatStep::HitsSub;
+        else {
+            error = "Unknown hits '" + hits + "' in '" + name + "'";
+            return false;
+        }
+
+        if (step.type == CombatStep::TypeFire) {
+            QString units = element.attribute("units", "all");
+            if (units == "all")
+                step.units = CombatStep::UnitsAll;
+            else if (units == "sub")
+                step.units = CombatStep::UnitsSub;
+            else if (units == "nonsub")
+                step.units = CombatStep::UnitsNonSub;
+            else if (units == "air")
+                step.units = CombatStep::UnitsAir;
+            else if (units == "land")
+                step.units = CombatStep::UnitsLand;
+            else if (units == "sea")
+                step.units = CombatStep::UnitsSea;
+            else {
+                error = "Unknown units '" + units + "' in 'Fire'";
+                return false;
+            }
+            step.artillerySupport = toBool(element.attribute("artillerySupport"));
+            step.marineBonus = toBool(element.attribute("marineBonus"));
+        }
+        else {
+            QString selection = element.attribute("selection", "land");
+            if (selection == "land")
+                step.selection = CombatStep::SelectionLand;
+            else if (selection == "sea")
+                step.selection = CombatStep::SelectionSea;
+            else if (selection == "sub")
+                step.selection = CombatStep::SelectionSub;
+            else {
+                error = "Unknown selection '" + selection + "' in 'Casualties'";
+                return false;
+            }
+            step.ifNoDestroyer = toBool(element.attribute("ifNoDestroyer"));
+        }
+        return true;
+    }
+
+    bool parseSteps(const QDomElement& element, QVector<CombatStep>& steps, QString& error) {
+        steps.clear();
+        QDomNodeList children = element.childNodes();
+        for (int i = 0; i < children.count(); ++i) {
+            QDomElement child = children.at(i).toElement();
+            if (child.isNull())
+                continue;
+            CombatStep step;
+            if (!parseStep(child, step, error))
+                return false;
+            steps.append(step);
+        }
+        return true;
+    }
+
+    bool parseProgram(const QDomElement& element, CombatProgram& program, QString& error) {
+        QDomNodeList children = element.childNodes();
+        for (int i = 0; i < children.count(); ++i) {
+            QDomElement child = children.at(i).toElement();
+            if (child.isNull())
+                continue;
+            bool success;
+            if (child.nodeName() == "Opening")
+                success = parseSteps(child, program.opening, error);
+            else if (child.nodeName() == "Round")
+                success = parseSteps(child, program.round, error);
+            else {
+                error = "Unknown element '" + child.nodeName() + "' in '" + element.nodeName() + "'";
+                success = false;
+            }
+            if (!success)
+                return false;
+        }
+        if (program.round.isEmpty()) {
+            error = "'" + element.nodeName() + "' needs a 'Round' with at least one step";
+            return false;
+        }
+        return true;
+    }
+}
+
+CombatStep::CombatStep()
+    : type(TypeFire)
+    , side(SideAttacker)
+    , units(UnitsAll)
+    , hits(HitsRegular)
+    , selection(SelectionLand)
+    , artillerySupport(false)
+    , marineBonus(false)
+    , ifNoDestroyer(false)
+    , narrowKernel(0)
+    , wideKernel(0)
+{}
+
+CombatProgram::CombatProgram() {
+    artillerySupport[CombatStep::SideAttacker] = false;
+    artillerySupport[CombatStep::SideDefender] = false;
+}
+
+CombatRules::CombatRules() {}
+
+QSharedPointer<const CombatRules> CombatRules::defaultRules() {
+    static QSharedPointer<const CombatRules> rules(createDefaultRules());
+    return rules;
+}
+
+CombatRules* CombatRules::createDefaultRules() {
+    CombatRules* result = new CombatRules;
+    result->_name = "Default";
+
+    CombatProgram& land = result->_landBattle;
+    land.opening.append(opening(CombatStep::TypeAAFire));
+    land.opening.append(opening(CombatStep::TypeBombardment));
+    land.round.append(fire(CombatStep::SideAttacker, CombatStep::UnitsAll, CombatStep::HitsRegular, true, true));
+    land.round.append(fire(CombatStep::SideDefender, CombatStep::UnitsAll, CombatStep::HitsRegular, false, false));
+    land.round.append(casualties(CombatStep::SideAttacker, CombatStep::HitsRegular, CombatStep::SelectionLand, false));
+    land.round.append(casualties(CombatStep::SideDefender, CombatStep::HitsRegular, CombatStep::SelectionLand, false));
+    land.compile();
+
+    // subs fire first; their hits are taken right away unless the receiving side has a destroyer
+    CombatProgram& sea = result->_seaBattle;
+    sea.round.append(fire(CombatStep::SideAttacker, CombatStep::UnitsSub, CombatStep::HitsSub, true, false));
+    sea.round.append(fire(CombatStep::SideDefender, CombatStep::UnitsSub, CombatStep::HitsSub, false, false));
+    sea.round.append(casualties(CombatStep::SideAttacker, CombatStep::HitsSub, CombatStep::SelectionSub, true));
+    sea.round.append(casualties(CombatStep::SideDefender, CombatStep::HitsSub, CombatStep::SelectionSub, true));
+    sea.round.append(fire(CombatStep::SideAttacker, CombatStep::UnitsNonSub, CombatStep::HitsRegular, true, false));
+    sea.round.append(fire(CombatStep::SideDefender, CombatStep::UnitsNonSub, CombatStep::HitsRegular, false, false));
+    sea.round.append(casualties(CombatStep::SideAttacker, CombatStep::HitsSub, CombatStep::SelectionSub, false));
+    sea.round.append(casualties(CombatStep::SideAttacker, CombatStep::HitsRegular, CombatStep::SelectionSea, false));
+    sea.round.append(casualties(CombatStep::SideDefender, CombatStep::HitsSub, CombatStep::SelectionSub, false));
+    sea.round.append(casualties(CombatStep::SideDefender, CombatStep::HitsRegular, CombatStep::SelectionSea, false));
+    sea.compile();
+
+    return result;
+}
+
+QSharedPointer<const CombatRules> CombatRules::fromXML(const QDomElement& element, QString& error) {
+    QSharedPointer<const CombatRules> defaults = defaultRules();
+    CombatRules* result = new CombatRules(*defaults);
+    result->_name = element.attribute("name", "Custom");
+
+    QDomNodeList children = element.childNodes();
+    for (int i = 0; i < children.count(); ++i) {
+        QDomElement child = children.at(i).toElement();
+        if (child.isNull())
+            continue;
+
+        bool success;
+        if (child.nodeName() == "LandBattle") {
+            result->_landBattle = CombatProgram();
+            success = parseProgram(child, result->_landBattle, error);
+        }
+        else if (child.nodeName() == "SeaBattle") {
+            result->_seaBattle = CombatProgram();
+            success = parseProgram(child, result->_seaBattle, error);
+        }
+        else {
+            error = "Unknown element '" + child.nodeName() + "' in 'Rules'";
+            success = false;
+        }
+        if (!success) {
+            delete result;
+            return QSharedPointer<const CombatRules>();
+        }
+    }
+
+    result->_landBattle.compile();
+    result->_seaBattle.compile();
+    return QSharedPointer<const CombatRules>(result);
+}
+
+QString CombatRules::name() const {
+    return _name;
+}
+
+const CombatProgram& CombatRules::landBattle() const {
+    return _landBattle;
+}
+
+const CombatProgram& CombatRules::seaBattle() const {
+    return _seaBattle;
+}
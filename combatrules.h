@@ -0,0 +1,138 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_COMBATRULES_H
+#define BOCK_COMBATRULES_H
+
+#include <QDomElement>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+template <typename Layout> class BasicBattle;
+struct UnitLayoutNarrow;
+struct UnitLayoutWide;
+
+// One step of a battle. When the program is compiled, every step gets a kernel that is
+// specialized for its parameters, so that the battle loop does not look at them per die. There
+// is one kernel for each unit layout the battles can use
+struct CombatStep {
+    enum Type {
+        TypeAAFire,         //< defending AA guns fire at attacking air units and leave the battle
+        TypeBombardment,    //< bombarding units fire once and leave the battle
+        TypeFire,           //< units of one side fire; the hits are collected for the other side
+        TypeCasualties      //< collected hits are taken as casualties
+    };
+
+    enum Side {
+        SideAttacker = 0,
+        SideDefender = 1
+    };
+
+    enum Units {
+        UnitsAll,
+        UnitsSub,
+        UnitsNonSub,
+        UnitsAir,
+        UnitsLand,
+        UnitsSea
+    };
+
+    enum Hits {
+        HitsRegular = 0,
+        HitsSub = 1
+    };
+
+    enum Selection {
+        SelectionLand,
+        SelectionSea,
+        SelectionSub
+    };
+
+    template <typename Layout>
+    struct Kernel {
+        typedef void (*Type)(BasicBattle<Layout>& battle, const CombatStep& step);
+    };
+
+    CombatStep();
+
+    template <typename Layout>
+    typename Kernel<Layout>::Type kernel() const; //< implemented next to the kernels in combatthread.cpp
+
+    Type type;
+    Side side;              //< firing side for TypeFire, receiving side for TypeCasualties
+    Units units;
+    Hits hits;
+    Selection selection;
+    bool artillerySupport;
+    bool marineBonus;       //< only in amphibious combat
+    bool ifNoDestroyer;     //< casualties are only taken if the side has no destroyer
+    Kernel<UnitLayoutNarrow>::Type narrowKernel;
+    Kernel<UnitLayoutWide>::Type wideKernel;
+};
+
+struct CombatProgram {
+    CombatProgram();
+
+    void compile(); //< implemented next to the kernels in combatthread.cpp
+
+    QVector<CombatStep> opening;    //< before the first round
+    QVector<CombatStep> round;      //< repeated until one side is gone
+    bool artillerySupport[2];       //< per side, set by compile if a step uses artillery support
+};
+
+// The combat phases of a ruleset. A map can describe them in its xml file:
+//  <Rules name="Revised">
+//    <LandBattle>
+//      <Opening><AAFire/><Bombardment/></Opening>
+//      <Round>
+//        <Fire side="attacker" units="all" artillerySupport="true" marineBonus="true"/>
+//        <Fire side="defender" units="all"/>
+//        <Casualties side="attacker" selection="land"/>
+//        <Casualties side="defender" selection="land"/>
+//      </Round>
+//    </LandBattle>
+//    <SeaBattle> ... </SeaBattle>
+//  </Rules>
+// 'hits' is 'regular' or 'sub' and selects one of two separate hit pools per side.
+// Without a Rules element, the default rules are used
+class CombatRules {
+public:
+    static QSharedPointer<const CombatRules> defaultRules();
+    // returns a null pointer and sets 'error' if the element is malformed
+    static QSharedPointer<const CombatRules> fromXML(const QDomElement& element, QString& error);
+
+    QString name() const;
+    const CombatProgram& landBattle() const;
+    const CombatProgram& seaBattle() const;
+
+private:
+    CombatRules();
+    static CombatRules* createDefaultRules();
+
+    QString _name;
+    CombatProgram _landBattle;
+    CombatProgram _seaBattle;
+};
+
+#endif
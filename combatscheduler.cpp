@@ -0,0 +1,447 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "combatscheduler.h"
+
+#include <QCoreApplication>
+#include <QThread>
+#include <math.h>
+
+namespace {
+    const float WAITTIMESMOOTHING = 0.2f;
+    const int QUASIRANDOMREPLICATES = 16;
+    const qint64 CHUNKTIME = 2000000; // ns between two checks of the deadline
+    const double BATTLETIMESMOOTHING = 0.3;
+}
+
+class SchedulerThread : public QThread {
+public:
+    SchedulerThread(CombatScheduler* scheduler)
+        : QThread()
+        , _scheduler(scheduler)
+    {}
+
+protected:
+    void run() {
+        _scheduler->work();
+    }
+
+private:
+    CombatScheduler* _scheduler;
+};
+
+CombatJob::CombatJob(int batches, CombatPriority priority)
+    : _batches(batches)
+    , _priority(priority)
+    , _nextBatch(0)
+    , _runningBatches(0)
+    , _canceled(false)
+    , _queued(false)
+    , _waitTime(-1)
+    , _finished(true)
+{}
+
+CombatJob::~CombatJob() {
+    cancel();
+    waitForFinished();
+}
+
+void CombatJob::start() {
+    CombatScheduler::instance()->submit(this);
+}
+
+void CombatJob::cancel() {
+    CombatScheduler::instance()->cancel(this);
+}
+
+void CombatJob::waitForFinished() {
+    CombatScheduler::instance()->runPending(this);
+
+    QMutexLocker lock(&_finishedMutex);
+    while (!_finished)
+        _finishedCondition.wait(&_finishedMutex);
+}
+
+bool CombatJob::isCanceled() const {
+    QMutexLocker lock(&CombatScheduler::instance()->_mutex);
+    return _canceled;
+}
+
+bool CombatJob::isFinished() const {
+    QMutexLocker lock(&_finishedMutex);
+    return _finished;
+}
+
+int CombatJob::batches() const {
+    return _batches;
+}
+
+CombatPriority CombatJob::priority() const {
+    return _priority;
+}
+
+int CombatJob::waitTime() const {
+    QMutexLocker lock(&CombatScheduler::instance()->_mutex);
+    return _waitTime;
+}
+
+qint64 CombatJob::elapsedTime() const {
+    return _startTime.nsecsElapsed();
+}
+
+void CombatJob::finished() {}
+
+CombatStatisticsJob::CombatStatisticsJob(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+                                         int battles, CombatPriority priority, int batchSize, SamplingMode sampling)
+    : CombatJob(replicateCount(sampling) * ((replicateBattles(battles, sampling) + batchSize - 1) / batchSize), priority)
+    , _attacker(attacker)
+    , _defender(defender)
+    , _settings(settings)
+    , _sampling(sampling)
+    , _replicateBattles(replicateBattles(battles, sampling))
+    , _batchSize(batchSize)
+    , _batchesPerReplicate((_replicateBattles + batchSize - 1) / batchSize)
+    , _seed(0)
+    , _timeBudget(0)
+    , _battleTime(0.0)
+{
+    setSeed(qrand());
+    _replicates.fill(CombatStatistics(), replicateCount(sampling));
+}
+
+CombatStatisticsJob::~CombatStatisticsJob() {
+    cancel();
+    waitForFinished();
+}
+
+void CombatStatisticsJob::setSeed(quint32 seed) {
+    _seed = seed;
+    DiceGenerator seeds(seed);
+    _seeds.clear();
+    for (int i = 0; i < batches(); ++i)
+        _seeds.append(seeds.next());
+    _sequences.clear();
+    if (_sampling == SamplingModeQuasiRandom) {
+        _sequences.fill(SobolSequence(), QUASIRANDOMREPLICATES);
+        for (int i = 0; i < QUASIRANDOMREPLICATES; ++i)
+            _sequences[i].scramble(seeds.next());
+    }
+}
+
+quint32 CombatStatisticsJob::seed() const {
+    return _seed;
+}
+
+void CombatStatisticsJob::setTimeBudget(int milliseconds) {
+    _timeBudget = static_cast<qint64>(milliseconds) * 1000000;
+}
+
+CombatStatistics CombatStatisticsJob::statistics() const {
+    QMutexLocker lock(&_statisticsMutex);
+    return _statistics;
+}
+
+float CombatStatisticsJob::winProbabilityError(bool attacker) const {
+    QMutexLocker lock(&_statisticsMutex);
+    QVector<float> probabilities;
+    foreach (const CombatStatistics& replicate, _replicates) {
+        if (replicate.battles > 0)
+            probabilities.append(static_cast<float>(attacker ? replicate.attackerWins : replicate.defenderWins) / replicate.battles);
+    }
+
+    if (probabilities.size() < 2) {
+        if (_statistics.battles == 0)
+            return 1.f;
+        float p = static_cast<float>(attacker ? _statistics.attackerWins : _statistics.defenderWins) / _statistics.battles;
+        return 1.96f * sqrt(p * (1.f - p) / _statistics.battles);
+    }
+
+    float mean = 0.f;
+    foreach (float p, probabilities)
+        mean += p;
+    mean /= probabilities.size();
+    float variance = 0.f;
+    foreach (float p, probabilities)
+        variance += (p - mean) * (p - mean);
+    variance /= probabilities.size() - 1;
+    // Student's t quantile for the 15 degrees of freedom of QUASIRANDOMREPLICATES copies
+    return 2.131f * sqrt(variance / probabilities.size());
+}
+
+int CombatStatisticsJob::replicateCount(SamplingMode sampling) {
+    return (sampling == SamplingModeQuasiRandom) ? QUASIRANDOMREPLICATES : 1;
+}
+
+int CombatStatisticsJob::replicateBattles(int battles, SamplingMode sampling) {
+    if (sampling == SamplingModePseudoRandom)
+        return battles;
+
+    // Sobol points are only balanced in blocks of a power of two
+    int perReplicate = (battles + QUASIRANDOMREPLICATES - 1) / QUASIRANDOMREPLICATES;
+    int result = 1;
+    while (result < perReplicate)
+        result *= 2;
+    return result;
+}
+
+void CombatStatisticsJob::runBatch(int batch) {
+    if (_timeBudget > 0) {
+        runTimedBatch(batch);
+        return;
+    }
+
+    int replicate = batch / _batchesPerReplicate;
+    int first = (batch % _batchesPerReplicate) * _batchSize;
+    int battles = qMin(_batchSize, _replicateBattles - first);
+
+    CombatStatistics result;
+    if (_sampling == SamplingModeQuasiRandom)
+        result = simulateCombat(_attacker, _defender, _settings, battles, _sequences.at(replicate), first, _seeds.at(batch));
+    else
+        result = simulateCombat(_attacker, _defender, _settings, battles, _seeds.at(batch));
+
+    QMutexLocker lock(&_statisticsMutex);
+    _statistics.merge(result);
+    _replicates[replicate].merge(result);
+}
+
+void CombatStatisticsJob::runTimedBatch(int batch) {
+    // the scrambled copies take turns, so that all of them get battles until the deadline
+    int replicates = replicateCount(_sampling);
+    int replicate = batch % replicates;
+    int first = (batch / replicates) * _batchSize;
+    int battles = qMin(_batchSize, _replicateBattles - first);
+    DiceGenerator seeds(_seeds.at(batch));
+
+    CombatStatistics result;
+    bool isLate = false;
+    while (result.battles < battles) {
+        _statisticsMutex.lock();
+        double battleTime = _battleTime;
+        _statisticsMutex.unlock();
+
+        // without a measurement yet, a single battle calibrates the time per battle
+        qint64 remaining = _timeBudget - elapsedTime();
+        int chunk = 1;
+        if (battleTime > 0.0)
+            chunk = static_cast<int>(qMin(remaining, CHUNKTIME) / battleTime);
+        chunk = qMin(chunk, battles - result.battles);
+        if ((remaining <= 0) || (chunk <= 0)) {
+            isLate = true;
+            break;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        if (_sampling == SamplingModeQuasiRandom)
+            result.merge(simulateCombat(_attacker, _defender, _settings, chunk, _sequences.at(replicate), first + result.battles, seeds.next()));
+        else
+            result.merge(simulateCombat(_attacker, _defender, _settings, chunk, seeds.next()));
+        double time = static_cast<double>(timer.nsecsElapsed()) / chunk;
+
+        QMutexLocker lock(&_statisticsMutex);
+        _battleTime = (_battleTime > 0.0) ? (1.0 - BATTLETIMESMOOTHING) * _battleTime + BATTLETIMESMOOTHING * time : time;
+    }
+
+    // the batches that did not begin yet would not get anything done either
+    if (isLate)
+        cancel();
+
+    QMutexLocker lock(&_statisticsMutex);
+    _statistics.merge(result);
+    _replicates[replicate].merge(result);
+}
+
+CombatScheduler* CombatScheduler::instance() {
+    // owned by the application, so that the threads are stopped before the application is gone
+    static CombatScheduler* scheduler = new CombatScheduler;
+    return scheduler;
+}
+
+CombatScheduler::CombatScheduler()
+    : QObject(QCoreApplication::instance())
+    , _quit(false)
+{
+    _averageWaitTime[CombatPriorityInteractive] = 0.f;
+    _averageWaitTime[CombatPriorityBackground] = 0.f;
+
+    int nThreads = qMax(1, QThread::idealThreadCount());
+    for (int i = 0; i < nThreads; ++i) {
+        QThread* thread = new SchedulerThread(this);
+        thread->start();
+        _threads.append(thread);
+    }
+}
+
+CombatScheduler::~CombatScheduler() {
+    _mutex.lock();
+    _quit = true;
+    _workAvailable.wakeAll();
+    _mutex.unlock();
+
+    foreach (QThread* thread, _threads)
+        thread->wait();
+    qDeleteAll(_threads);
+}
+
+int CombatScheduler::threadCount() const {
+    return _threads.size();
+}
+
+int CombatScheduler::queueDepth(CombatPriority priority) const {
+    QMutexLocker lock(&_mutex);
+    int result = 0;
+    foreach (const CombatJob* job, _jobs[priority]) {
+        if (!job->_canceled)
+            result += job->_batches - job->_nextBatch;
+    }
+    return result;
+}
+
+int CombatScheduler::averageWaitTime(CombatPriority priority) const {
+    QMutexLocker lock(&_mutex);
+    return static_cast<int>(_averageWaitTime[priority]);
+}
+
+void CombatScheduler::submit(CombatJob* job) {
+    _mutex.lock();
+    job->_nextBatch = 0;
+    job->_runningBatches = 0;
+    job->_canceled = false;
+    job->_waitTime = -1;
+    job->_startTime.start();
+    job->_finishedMutex.lock();
+    job->_finished = false;
+    job->_finishedMutex.unlock();
+
+    if (job->_batches == 0) {
+        _mutex.unlock();
+        complete(job);
+        return;
+    }
+
+    job->_queued = true;
+    _jobs[job->_priority].append(job);
+    _workAvailable.wakeAll();
+    _mutex.unlock();
+}
+
+void CombatScheduler::cancel(CombatJob* job) {
+    _mutex.lock();
+    job->_canceled = true;
+    // if no batch is running, nobody else will notice the cancellation
+    bool isDone = job->_queued && (job->_runningBatches == 0);
+    if (job->_queued) {
+        _jobs[job->_priority].removeOne(job);
+        job->_queued = false;
+    }
+    _mutex.unlock();
+
+    if (isDone)
+        complete(job);
+}
+
+void CombatScheduler::work() {
+    QMutexLocker lock(&_mutex);
+    while (!_quit) {
+        int batch;
+        CombatJob* job = claim(batch);
+        if (!job) {
+            _workAvailable.wait(&_mutex);
+            continue;
+        }
+
+        lock.unlock();
+        job->runBatch(batch);
+        lock.relock();
+
+        if (releaseBatch(job)) {
+            lock.unlock();
+            complete(job);
+            lock.relock();
+        }
+    }
+}
+
+void CombatScheduler::runPending(CombatJob* job) {
+    QMutexLocker lock(&_mutex);
+    while (job->_queued) {
+        int batch;
+        claimBatch(job, batch);
+        if (!job->_queued)
+            _jobs[job->_priority].removeOne(job);
+
+        lock.unlock();
+        job->runBatch(batch);
+        lock.relock();
+
+        if (releaseBatch(job)) {
+            lock.unlock();
+            complete(job);
+            return;
+        }
+    }
+}
+
+CombatJob* CombatScheduler::claim(int& batch) {
+    // interactive jobs first, then round robin between the jobs of the same priority
+    for (int priority = CombatPriorityInteractive; priority <= CombatPriorityBackground; ++priority) {
+        QList<CombatJob*>& jobs = _jobs[priority];
+        if (jobs.isEmpty())
+            continue;
+
+        CombatJob* job = jobs.takeFirst();
+        claimBatch(job, batch);
+        if (job->_queued)
+            jobs.append(job);
+        return job;
+    }
+    return 0;
+}
+
+void CombatScheduler::claimBatch(CombatJob* job, int& batch) {
+    batch = job->_nextBatch++;
+    ++job->_runningBatches;
+
+    if (job->_waitTime == -1) {
+        job->_waitTime = static_cast<int>(job->_startTime.elapsed());
+        float& average = _averageWaitTime[job->_priority];
+        average = (1.f - WAITTIMESMOOTHING) * average + WAITTIMESMOOTHING * job->_waitTime;
+    }
+
+    if (job->_nextBatch >= job->_batches)
+        job->_queued = false;
+}
+
+bool CombatScheduler::releaseBatch(CombatJob* job) {
+    --job->_runningBatches;
+    return !job->_queued && (job->_runningBatches == 0);
+}
+
+void CombatScheduler::complete(CombatJob* job) {
+    job->finished();
+
+    QMutexLocker lock(&job->_finishedMutex);
+    job->_finished = true;
+    job->_finishedCondition.wakeAll();
+}
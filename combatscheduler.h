@@ -0,0 +1,213 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_COMBATSCHEDULER_H
+#define BOCK_COMBATSCHEDULER_H
+
+#include <QObject>
+
+#include "combatthread.h"
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+class QThread;
+
+enum CombatPriority {
+    CombatPriorityInteractive,
+    CombatPriorityBackground
+};
+
+// Simulation work that is split into batches. The batches of one job run concurrently on the
+// threads of the CombatScheduler, so runBatch has to be safe to call for different batches at
+// the same time. Cancelling takes effect at the next batch boundary. Deleting a job cancels it and
+// waits for its running batches; as the part of a derived class is gone by the time ~CombatJob
+// runs, every class that overrides runBatch or finished does the same in its own destructor
+class CombatJob {
+public:
+    CombatJob(int batches, CombatPriority priority);
+    virtual ~CombatJob();
+
+    void start();
+    void cancel();
+    // the calling thread runs the batches that no thread has claimed yet while it waits, so a
+    // job that is waited for from a batch of another job cannot run out of threads
+    void waitForFinished();
+    bool isCanceled() const;
+    bool isFinished() const; //< true as well if the job was never started
+
+    int batches() const;
+    CombatPriority priority() const;
+    int waitTime() const; //< ms between start() and the first batch, -1 if it did not begin yet
+    qint64 elapsedTime() const; //< ns since start()
+
+protected:
+    virtual void runBatch(int batch) = 0;
+    // called from a scheduler thread once no batch of the job is running or will run anymore
+    virtual void finished();
+
+private:
+    friend class CombatScheduler;
+
+    int _batches;
+    CombatPriority _priority;
+
+    // guarded by the scheduler
+    int _nextBatch;
+    int _runningBatches;
+    bool _canceled;
+    bool _queued;
+    QElapsedTimer _startTime;
+    int _waitTime;
+
+    mutable QMutex _finishedMutex;
+    QWaitCondition _finishedCondition;
+    bool _finished;
+};
+
+// Simulates 'battles' battles of one setup, 'batchSize' of them per batch. With quasi-random
+// sampling the battles are split into independently scrambled copies of a Sobol sequence,
+// each rounded up to a power of two battles. With a time budget, 'battles' is only the upper
+// limit and the job stops at the deadline with as many battles as it managed
+class CombatStatisticsJob : public CombatJob {
+public:
+    CombatStatisticsJob(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+        int battles, CombatPriority priority, int batchSize = 250, SamplingMode sampling = SamplingModePseudoRandom);
+    ~CombatStatisticsJob();
+
+    // all seeds of the batches are derived from this one, so the same seed gives the same
+    // statistics; it is random unless it is set before the job is started
+    void setSeed(quint32 seed);
+    quint32 seed() const;
+
+    // the job finishes at most 'milliseconds' after start(), unless a single battle takes longer.
+    // The battles of a batch are simulated in small chunks whose size follows the measured time
+    // per battle, and no chunk is started that is expected to end after the deadline. The
+    // statistics do not depend on the seed alone anymore, as the chunks depend on the timing
+    void setTimeBudget(int milliseconds);
+
+    CombatStatistics statistics() const; //< of all batches finished so far
+    // half width of the 95% confidence interval of the win probability of either side; for
+    // quasi-random sampling it is estimated from the spread between the scrambled copies
+    float winProbabilityError(bool attacker) const;
+
+protected:
+    void runBatch(int batch);
+
+private:
+    static int replicateCount(SamplingMode sampling);
+    static int replicateBattles(int battles, SamplingMode sampling);
+    void runTimedBatch(int batch);
+
+    Batallion _attacker;
+    Batallion _defender;
+    CombatSettings _settings;
+    SamplingMode _sampling;
+    int _replicateBattles;
+    int _batchSize;
+    int _batchesPerReplicate;
+    quint32 _seed;
+    qint64 _timeBudget; //< ns, 0 without a deadline
+    QVector<int> _seeds;
+    QVector<SobolSequence> _sequences;
+
+    mutable QMutex _statisticsMutex;
+    double _battleTime; //< average ns per battle in one thread, 0 until it is measured
+    CombatStatistics _statistics;
+    QVector<CombatStatistics> _replicates;
+};
+
+// Calls 'function' for every item of the list, one item per batch
+template <typename T, typename Function>
+class CombatMapJob : public CombatJob {
+public:
+    CombatMapJob(QList<T>& items, Function function, CombatPriority priority)
+        : CombatJob(items.size(), priority)
+        , _function(function)
+    {
+        // the items are accessed through pointers, so that the list is never detached concurrently
+        for (int i = 0; i < items.size(); ++i)
+            _items.append(&items[i]);
+    }
+
+    ~CombatMapJob() {
+        cancel();
+        waitForFinished();
+    }
+
+protected:
+    void runBatch(int batch) {
+        _function(*_items[batch]);
+    }
+
+private:
+    QList<T*> _items;
+    Function _function;
+};
+
+// the scheduler's counterpart to QtConcurrent::blockingMap
+template <typename T, typename Function>
+void blockingCombatMap(QList<T>& items, Function function, CombatPriority priority) {
+    CombatMapJob<T, Function> job(items, function, priority);
+    job.start();
+    job.waitForFinished();
+}
+
+// Runs all simulations of the application on its own threads. Interactive jobs always get the
+// next free batch before background jobs, so a Fight click does not wait behind a parameter
+// sweep for longer than one batch. Jobs of the same priority take turns batch by batch
+class CombatScheduler : public QObject {
+public:
+    static CombatScheduler* instance();
+    ~CombatScheduler();
+
+    int threadCount() const;
+    int queueDepth(CombatPriority priority) const; //< batches that are waiting to be run
+    int averageWaitTime(CombatPriority priority) const; //< ms until the first batch of a job runs
+
+private:
+    friend class CombatJob;
+    friend class SchedulerThread;
+
+    CombatScheduler();
+
+    void submit(CombatJob* job);
+    void cancel(CombatJob* job);
+    void work();
+    void runPending(CombatJob* job);
+    CombatJob* claim(int& batch);
+    void claimBatch(CombatJob* job, int& batch);
+    bool releaseBatch(CombatJob* job); //< true if it was the job's last batch
+    void complete(CombatJob* job);
+
+    QList<CombatJob*> _jobs[2]; //< per priority, in round robin order
+    QList<QThread*> _threads;
+    mutable QMutex _mutex;
+    QWaitCondition _workAvailable;
+    bool _quit;
+    float _averageWaitTime[2];
+};
+
+#endif
@@ -23,26 +23,447 @@
 
 #include "combatthread.h"
 
-OrderOfLoss _ool;
+#include "battletrace.h"
+#include <QThreadStorage>
+#include <limits.h>
+#include <math.h>
+#include <new>
+#include <string.h>
+
+CombatSettings::CombatSettings()
+    : isLandBattle(true)
+    , isAmphibiousCombat(false)
+    , landUnitMustLive(false)
+    , orderOfLoss(OrderOfLossValue)
+    , maxRounds(0)
+    , rules(CombatRules::defaultRules())
+    , narrowUnits(false)
+{}
+
+BattleReservoir::BattleReservoir() {
+    _size[BattleOutcomeAttackerWins] = 0;
+    _size[BattleOutcomeDefenderWins] = 0;
+    _size[BattleOutcomeDraw] = 0;
+}
+
+void BattleReservoir::add(BattleOutcome outcome, quint32 seed) {
+    quint32 k = key(seed);
+    int& size = _size[outcome];
+    quint32* keys = _keys[outcome];
+    quint32* seeds = _seeds[outcome];
+    if ((size == Capacity) && (k >= keys[Capacity - 1]))
+        return;
+
+    int i = size;
+    while ((i > 0) && (keys[i - 1] > k))
+        --i;
+    if ((i > 0) && (seeds[i - 1] == seed))
+        return;
+    for (int j = qMin(size, Capacity - 1); j > i; --j) {
+        keys[j] = keys[j - 1];
+        seeds[j] = seeds[j - 1];
+    }
+    keys[i] = k;
+    seeds[i] = seed;
+    size = qMin(size + 1, static_cast<int>(Capacity));
+}
+
+void BattleReservoir::merge(const BattleReservoir& other) {
+    for (int outcome = 0; outcome < 3; ++outcome) {
+        for (int i = 0; i < other._size[outcome]; ++i)
+            add(static_cast<BattleOutcome>(outcome), other._seeds[outcome][i]);
+    }
+}
+
+QList<quint32> BattleReservoir::seeds(BattleOutcome outcome) const {
+    QList<quint32> result;
+    for (int i = 0; i < _size[outcome]; ++i)
+        result.append(_seeds[outcome][i]);
+    return result;
+}
+
+quint32 BattleReservoir::key(quint32 seed) {
+    // finalizer of MurmurHash3, so that the key does not depend on the seed in an obvious way
+    seed ^= seed >> 16;
+    seed *= 0x85ebca6bu;
+    seed ^= seed >> 13;
+    seed *= 0xc2b2ae35u;
+    seed ^= seed >> 16;
+    return seed;
+}
+
+SurvivalCurve::SurvivalCurve()
+    : battles(0)
+{
+    memset(running, 0, sizeof(running));
+    memset(runningUnits, 0, sizeof(runningUnits));
+    memset(runningIPC, 0, sizeof(runningIPC));
+    memset(endedUnits, 0, sizeof(endedUnits));
+    memset(endedIPC, 0, sizeof(endedIPC));
+}
+
+void SurvivalCurve::addRound(int round, bool isRunning, int attackerUnits, int defenderUnits, int attackerIPC, int defenderIPC) {
+    if (round == 0)
+        ++battles;
+    if (round >= Rounds)
+        return;
+
+    if (isRunning) {
+        ++running[round];
+        runningUnits[0][round] += attackerUnits;
+        runningUnits[1][round] += defenderUnits;
+        runningIPC[0][round] += attackerIPC;
+        runningIPC[1][round] += defenderIPC;
+    }
+    else {
+        endedUnits[0][round] += attackerUnits;
+        endedUnits[1][round] += defenderUnits;
+        endedIPC[0][round] += attackerIPC;
+        endedIPC[1][round] += defenderIPC;
+    }
+}
+
+void SurvivalCurve::merge(const SurvivalCurve& other) {
+    battles += other.battles;
+    for (int round = 0; round < Rounds; ++round) {
+        running[round] += other.running[round];
+        for (int side = 0; side < 2; ++side) {
+            runningUnits[side][round] += other.runningUnits[side][round];
+            runningIPC[side][round] += other.runningIPC[side][round];
+            endedUnits[side][round] += other.endedUnits[side][round];
+            endedIPC[side][round] += other.endedIPC[side][round];
+        }
+    }
+}
+
+int SurvivalCurve::rounds() const {
+    int result = 0;
+    while ((result < Rounds) && (running[result] > 0))
+        ++result;
+    return qMin(result + 1, static_cast<int>(Rounds));
+}
+
+float SurvivalCurve::runningProbability(int round) const {
+    if (battles == 0)
+        return 0.f;
+    return static_cast<float>(running[round]) / battles;
+}
+
+float SurvivalCurve::expectedUnits(bool attacker, int round) const {
+    if (battles == 0)
+        return 0.f;
+    int side = attacker ? 0 : 1;
+    qint64 sum = runningUnits[side][round];
+    for (int i = 0; i <= round; ++i)
+        sum += endedUnits[side][i];
+    return static_cast<float>(sum) / battles;
+}
+
+float SurvivalCurve::expectedIPC(bool attacker, int round) const {
+    if (battles == 0)
+        return 0.f;
+    int side = attacker ? 0 : 1;
+    qint64 sum = runningIPC[side][round];
+    for (int i = 0; i <= round; ++i)
+        sum += endedIPC[side][i];
+    return static_cast<float>(sum) / battles;
+}
+
+CombatStatistics::CombatStatistics()
+    : battles(0)
+    , attackerWins(0)
+    , defenderWins(0)
+    , draws(0)
+    , attackerIPCLoss(0)
+    , defenderIPCLoss(0)
+    , attackerUnitsLeft(0)
+    , defenderUnitsLeft(0)
+{}
+
+template <typename Layout>
+void CombatStatistics::addResult(const BasicBattle<Layout>& result) {
+    typedef BasicUnitLite<Layout> UnitType;
+    const typename BasicBattle<Layout>::Units& attacker = result.attacker();
+    const typename BasicBattle<Layout>::Units& defender = result.defender();
+
+    ++battles;
+    attackerUnitsLeft += attacker.size();
+    defenderUnitsLeft += defender.size();
+
+    // summed per battle first, as adding the float values to the totals directly loses
+    // precision once the totals exceed 2^24
+    int attackerIPC = 0;
+    int defenderIPC = 0;
+    foreach (const UnitType& unit, result.attackerCasualities())
+        attackerIPC += unit.ipcValue();
+    foreach (const UnitType& unit, result.defenderCasualities())
+        defenderIPC += unit.ipcValue();
+    attackerIPCLoss += attackerIPC;
+    defenderIPCLoss += defenderIPC;
+
+    BattleOutcome outcome = result.outcome();
+    if (outcome == BattleOutcomeDefenderWins)
+        ++defenderWins;
+    else if (outcome == BattleOutcomeAttackerWins)
+        ++attackerWins;
+    else
+        ++draws;
+
+    if (result.isReplayable())
+        examples.add(outcome, result.seed());
+}
+
+void CombatStatistics::merge(const CombatStatistics& other) {
+    battles += other.battles;
+    attackerWins += other.attackerWins;
+    defenderWins += other.defenderWins;
+    draws += other.draws;
+    attackerIPCLoss += other.attackerIPCLoss;
+    defenderIPCLoss += other.defenderIPCLoss;
+    attackerUnitsLeft += other.attackerUnitsLeft;
+    defenderUnitsLeft += other.defenderUnitsLeft;
+    examples.merge(other.examples);
+    survival.merge(other.survival);
+}
+
+float CombatStatistics::attackerWinProbability() const {
+    if (battles == 0)
+        return 0.f;
+    return static_cast<float>(attackerWins) / battles;
+}
+
+void CombatStatistics::attackerWinInterval(float& lower, float& upper) const {
+    if (battles == 0) {
+        lower = 0.f;
+        upper = 1.f;
+        return;
+    }
+    const float z = 1.96f;
+    float n = static_cast<float>(battles);
+    float p = attackerWinProbability();
+    float denominator = 1.f + z*z/n;
+    float center = (p + z*z/(2.f*n)) / denominator;
+    float halfWidth = z * sqrt(p*(1.f-p)/n + z*z/(4.f*n*n)) / denominator;
+    lower = qMax(0.f, center - halfWidth);
+    upper = qMin(1.f, center + halfWidth);
+}
+
+BattleRecord replayBattle(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, quint32 seed) {
+    CombatThread combat(attacker, defender, settings, seed);
+    combat.setRecordRounds(true);
+    combat.run();
+
+    BattleRecord result;
+    result.seed = seed;
+    result.attacker = combat.attacker();
+    result.attackerCasualities = combat.attackerCasualities();
+    result.defender = combat.defender();
+    result.defenderCasualities = combat.defenderCasualities();
+    result.rounds = combat.rounds();
+    if (result.attacker.isEmpty() && !result.defender.isEmpty())
+        result.outcome = BattleOutcomeDefenderWins;
+    else if (!result.attacker.isEmpty() && result.defender.isEmpty())
+        result.outcome = BattleOutcomeAttackerWins;
+    else
+        result.outcome = BattleOutcomeDraw;
+    return result;
+}
+
+namespace {
+    template <typename Layout>
+    CombatStatistics simulate(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles, int seed) {
+        CombatStatistics result;
+        DiceGenerator seeds(seed);
+        for (int i = 0; i < battles; ++i) {
+            BasicBattle<Layout> battle(attacker, defender, settings, seeds.next());
+            battle.setSurvivalCurve(&result.survival);
+            battle.run();
+            result.addResult(battle);
+        }
+        return result;
+    }
+
+    template <typename Layout>
+    CombatStatistics simulate(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles,
+                              const SobolSequence& sequence, int first, int seed)
+    {
+        CombatStatistics result;
+        QuasiRandomDice dice(sequence, first, seed);
+        for (int i = 0; i < battles; ++i) {
+            if (i > 0)
+                dice.nextBattle();
+            BasicBattle<Layout> battle(attacker, defender, settings, 0);
+            battle.setDice(&dice);
+            battle.setSurvivalCurve(&result.survival);
+            battle.run();
+            result.addResult(battle);
+        }
+        return result;
+    }
+}
+
+CombatStatistics simulateCombat(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles, int seed) {
+    if (settings.narrowUnits)
+        return simulate<UnitLayoutNarrow>(attacker, defender, settings, battles, seed);
+    return simulate<UnitLayoutWide>(attacker, defender, settings, battles, seed);
+}
+
+CombatStatistics simulateCombat(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles,
+                                const SobolSequence& sequence, int first, int seed)
+{
+    if (settings.narrowUnits)
+        return simulate<UnitLayoutNarrow>(attacker, defender, settings, battles, sequence, first, seed);
+    return simulate<UnitLayoutWide>(attacker, defender, settings, battles, sequence, first, seed);
+}
+
+template <typename UnitType>
+BasicUnitArray<UnitType>::BasicUnitArray()
+    : _data(0)
+    , _size(0)
+    , _capacity(0)
+{}
+
+template <typename UnitType>
+BasicUnitArray<UnitType>::BasicUnitArray(UnitType* data, int capacity)
+    : _data(data)
+    , _size(0)
+    , _capacity(capacity)
+{}
+
+template <typename UnitType>
+int BasicUnitArray<UnitType>::size() const {
+    return _size;
+}
+
+template <typename UnitType>
+bool BasicUnitArray<UnitType>::isEmpty() const {
+    return _size == 0;
+}
+
+template <typename UnitType>
+UnitType& BasicUnitArray<UnitType>::operator[](int i) {
+    return _data[i];
+}
+
+template <typename UnitType>
+const UnitType& BasicUnitArray<UnitType>::operator[](int i) const {
+    return _data[i];
+}
+
+template <typename UnitType>
+typename BasicUnitArray<UnitType>::iterator BasicUnitArray<UnitType>::begin() {
+    return _data;
+}
+
+template <typename UnitType>
+typename BasicUnitArray<UnitType>::iterator BasicUnitArray<UnitType>::end() {
+    return _data + _size;
+}
+
+template <typename UnitType>
+typename BasicUnitArray<UnitType>::const_iterator BasicUnitArray<UnitType>::begin() const {
+    return _data;
+}
+
+template <typename UnitType>
+typename BasicUnitArray<UnitType>::const_iterator BasicUnitArray<UnitType>::end() const {
+    return _data + _size;
+}
+
+template <typename UnitType>
+void BasicUnitArray<UnitType>::append(const UnitType& unit) {
+    Q_ASSERT(_size < _capacity);
+    new (_data + _size) UnitType(unit);
+    ++_size;
+}
+
+template <typename UnitType>
+void BasicUnitArray<UnitType>::removeAt(int i) {
+    memmove(_data + i, _data + i + 1, (_size - i - 1) * sizeof(UnitType));
+    --_size;
+}
+
+template <typename UnitType>
+void BasicUnitArray<UnitType>::removeFirst() {
+    removeAt(0);
+}
+
+template <typename UnitType>
+void BasicUnitArray<UnitType>::assign(const Batallion& units) {
+    _size = 0;
+    for (int i = 0; i < units.size(); ++i)
+        append(UnitType(units[i]));
+}
+
+template <typename UnitType>
+Batallion BasicUnitArray<UnitType>::toBatallion() const {
+    Batallion result;
+    for (int i = 0; i < _size; ++i)
+        result.append(UnitLite(_data[i]));
+    return result;
+}
+
+BattleArena& BattleArena::local() {
+    static QThreadStorage<BattleArena*> arenas;
+    if (!arenas.hasLocalData())
+        arenas.setLocalData(new BattleArena);
+    return *arenas.localData();
+}
+
+BattleArena::BattleArena()
+    : _used(0)
+{}
+
+template <typename UnitType>
+void BattleArena::reset(int units) {
+    _used = 0;
+    int bytes = units * sizeof(UnitType);
+    if (_memory.size() < bytes)
+        _memory.resize(bytes);
+}
+
+template <typename UnitType>
+BasicUnitArray<UnitType> BattleArena::allocate(int units) {
+    Q_ASSERT(static_cast<int>((_used + units) * sizeof(UnitType)) <= _memory.size());
+    BasicUnitArray<UnitType> result(reinterpret_cast<UnitType*>(_memory.data()) + _used, units);
+    _used += units;
+    return result;
+}
 
 CombatThread::CombatThread(const Batallion& attacker, const Batallion& defender, bool isLandBattle, bool isAmphibiousCombat, bool landUnitMustLive, OrderOfLoss ool, int seedHelper)
     : QRunnable()
     , _attacker(attacker)
     , _defender(defender)
-    , _isLandBattle(isLandBattle)
-    , _isAmphibiousCombat(isAmphibiousCombat)
-    , _landUnitMustLive(landUnitMustLive)
     , _seedHelper(seedHelper)
+    , _recordRounds(false)
+{
+    _settings.isLandBattle = isLandBattle;
+    _settings.isAmphibiousCombat = isAmphibiousCombat;
+    _settings.landUnitMustLive = landUnitMustLive;
+    _settings.orderOfLoss = ool;
+    setAutoDelete(false);
+}
+
+CombatThread::CombatThread(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int seedHelper)
+    : QRunnable()
+    , _attacker(attacker)
+    , _defender(defender)
+    , _settings(settings)
+    , _seedHelper(seedHelper)
+    , _recordRounds(false)
 {
-    _ool = ool;
     setAutoDelete(false);
 }
 
-inline int getRoll() {
-    return (qrand() % 6) + 1;
+template <typename Layout>
+inline int BasicBattle<Layout>::roll() {
+    if (_dice)
+        return _dice->roll();
+    return _random.roll();
 }
 
-inline bool lessThanAttack(const UnitLite& p1, const UnitLite& p2) {
+template <typename UnitType>
+inline bool lessThanAttack(const UnitType& p1, const UnitType& p2, OrderOfLoss ool) {
     if (p1.isTwoHit())
         return (!p1.isHit());
     
@@ -55,7 +476,7 @@ inline bool lessThanAttack(const UnitLite& p1, const UnitLite& p2) {
     if (p2.hasTwoRolls() && !p1.hasTwoRolls())
         return false;
 
-    if (_ool == OrderOfLossValue) {
+    if (ool == OrderOfLossValue) {
         if (p1.attackValue() < p2.attackValue())
             return true;
         else if (p1.attackValue() > p2.attackValue())
@@ -73,7 +494,8 @@ inline bool lessThanAttack(const UnitLite& p1, const UnitLite& p2) {
     }
 }
 
-inline bool lessThanDefense(const UnitLite& p1, const UnitLite& p2) {
+template <typename UnitType>
+inline bool lessThanDefense(const UnitType& p1, const UnitType& p2, OrderOfLoss ool) {
     if (p1.isTwoHit())
         return (!p1.isHit());
 
@@ -86,7 +508,7 @@ inline bool lessThanDefense(const UnitLite& p1, const UnitLite& p2) {
     if (p2.hasTwoRolls() && !p1.hasTwoRolls())
         return false;
 
-    if (_ool == OrderOfLossValue) {
+    if (ool == OrderOfLossValue) {
         if (p1.defenseValue() < p2.defenseValue())
             return true;
         else if (p1.defenseValue() > p2.defenseValue())
@@ -104,7 +526,25 @@ inline bool lessThanDefense(const UnitLite& p1, const UnitLite& p2) {
     }
 }
 
-inline int getNumberOfSupporters(const Batallion& bat) {
+// the order of loss is passed along instead of being global, as battles with different settings
+// run concurrently
+struct LessThanCasualty {
+    LessThanCasualty(bool isDefender, OrderOfLoss ool)
+        : isDefender(isDefender)
+        , ool(ool)
+    {}
+
+    template <typename UnitType>
+    bool operator()(const UnitType& p1, const UnitType& p2) const {
+        return isDefender ? lessThanDefense(p1, p2, ool) : lessThanAttack(p1, p2, ool);
+    }
+
+    bool isDefender;
+    OrderOfLoss ool;
+};
+
+template <typename Units>
+inline int getNumberOfSupporters(const Units& bat) {
     int result = 0;
     for (int i = 0; i < bat.size(); ++i) {
         if (bat[i].isArtillery()) {
@@ -114,9 +554,10 @@ inline int getNumberOfSupporters(const Batallion& bat) {
     return result;
 }
 
-inline bool hasOnlyOneLandUnit(Batallion& bat) {
+template <typename UnitType>
+inline bool hasOnlyOneLandUnit(const BasicUnitArray<UnitType>& bat) {
     int count = 0;
-    foreach (const UnitLite& unit, bat) {
+    foreach (const UnitType& unit, bat) {
         if (unit.isLand())
             count++;
         
@@ -126,30 +567,30 @@ inline bool hasOnlyOneLandUnit(Batallion& bat) {
     return count == 1;
 }
 
-inline bool hasDestroyer(Batallion& bat) {
-    foreach (const UnitLite& unit, bat) {
+template <typename UnitType>
+inline bool hasDestroyer(const BasicUnitArray<UnitType>& bat) {
+    foreach (const UnitType& unit, bat) {
         if (unit.isDestroyer())
             return true;
     }
     return false;
 }
 
-void applyCasualtyLand(Batallion& bat, Batallion& casBat, int casualties, bool isDefender, bool landUnitMustLive, bool needsSorting) {
+template <typename UnitType>
+void applyCasualtyLand(BasicUnitArray<UnitType>& bat, BasicUnitArray<UnitType>& casBat, int casualties, bool isDefender, OrderOfLoss ool,
+                       bool landUnitMustLive, bool needsSorting)
+{
     if ((bat.size() == 0) || (casualties == 0))
         return;
 
-    if (needsSorting) {
-        if (isDefender)
-            qSort(bat.begin(), bat.end(), lessThanDefense);
-        else
-            qSort(bat.begin(), bat.end(), lessThanAttack);
-    }
+    if (needsSorting)
+        qSort(bat.begin(), bat.end(), LessThanCasualty(isDefender, ool));
 
     int index = 0;
-    if (landUnitMustLive && bat[0].isLand() && (bat.count() > 1) && hasOnlyOneLandUnit(bat))
+    if (landUnitMustLive && bat[0].isLand() && (bat.size() > 1) && hasOnlyOneLandUnit(bat))
         index = 1;
 
-    const UnitLite& unit = bat[index];
+    const UnitType& unit = bat[index];
 
     if (unit.isTwoHit()) {
         if (unit.isHit()) {
@@ -158,7 +599,7 @@ void applyCasualtyLand(Batallion& bat, Batallion& casBat, int casualties, bool i
         }
         else {
             bat[index].setHit();
-            applyCasualtyLand(bat, casBat, casualties - 1, isDefender, landUnitMustLive);
+            applyCasualtyLand(bat, casBat, casualties - 1, isDefender, ool, landUnitMustLive);
             return;
         }
     }
@@ -166,37 +607,36 @@ void applyCasualtyLand(Batallion& bat, Batallion& casBat, int casualties, bool i
         casBat.append(unit);
         bat.removeAt(index);
     }
-    applyCasualtyLand(bat, casBat, casualties - 1, isDefender, landUnitMustLive, false);
+    applyCasualtyLand(bat, casBat, casualties - 1, isDefender, ool, landUnitMustLive, false);
 }
 
-void applyCasualtySub(Batallion& bat, Batallion& casBat, int casualties, bool isDefender, bool needsSorting = true) {
+template <typename UnitType>
+void applyCasualtySub(BasicUnitArray<UnitType>& bat, BasicUnitArray<UnitType>& casBat, int casualties, bool isDefender, OrderOfLoss ool,
+                      bool needsSorting = true)
+{
     if ((bat.size() == 0) || (casualties == 0))
         return;
     
-    if (needsSorting) {
-        if (isDefender)
-            qSort(bat.begin(), bat.end(), lessThanDefense);
-        else
-            qSort(bat.begin(), bat.end(), lessThanAttack);
-    }
+    if (needsSorting)
+        qSort(bat.begin(), bat.end(), LessThanCasualty(isDefender, ool));
     
     for (int i = 0; i < bat.size(); ++i) {
         if (bat[i].isSea()) {
             if (bat[i].isTwoHit()) {
                 if (bat[i].isHit()) {
-                    const UnitLite& tmp = bat[i];
+                    const UnitType& tmp = bat[i];
                     casBat.append(tmp);
                     bat.removeAt(i);
                     break;
                 }
                 else {
                     bat[i].setHit();
-                    applyCasualtySub(bat, casBat, casualties - 1, isDefender);
+                    applyCasualtySub(bat, casBat, casualties - 1, isDefender, ool);
                     return;
                 }
             }
             else {
-                const UnitLite& tmp = bat[i];
+                const UnitType& tmp = bat[i];
                 casBat.append(tmp);
                 bat.removeAt(i);
                 break;
@@ -204,21 +644,20 @@ void applyCasualtySub(Batallion& bat, Batallion& casBat, int casualties, bool is
         }
     }
     
-    applyCasualtySub(bat, casBat, casualties - 1, isDefender, false);
+    applyCasualtySub(bat, casBat, casualties - 1, isDefender, ool, false);
 }
 
-void applyCasualtySea(Batallion& bat, Batallion& casBat, int casualties, bool isDefender, bool needsSorting) {
+template <typename UnitType>
+void applyCasualtySea(BasicUnitArray<UnitType>& bat, BasicUnitArray<UnitType>& casBat, int casualties, bool isDefender, OrderOfLoss ool,
+                      bool needsSorting)
+{
     if ((casualties == 0) || (bat.size() == 0))
         return;
     
-    if (needsSorting) {
-        if (isDefender)
-            qSort(bat.begin(), bat.end(), lessThanDefense);
-        else
-            qSort(bat.begin(), bat.end(), lessThanAttack);
-    }
+    if (needsSorting)
+        qSort(bat.begin(), bat.end(), LessThanCasualty(isDefender, ool));
 
-    const UnitLite& unit = bat[0];
+    const UnitType& unit = bat[0];
     
     if (unit.isTwoHit()) {
         if (unit.isHit()) {
@@ -227,7 +666,7 @@ void applyCasualtySea(Batallion& bat, Batallion& casBat, int casualties, bool is
         }
         else {
             bat[0].setHit();
-            applyCasualtySea(bat, casBat, casualties - 1, isDefender);
+            applyCasualtySea(bat, casBat, casualties - 1, isDefender, ool);
             return;
         }
     }
@@ -235,164 +674,568 @@ void applyCasualtySea(Batallion& bat, Batallion& casBat, int casualties, bool is
         casBat.append(unit);
         bat.removeFirst();
     }
-    applyCasualtySea(bat, casBat, casualties - 1, isDefender, false);    
+    applyCasualtySea(bat, casBat, casualties - 1, isDefender, ool, false);    
 }
 
 void CombatThread::run() {
-    qsrand(_seedHelper);
-
-    if (_isLandBattle)
-        runLandBattle();
+    if (_settings.narrowUnits)
+        runBattle<UnitLayoutNarrow>();
     else
-        runSeaBattle();     
-}
-
-void CombatThread::runLandBattle() {
-    // AA fire
-    for (int i = 0; i < _defender.size(); ++i) {
-        const UnitLite& uDefender = _defender[i];
-        if (uDefender.isAA()) {
-            for (int j = 0; j < _attacker.size(); ++j) {
-                const UnitLite& uAttacker = _attacker[j];
-                if (uAttacker.isAir()) {
-                    for (int k = 0; k < uDefender.numRolls(); ++k) {
-                        int aaRoll = getRoll();
-                        if (aaRoll <= uDefender.defenseValue()) {
-                            _attackerCasualities.append(uAttacker);
-                            _attacker.removeAt(j--);
+        runBattle<UnitLayoutWide>();
+}
+
+template <typename Layout>
+void CombatThread::runBattle() {
+    BasicBattle<Layout> battle(_attacker, _defender, _settings, _seedHelper);
+    if (_recordRounds)
+        battle.setRounds(&_rounds);
+    battle.run();
+
+    _attacker = battle.attacker().toBatallion();
+    _attackerCasualities = battle.attackerCasualities().toBatallion();
+    _defender = battle.defender().toBatallion();
+    _defenderCasualities = battle.defenderCasualities().toBatallion();
+}
+
+template <typename Layout>
+BasicBattle<Layout>::BasicBattle(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, quint32 seed)
+    : _settings(settings)
+    , _rounds(0)
+    , _survival(0)
+    , _seed(seed)
+    , _random(seed)
+    , _dice(0)
+    , _trace(BattleTrace::isEnabled() ? BattleTrace::localBuffer() : 0)
+{
+    typedef BasicUnitLite<Layout> UnitType;
+    BattleArena& arena = BattleArena::local();
+    arena.reset<UnitType>(2 * (attacker.size() + defender.size()));
+    _attacker = arena.allocate<UnitType>(attacker.size());
+    _attackerCasualities = arena.allocate<UnitType>(attacker.size());
+    _defender = arena.allocate<UnitType>(defender.size());
+    _defenderCasualities = arena.allocate<UnitType>(defender.size());
+    _attacker.assign(attacker);
+    _defender.assign(defender);
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::setRounds(QList<CombatRound>* rounds) {
+    _rounds = rounds;
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::setDice(QuasiRandomDice* dice) {
+    _dice = dice;
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::setSurvivalCurve(SurvivalCurve* survival) {
+    _survival = survival;
+}
+
+// The kernels of the combat steps. The parameters that are checked for every die are template
+// arguments, so every combination gets its own loop without any checks for disabled rules
+template <typename Layout>
+struct CombatKernels {
+    typedef BasicUnitLite<Layout> UnitType;
+    typedef BasicUnitArray<UnitType> Units;
+    typedef BasicBattle<Layout> Battle;
+    typedef typename CombatStep::Kernel<Layout>::Type Kernel;
+
+    static void aaFire(Battle& battle, const CombatStep&) {
+        Units& attacker = battle._attacker;
+        Units& defender = battle._defender;
+        for (int i = 0; i < defender.size(); ++i) {
+            const UnitType& uDefender = defender[i];
+            if (uDefender.isAA()) {
+                for (int j = 0; j < attacker.size(); ++j) {
+                    const UnitType& uAttacker = attacker[j];
+                    if (uAttacker.isAir()) {
+                        for (int k = 0; k < uDefender.numRolls(); ++k) {
+                            int aaRoll = battle.roll();
+                            if (aaRoll <= uDefender.defenseValue()) {
+                                battle._attackerCasualities.append(uAttacker);
+                                attacker.removeAt(j--);
+                            }
                         }
                     }
                 }
+                defender.removeAt(i--);
             }
-            _defender.removeAt(i--);
         }
     }
 
-    // Bombardment
-    for (int i = 0; i < _attacker.size(); ++i) {
-        const UnitLite& uAtt = _attacker[i];
+    static void bombardment(Battle& battle, const CombatStep&) {
+        Units& attacker = battle._attacker;
+        for (int i = 0; i < attacker.size(); ++i) {
+            const UnitType& uAtt = attacker[i];
 
-        if (uAtt.canBombard()) {
-            for (int j = 0; j < uAtt.numRolls(); ++j) {
-                int bombardRoll = getRoll();
-                if (bombardRoll <= uAtt.bombardmentValue())
-                    applyCasualtyLand(_defender, _defenderCasualities, 1, true, false);
-                    // Bombarded -> remove it
+            if (uAtt.canBombard()) {
+                for (int j = 0; j < uAtt.numRolls(); ++j) {
+                    int bombardRoll = battle.roll();
+                    if (bombardRoll <= uAtt.bombardmentValue())
+                        applyCasualtyLand(battle._defender, battle._defenderCasualities, 1, true, battle._settings.orderOfLoss, false);
+                        // Bombarded -> remove it
+                }
+                attacker.removeAt(i--);
             }
-            _attacker.removeAt(i--);
         }
     }
 
-    // regular battle
-    while ((_attacker.size() > 0) && (_defender.size() > 0)) {
-        int attackerHits = 0;
-        int defenderHits = 0;
-        int supporter = getNumberOfSupporters(_attacker);
+    template <CombatStep::Units U, typename T>
+    static bool isSelected(const T& unit) {
+        switch (U) {
+        case CombatStep::UnitsAll:
+            return true;
+        case CombatStep::UnitsSub:
+            return unit.isSub();
+        case CombatStep::UnitsNonSub:
+            return !unit.isSub();
+        case CombatStep::UnitsAir:
+            return unit.isAir();
+        case CombatStep::UnitsLand:
+            return unit.isLand();
+        case CombatStep::UnitsSea:
+            return unit.isSea();
+        }
+        return false;
+    }
+
+    template <typename T>
+    static bool isSelected(const T& unit, CombatStep::Units units) {
+        switch (units) {
+        case CombatStep::UnitsAll:
+            return isSelected<CombatStep::UnitsAll>(unit);
+        case CombatStep::UnitsSub:
+            return isSelected<CombatStep::UnitsSub>(unit);
+        case CombatStep::UnitsNonSub:
+            return isSelected<CombatStep::UnitsNonSub>(unit);
+        case CombatStep::UnitsAir:
+            return isSelected<CombatStep::UnitsAir>(unit);
+        case CombatStep::UnitsLand:
+            return isSelected<CombatStep::UnitsLand>(unit);
+        case CombatStep::UnitsSea:
+            return isSelected<CombatStep::UnitsSea>(unit);
+        }
+        return false;
+    }
+
+    template <CombatStep::Side S, CombatStep::Units U, bool Support, bool Marine>
+    static void fire(Battle& battle, const CombatStep& step) {
+        const Units& units = (S == CombatStep::SideAttacker) ? battle._attacker : battle._defender;
+        int supporter = battle._supporters[S];
+        const bool isMarineRound = Marine && battle._settings.isAmphibiousCombat;
+        QuasiRandomDice* dice = battle._dice;
+        int diceForValue[7] = { 0, 0, 0, 0, 0, 0, 0 }; //< only used for quasi-random dice
+        int hits = 0;
 
-        foreach (const UnitLite& unit, _attacker) {
+        foreach (const UnitType& unit, units) {
+            if (!isSelected<U>(unit))
+                continue;
+            int value = (S == CombatStep::SideAttacker) ? unit.attackValue() : unit.defenseValue();
             for (int i = 0; i < unit.numRolls(); ++i) {
-                int roll = getRoll();
-                if (unit.isArtillerySupportable() && (supporter > 0)) {
-                    --roll;
+                int target = value;
+                if (Support && unit.isArtillerySupportable() && (supporter > 0)) {
+                    ++target;
                     --supporter;
                 }
-                if (_isAmphibiousCombat && unit.isMarine())
-                    --roll;
-                
-                if (roll <= unit.attackValue())
-                    ++attackerHits;
+                if (isMarineRound && unit.isMarine())
+                    ++target;
+
+                if (dice)
+                    ++diceForValue[qBound(0, target, 6)];
+                else if (battle.roll() <= target)
+                    ++hits;
             }
         }
 
-        foreach (const UnitLite& unit, _defender) {
-            for (int i = 0; i < unit.numRolls(); ++i) {
-                int roll = getRoll();
-                if (roll <= unit.defenseValue())
-                    ++defenderHits;
-            }
+        // only the number of hits matters, so all dice with the same target are rolled at once
+        if (dice) {
+            for (int i = 1; i <= 6; ++i)
+                hits += dice->hits(diceForValue[i], i);
         }
 
-        applyCasualtyLand(_attacker, _attackerCasualities, defenderHits, false, _landUnitMustLive);
-        applyCasualtyLand(_defender, _defenderCasualities, attackerHits, true, false);
+        // the hits are taken by the other side
+        battle._hits[1 - S][step.hits] += hits;
+        battle._supporters[S] = supporter;
     }
 
-}
+    template <CombatStep::Side S, CombatStep::Selection Sel>
+    static void casualties(Battle& battle, const CombatStep& step) {
+        const bool isDefender = (S == CombatStep::SideDefender);
+        Units& units = isDefender ? battle._defender : battle._attacker;
+        Units& casualties = isDefender ? battle._defenderCasualities : battle._attackerCasualities;
+        int& hits = battle._hits[S][step.hits];
+        if (step.ifNoDestroyer && hasDestroyer(units))
+            return;
 
-void CombatThread::runSeaBattle() {
-    while ((_attacker.size() > 0) && (_defender.size() > 0)) {
-        int attackerSubHits = 0;
-        int defenderSubHits = 0;
-        int attackerHits = 0;
-        int defenderHits = 0;
-        int supporter = getNumberOfSupporters(_attacker);
+        OrderOfLoss ool = battle._settings.orderOfLoss;
+        switch (Sel) {
+        case CombatStep::SelectionLand:
+            applyCasualtyLand(units, casualties, hits, isDefender, ool, !isDefender && battle._settings.landUnitMustLive);
+            break;
+        case CombatStep::SelectionSea:
+            applyCasualtySea(units, casualties, hits, isDefender, ool);
+            break;
+        case CombatStep::SelectionSub:
+            applyCasualtySub(units, casualties, hits, isDefender, ool);
+            break;
+        }
+        hits = 0;
+    }
 
-        // Sub Fire
-        foreach (const UnitLite& unit, _attacker) {
-            if (unit.isSub()) {
-                for (int i = 0; i < unit.numRolls(); ++i) {
-                    int roll = getRoll();
-                    if (unit.isArtillerySupportable() && (supporter > 0)) {
-                        --roll;
-                        --supporter;
-                    }
-                    if (roll <= unit.attackValue())
-                        ++attackerSubHits;
-                }
+    template <CombatStep::Side S, CombatStep::Units U>
+    static Kernel fireKernel(const CombatStep& step) {
+        if (step.artillerySupport)
+            return step.marineBonus ? &fire<S, U, true, true> : &fire<S, U, true, false>;
+        else
+            return step.marineBonus ? &fire<S, U, false, true> : &fire<S, U, false, false>;
+    }
+
+    template <CombatStep::Side S>
+    static Kernel fireKernel(const CombatStep& step) {
+        switch (step.units) {
+        case CombatStep::UnitsAll:
+            return fireKernel<S, CombatStep::UnitsAll>(step);
+        case CombatStep::UnitsSub:
+            return fireKernel<S, CombatStep::UnitsSub>(step);
+        case CombatStep::UnitsNonSub:
+            return fireKernel<S, CombatStep::UnitsNonSub>(step);
+        case CombatStep::UnitsAir:
+            return fireKernel<S, CombatStep::UnitsAir>(step);
+        case CombatStep::UnitsLand:
+            return fireKernel<S, CombatStep::UnitsLand>(step);
+        case CombatStep::UnitsSea:
+            return fireKernel<S, CombatStep::UnitsSea>(step);
+        }
+        return 0;
+    }
+
+    template <CombatStep::Side S>
+    static Kernel casualtiesKernel(const CombatStep& step) {
+        switch (step.selection) {
+        case CombatStep::SelectionLand:
+            return &casualties<S, CombatStep::SelectionLand>;
+        case CombatStep::SelectionSea:
+            return &casualties<S, CombatStep::SelectionSea>;
+        case CombatStep::SelectionSub:
+            return &casualties<S, CombatStep::SelectionSub>;
+        }
+        return 0;
+    }
+
+    // true if hits in the pool 'hits' of 'side' that are scored in the step 'fire' of the round
+    // are taken by a later step of it
+    static bool canTakeHits(const Battle& battle, const CombatProgram& program, int fire, int side, int hits) {
+        const Units& units = (side == CombatStep::SideAttacker) ? battle._attacker : battle._defender;
+        for (int i = fire + 1; i < program.round.size(); ++i) {
+            const CombatStep& step = program.round[i];
+            if ((step.type != CombatStep::TypeCasualties) || (step.side != side) || (step.hits != hits))
+                continue;
+            if (step.ifNoDestroyer && hasDestroyer(units))
+                continue;
+            if (step.selection != CombatStep::SelectionSub)
+                return !units.isEmpty();
+            foreach (const UnitType& unit, units) {
+                if (unit.isSea())
+                    return true;
             }
         }
+        return false;
+    }
 
-        foreach (const UnitLite& unit, _defender) {
-            if (unit.isSub()) {
-                for (int i = 0; i < unit.numRolls(); ++i) {
-                    int roll = getRoll();
-                    if (roll <= unit.defenseValue())
-                        ++defenderSubHits;
-                }
+    // true if 'side' can score a hit in the round that the other side takes
+    static bool canHit(const Battle& battle, const CombatProgram& program, int side) {
+        const Units& units = (side == CombatStep::SideAttacker) ? battle._attacker : battle._defender;
+        const bool isSupported = program.artillerySupport[side] && (getNumberOfSupporters(units) > 0);
+        for (int i = 0; i < program.round.size(); ++i) {
+            const CombatStep& step = program.round[i];
+            if ((step.type != CombatStep::TypeFire) || (step.side != side) || !canTakeHits(battle, program, i, 1 - side, step.hits))
+                continue;
+            const bool isMarineRound = step.marineBonus && battle._settings.isAmphibiousCombat;
+            foreach (const UnitType& unit, units) {
+                if (!isSelected(unit, step.units))
+                    continue;
+                int value = (side == CombatStep::SideAttacker) ? unit.attackValue() : unit.defenseValue();
+                if ((value > 0) || (step.artillerySupport && isSupported && unit.isArtillerySupportable()) || (isMarineRound && unit.isMarine()))
+                    return true;
             }
         }
+        return false;
+    }
 
-        // if the attacker doesn't have destroyers, apply the casualties directly
-        if (!hasDestroyer(_attacker)) {
-            applyCasualtySub(_attacker, _attackerCasualities, defenderSubHits, false);
-            defenderSubHits = 0;
+    static bool isStalemate(const Battle& battle, const CombatProgram& program) {
+        return !canHit(battle, program, CombatStep::SideAttacker) && !canHit(battle, program, CombatStep::SideDefender);
+    }
+
+    // the dice the step will roll, for tracing
+    static int dice(const Battle& battle, const CombatStep& step) {
+        const Units& attacker = battle._attacker;
+        const Units& defender = battle._defender;
+        int result = 0;
+        switch (step.type) {
+        case CombatStep::TypeAAFire: {
+            int air = 0;
+            foreach (const UnitType& unit, attacker)
+                air += unit.isAir() ? 1 : 0;
+            foreach (const UnitType& unit, defender)
+                result += unit.isAA() ? unit.numRolls() * air : 0;
+            break;
         }
+        case CombatStep::TypeBombardment:
+            foreach (const UnitType& unit, attacker)
+                result += unit.canBombard() ? unit.numRolls() : 0;
+            break;
+        case CombatStep::TypeFire:
+            foreach (const UnitType& unit, (step.side == CombatStep::SideAttacker) ? attacker : defender)
+                result += isSelected(unit, step.units) ? unit.numRolls() : 0;
+            break;
+        case CombatStep::TypeCasualties:
+            break;
+        }
+        return result;
+    }
 
-        // if the defender doesn't have destroyers, apply the casualites directly
-        if (!hasDestroyer(_defender)) {
-            applyCasualtySub(_defender, _defenderCasualities, attackerSubHits, true);
-            attackerSubHits = 0;
+    static Kernel kernel(const CombatStep& step) {
+        switch (step.type) {
+        case CombatStep::TypeAAFire:
+            return &aaFire;
+        case CombatStep::TypeBombardment:
+            return &bombardment;
+        case CombatStep::TypeFire:
+            if (step.side == CombatStep::SideAttacker)
+                return fireKernel<CombatStep::SideAttacker>(step);
+            else
+                return fireKernel<CombatStep::SideDefender>(step);
+        case CombatStep::TypeCasualties:
+            if (step.side == CombatStep::SideAttacker)
+                return casualtiesKernel<CombatStep::SideAttacker>(step);
+            else
+                return casualtiesKernel<CombatStep::SideDefender>(step);
         }
+        return 0;
+    }
+};
 
-        foreach (const UnitLite& unit, _attacker) {
-            if (!unit.isSub()) {
-                for (int i = 0; i < unit.numRolls(); ++i) {
-                    int roll = getRoll();
-                    if (unit.isArtillerySupportable() && (supporter > 0)) {
-                        --roll;
-                        --supporter;
-                    }
+void countFireDice(const Batallion& units, const CombatStep& step, bool isAmphibiousCombat, int dice[7]) {
+    for (int i = 0; i <= 6; ++i)
+        dice[i] = 0;
 
-                    if (roll <= unit.attackValue())
-                        ++attackerHits;
-                }
+    int supporter = 0;
+    if (step.artillerySupport) {
+        foreach (const UnitLite& unit, units)
+            supporter += unit.isArtillery() ? unit.numArtillery() : 0;
+    }
+    const bool isMarineRound = step.marineBonus && isAmphibiousCombat;
+
+    // the same order of the dice as in CombatKernels::fire, so that the support goes to the same units
+    foreach (const UnitLite& unit, units) {
+        if (!CombatKernels<UnitLayoutWide>::isSelected(unit, step.units))
+            continue;
+        int value = (step.side == CombatStep::SideAttacker) ? unit.attackValue() : unit.defenseValue();
+        for (int i = 0; i < unit.numRolls(); ++i) {
+            int target = value;
+            if (unit.isArtillerySupportable() && (supporter > 0)) {
+                ++target;
+                --supporter;
             }
+            if (isMarineRound && unit.isMarine())
+                ++target;
+            ++dice[qBound(0, target, 6)];
         }
+    }
+}
 
-        foreach (const UnitLite& unit, _defender) {
-            if (!unit.isSub()) {
-                for (int i = 0; i < unit.numRolls(); ++i) {
-                    int roll = getRoll();
-                    if (roll <= unit.defenseValue())
-                        ++defenderHits;
-                }
-            }
+template <>
+CombatStep::Kernel<UnitLayoutNarrow>::Type CombatStep::kernel<UnitLayoutNarrow>() const {
+    return narrowKernel;
+}
+
+template <>
+CombatStep::Kernel<UnitLayoutWide>::Type CombatStep::kernel<UnitLayoutWide>() const {
+    return wideKernel;
+}
+
+void CombatProgram::compile() {
+    artillerySupport[CombatStep::SideAttacker] = false;
+    artillerySupport[CombatStep::SideDefender] = false;
+    for (int i = 0; i < opening.size(); ++i) {
+        opening[i].narrowKernel = CombatKernels<UnitLayoutNarrow>::kernel(opening[i]);
+        opening[i].wideKernel = CombatKernels<UnitLayoutWide>::kernel(opening[i]);
+    }
+    for (int i = 0; i < round.size(); ++i) {
+        round[i].narrowKernel = CombatKernels<UnitLayoutNarrow>::kernel(round[i]);
+        round[i].wideKernel = CombatKernels<UnitLayoutWide>::kernel(round[i]);
+        if ((round[i].type == CombatStep::TypeFire) && round[i].artillerySupport)
+            artillerySupport[round[i].side] = true;
+    }
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::run() {
+    if (_trace)
+        runProgram<true>();
+    else
+        runProgram<false>();
+}
+
+template <typename Units>
+inline int damagedUnits(const Units& units, int first = 0) {
+    int result = 0;
+    for (int i = first; i < units.size(); ++i)
+        result += units[i].isHit() ? 1 : 0;
+    return result;
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::traceStep(const CombatStep& step, int round, BattleEvent& battle) {
+    int attackerCasualities = _attackerCasualities.size();
+    int defenderCasualities = _defenderCasualities.size();
+    int damaged = damagedUnits(_attacker) + damagedUnits(_defender);
+    int pool = _hits[1 - step.side][step.hits];
+    int casualtyHits = _hits[step.side][step.hits];
+
+    BattleEvent event;
+    event.dice = CombatKernels<Layout>::dice(*this, step);
+    event.time = BattleTrace::elapsed();
+    step.kernel<Layout>()(*this, step);
+    event.duration = static_cast<quint32>(BattleTrace::elapsed() - event.time);
+
+    int casualties = (_attackerCasualities.size() - attackerCasualities) + (_defenderCasualities.size() - defenderCasualities);
+    // units that were damaged before and die now cancel out
+    damaged = damagedUnits(_attacker) + damagedUnits(_defender) - damaged +
+        damagedUnits(_attackerCasualities, attackerCasualities) + damagedUnits(_defenderCasualities, defenderCasualities);
+    event.battle = _seed;
+    event.round = round;
+    event.casualties = casualties;
+    event.damaged = damaged;
+    event.type = step.type;
+    event.side = step.side;
+    event.units = step.units;
+    event.isLandBattle = _settings.isLandBattle;
+    switch (step.type) {
+    case CombatStep::TypeFire:
+        event.hits = _hits[1 - step.side][step.hits] - pool;
+        break;
+    case CombatStep::TypeCasualties:
+        // no hits are taken if the step did not apply
+        event.hits = (casualties + damaged > 0) ? casualtyHits : 0;
+        break;
+    default:
+        event.hits = casualties + damaged;
+        break;
+    }
+    _trace->append(event);
+
+    battle.dice += event.dice;
+    if (step.type != CombatStep::TypeCasualties)
+        battle.hits += event.hits;
+    battle.casualties += event.casualties;
+    battle.damaged += event.damaged;
+}
+
+template <typename Layout>
+template <bool Traced>
+void BasicBattle<Layout>::runProgram() {
+    const CombatRules& rules = *_settings.rules;
+    const CombatProgram& program = _settings.isLandBattle ? rules.landBattle() : rules.seaBattle();
+    const CombatStep* opening = program.opening.constData();
+    const CombatStep* round = program.round.constData();
+    const int nOpening = program.opening.size();
+    const int nRound = program.round.size();
+    const bool attackerSupport = program.artillerySupport[CombatStep::SideAttacker];
+    const bool defenderSupport = program.artillerySupport[CombatStep::SideDefender];
+
+    BattleEvent battle;
+    if (Traced) {
+        battle.time = BattleTrace::elapsed();
+        battle.battle = _seed;
+        battle.dice = 0;
+        battle.hits = 0;
+        battle.round = 0;
+        battle.casualties = 0;
+        battle.damaged = 0;
+        battle.type = BattleEvent::TypeBattle;
+        battle.units = CombatStep::UnitsAll;
+        battle.isLandBattle = _settings.isLandBattle;
+    }
+
+    for (int i = 0; i < nOpening; ++i) {
+        if (Traced)
+            traceStep(opening[i], 0, battle);
+        else
+            opening[i].kernel<Layout>()(*this, opening[i]);
+    }
+
+    // regular battle. Only casualties change whether the sides can still hit each other, so a
+    // stalemate is looked for before the first round and once after every round without them
+    const int maxRounds = (_settings.maxRounds > 0) ? _settings.maxRounds : INT_MAX;
+    int rounds = 0;
+    int casualties = -1; //< at the beginning of the last round
+    int checkedCasualties = -1; //< at the last stalemate check
+    for (;;) {
+        // a battle that ends on a stalemate or on the round limit is a draw, and is recorded as
+        // over in the round it ends, like any other battle
+        bool isRunning = (_attacker.size() > 0) && (_defender.size() > 0) && (rounds < maxRounds);
+        int currentCasualties = _attackerCasualities.size() + _defenderCasualities.size();
+        if (isRunning && ((rounds == 0) || (currentCasualties == casualties)) && (currentCasualties != checkedCasualties)) {
+            checkedCasualties = currentCasualties;
+            isRunning = !CombatKernels<Layout>::isStalemate(*this, program);
         }
+        recordRound(rounds, isRunning);
+        if (!isRunning)
+            break;
+        casualties = currentCasualties;
+
+        ++rounds;
+        _hits[CombatStep::SideAttacker][CombatStep::HitsRegular] = 0;
+        _hits[CombatStep::SideAttacker][CombatStep::HitsSub] = 0;
+        _hits[CombatStep::SideDefender][CombatStep::HitsRegular] = 0;
+        _hits[CombatStep::SideDefender][CombatStep::HitsSub] = 0;
+        _supporters[CombatStep::SideAttacker] = attackerSupport ? getNumberOfSupporters(_attacker) : 0;
+        _supporters[CombatStep::SideDefender] = defenderSupport ? getNumberOfSupporters(_defender) : 0;
+
+        for (int i = 0; i < nRound; ++i) {
+            if (Traced)
+                traceStep(round[i], rounds, battle);
+            else
+                round[i].kernel<Layout>()(*this, round[i]);
+        }
+    }
 
-        applyCasualtySub(_attacker, _attackerCasualities, defenderSubHits, false);
-        applyCasualtySea(_attacker, _attackerCasualities, defenderHits, false);
-        applyCasualtySub(_defender, _defenderCasualities, attackerSubHits, true);
-        applyCasualtySea(_defender, _defenderCasualities, attackerHits, true);
-    }   
+    if (Traced) {
+        battle.round = rounds;
+        battle.duration = static_cast<quint32>(BattleTrace::elapsed() - battle.time);
+        battle.side = outcome();
+        _trace->append(battle);
+    }
+}
+
+template <typename Layout>
+void BasicBattle<Layout>::recordRound(int index, bool isRunning) {
+    if (_survival) {
+        int attackerIPC = 0;
+        int defenderIPC = 0;
+        foreach (const BasicUnitLite<Layout>& unit, _attacker)
+            attackerIPC += unit.ipcValue();
+        foreach (const BasicUnitLite<Layout>& unit, _defender)
+            defenderIPC += unit.ipcValue();
+        _survival->addRound(index, isRunning, _attacker.size(), _defender.size(), attackerIPC, defenderIPC);
+    }
+
+    if (!_rounds)
+        return;
+
+    CombatRound round;
+    round.attackerUnits = _attacker.size();
+    round.defenderUnits = _defender.size();
+    round.attackerIPCLoss = 0;
+    round.defenderIPCLoss = 0;
+    foreach (const BasicUnitLite<Layout>& unit, _attackerCasualities)
+        round.attackerIPCLoss += unit.ipcValue();
+    foreach (const BasicUnitLite<Layout>& unit, _defenderCasualities)
+        round.defenderIPCLoss += unit.ipcValue();
+    _rounds->append(round);
 }
 
 const Batallion& CombatThread::attacker() const {
@@ -410,3 +1253,62 @@ const Batallion& CombatThread::defender() const {
 const Batallion& CombatThread::defenderCasualities() const {
     return _defenderCasualities;
 }
+
+template <typename Layout>
+const typename BasicBattle<Layout>::Units& BasicBattle<Layout>::attacker() const {
+    return _attacker;
+}
+
+template <typename Layout>
+const typename BasicBattle<Layout>::Units& BasicBattle<Layout>::attackerCasualities() const {
+    return _attackerCasualities;
+}
+
+template <typename Layout>
+const typename BasicBattle<Layout>::Units& BasicBattle<Layout>::defender() const {
+    return _defender;
+}
+
+template <typename Layout>
+const typename BasicBattle<Layout>::Units& BasicBattle<Layout>::defenderCasualities() const {
+    return _defenderCasualities;
+}
+
+template <typename Layout>
+BattleOutcome BasicBattle<Layout>::outcome() const {
+    if ((_attacker.size() == 0) && (_defender.size() > 0))
+        return BattleOutcomeDefenderWins;
+    else if ((_attacker.size() > 0) && (_defender.size() == 0))
+        return BattleOutcomeAttackerWins;
+    else
+        return BattleOutcomeDraw;
+}
+
+template <typename Layout>
+quint32 BasicBattle<Layout>::seed() const {
+    return _seed;
+}
+
+template <typename Layout>
+bool BasicBattle<Layout>::isReplayable() const {
+    return _dice == 0;
+}
+
+void CombatThread::setRecordRounds(bool record) {
+    _recordRounds = record;
+}
+
+const QList<CombatRound>& CombatThread::rounds() const {
+    return _rounds;
+}
+
+template void CombatStatistics::addResult(const BasicBattle<UnitLayoutNarrow>&);
+template void CombatStatistics::addResult(const BasicBattle<UnitLayoutWide>&);
+template class BasicUnitArray<NarrowUnitLite>;
+template class BasicUnitArray<UnitLite>;
+template void applyCasualtyLand(BasicUnitArray<NarrowUnitLite>&, BasicUnitArray<NarrowUnitLite>&, int, bool, OrderOfLoss, bool, bool);
+template void applyCasualtyLand(BasicUnitArray<UnitLite>&, BasicUnitArray<UnitLite>&, int, bool, OrderOfLoss, bool, bool);
+template void applyCasualtySea(BasicUnitArray<NarrowUnitLite>&, BasicUnitArray<NarrowUnitLite>&, int, bool, OrderOfLoss, bool);
+template void applyCasualtySea(BasicUnitArray<UnitLite>&, BasicUnitArray<UnitLite>&, int, bool, OrderOfLoss, bool);
+template class BasicBattle<UnitLayoutNarrow>;
+template class BasicBattle<UnitLayoutWide>;
@@ -26,7 +26,11 @@
 
 #include <QRunnable>
 
+#include "combatrules.h"
+#include "dicegenerator.h"
+#include "quasirandom.h"
 #include "unit.h"
+#include <QByteArray>
 #include <QList>
 #include <QPair>
 
@@ -37,12 +41,254 @@ enum OrderOfLoss {
 
 typedef QList<UnitLite> Batallion;
 
-void applyCasualtyLand(Batallion& bat, Batallion& casBat, int casualties, bool isDefender, bool landUnitMustLive, bool needsSorting = true);
-void applyCasualtySea(Batallion& bat, Batallion& casBat, int casualties, bool isDefender, bool needsSorting = true);
+struct CombatSettings {
+    CombatSettings();
+
+    bool isLandBattle;
+    bool isAmphibiousCombat;
+    bool landUnitMustLive;
+    OrderOfLoss orderOfLoss;
+    int maxRounds; //< 0 for no limit; a battle that is still running after it is a draw
+    QSharedPointer<const CombatRules> rules;
+    bool narrowUnits; //< the battles use UnitLayoutNarrow; only if all units of the map fit into it
+};
+
+template <typename Layout> class BasicBattle;
+struct BattleEvent;
+class TraceBuffer;
+
+// State of a battle at the beginning of a round. The IPC losses are cumulative and stored in
+// multiples of the map's ipc factor
+struct CombatRound {
+    int attackerUnits;
+    int defenderUnits;
+    int attackerIPCLoss;
+    int defenderIPCLoss;
+};
+
+enum BattleOutcome {
+    BattleOutcomeAttackerWins,
+    BattleOutcomeDefenderWins,
+    BattleOutcomeDraw
+};
+
+// Uniform sample of the seeds of a run's battles per outcome. Every battle gets a key computed
+// from its seed and only the battles with the smallest keys are kept, so the samples of different
+// batches merge into a sample of the whole run in any order and the memory does not grow with the
+// number of battles. As a battle is determined by its seed, the sampled battles can be replayed
+// completely with replayBattle
+class BattleReservoir {
+public:
+    enum { Capacity = 5 };
+
+    BattleReservoir();
+
+    void add(BattleOutcome outcome, quint32 seed);
+    void merge(const BattleReservoir& other);
+    QList<quint32> seeds(BattleOutcome outcome) const;
+
+private:
+    static quint32 key(quint32 seed);
+
+    int _size[3];
+    quint32 _keys[3][Capacity]; //< ascending
+    quint32 _seeds[3][Capacity];
+};
+
+// A battle with everything that happened in it
+struct BattleRecord {
+    BattleOutcome outcome;
+    quint32 seed;
+    Batallion attacker;
+    Batallion attackerCasualities;
+    Batallion defender;
+    Batallion defenderCasualities;
+    QList<CombatRound> rounds;
+};
+
+// Expected course of the battles over the rounds. Round 0 is the state after the opening steps,
+// round r the state after r regular rounds; a battle that is over counts with its final state.
+// Only sums per round are kept, so the memory does not depend on the number of battles
+struct SurvivalCurve {
+    enum { Rounds = 16 }; //< later rounds are not recorded
+
+    SurvivalCurve();
+
+    // the state of a battle at the beginning of 'round'; it is called until the battle is over
+    void addRound(int round, bool isRunning, int attackerUnits, int defenderUnits, int attackerIPC, int defenderIPC);
+    void merge(const SurvivalCurve& other);
+
+    int rounds() const; //< the recorded rounds up to the last one in which a battle was still running
+    float runningProbability(int round) const;
+    float expectedUnits(bool attacker, int round) const;
+    float expectedIPC(bool attacker, int round) const; //< of the surviving units, in multiples of the ipc factor
+
+    qint64 battles;
+    qint64 running[Rounds];
+    qint64 runningUnits[2][Rounds];     //< per CombatStep::Side
+    qint64 runningIPC[2][Rounds];
+    qint64 endedUnits[2][Rounds];       //< of the battles that ended in the round
+    qint64 endedIPC[2][Rounds];
+};
+
+// Aggregated outcome of many battles of the same setup. IPC losses are stored in multiples of
+// the map's ipc factor, just like UnitLite::ipcValue
+struct CombatStatistics {
+    CombatStatistics();
+
+    template <typename Layout>
+    void addResult(const BasicBattle<Layout>& result);
+    void merge(const CombatStatistics& other);
+
+    float attackerWinProbability() const;
+    void attackerWinInterval(float& lower, float& upper) const; //< 95% Wilson score interval
+
+    int battles;
+    int attackerWins;
+    int defenderWins;
+    int draws;
+    qint64 attackerIPCLoss;
+    qint64 defenderIPCLoss;
+    qint64 attackerUnitsLeft;
+    qint64 defenderUnitsLeft;
+    BattleReservoir examples; //< of the battles with pseudo-random dice
+    SurvivalCurve survival;
+};
+
+BattleRecord replayBattle(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, quint32 seed);
+
+// runs 'battles' battles in the calling thread; the same seed always gives the same result
+CombatStatistics simulateCombat(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles, int seed);
+// runs 'battles' battles in the calling thread with the dice of the points 'first', 'first + 1', ...
+// of 'sequence'; 'seed' is used for the dice beyond its dimensions
+CombatStatistics simulateCombat(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles,
+    const SobolSequence& sequence, int first, int seed);
+
+// Units of one side of a battle in one of the layouts of BasicUnitLite. The memory belongs to a
+// BattleArena, so the array never allocates or frees anything and its capacity is fixed when it
+// is created
+template <typename UnitType>
+class BasicUnitArray {
+public:
+    typedef UnitType* iterator;
+    typedef const UnitType* const_iterator;
+
+    BasicUnitArray();
+    BasicUnitArray(UnitType* data, int capacity);
+
+    int size() const;
+    bool isEmpty() const;
+    UnitType& operator[](int i);
+    const UnitType& operator[](int i) const;
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    void append(const UnitType& unit);
+    void removeAt(int i);
+    void removeFirst();
+    void assign(const Batallion& units); //< converted into the layout of the array
+    Batallion toBatallion() const;
+
+private:
+    UnitType* _data;
+    int _size;
+    int _capacity;
+};
+
+typedef BasicUnitArray<UnitLite> UnitArray;
+
+// Memory for the units of the battle that is currently fought in a thread. It is reused for
+// every battle, so after the first battles no more memory is allocated
+class BattleArena {
+public:
+    static BattleArena& local(); //< the arena of the calling thread
+
+    // invalidates all arrays and makes sure that 'units' units of the type fit into the arena
+    template <typename UnitType>
+    void reset(int units);
+    template <typename UnitType>
+    BasicUnitArray<UnitType> allocate(int units);
+
+private:
+    BattleArena();
+
+    QByteArray _memory;
+    int _used;
+};
+
+// dice per target value 0 to 6 that 'units' roll in the fire step 'step' of the firing side at
+// the beginning of a round, with the artillery support and the marine bonus of a battle
+void countFireDice(const Batallion& units, const CombatStep& step, bool isAmphibiousCombat, int dice[7]);
+
+template <typename UnitType>
+void applyCasualtyLand(BasicUnitArray<UnitType>& bat, BasicUnitArray<UnitType>& casBat, int casualties, bool isDefender, OrderOfLoss ool,
+    bool landUnitMustLive, bool needsSorting = true);
+template <typename UnitType>
+void applyCasualtySea(BasicUnitArray<UnitType>& bat, BasicUnitArray<UnitType>& casBat, int casualties, bool isDefender, OrderOfLoss ool,
+    bool needsSorting = true);
+
+// A single battle whose units live in the BattleArena of the calling thread, so only one
+// battle per thread can exist at a time. It runs the combat program of the settings' rules;
+// the settings have to outlive the battle. While BattleTrace is enabled, its steps are traced.
+// The battle ends in a draw with units on both sides if the round limit of the settings is
+// reached or no side can hit the other one anymore, for example if only units without an
+// attack value are left. The battle is compiled for both unit layouts; callers pick the one of
+// CombatSettings::narrowUnits once for all battles of a setup
+template <typename Layout>
+class BasicBattle {
+public:
+    typedef BasicUnitArray<BasicUnitLite<Layout> > Units;
+
+    BasicBattle(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, quint32 seed);
+
+    void run();
+    // if set, the state before the first regular round and after every round is recorded
+    void setRounds(QList<CombatRound>* rounds);
+    // if set, the dice are taken from 'dice' instead of the battle's own generator
+    void setDice(QuasiRandomDice* dice);
+    // if set, every round of the battle is added to 'survival'
+    void setSurvivalCurve(SurvivalCurve* survival);
+
+    const Units& attacker() const;
+    const Units& attackerCasualities() const;
+    const Units& defender() const;
+    const Units& defenderCasualities() const;
+    BattleOutcome outcome() const;
+    quint32 seed() const;
+    bool isReplayable() const; //< false if the dice did not come from the seed
+
+private:
+    template <typename Other>
+    friend struct CombatKernels;
+
+    template <bool Traced>
+    void runProgram();
+    void traceStep(const CombatStep& step, int round, BattleEvent& battle);
+    void recordRound(int index, bool isRunning); //< 'isRunning' is false for the final state
+    int roll();
+
+    Units _attacker;
+    Units _attackerCasualities;
+    Units _defender;
+    Units _defenderCasualities;
+    const CombatSettings& _settings;
+    QList<CombatRound>* _rounds;
+    SurvivalCurve* _survival;
+    quint32 _seed;
+    DiceGenerator _random;
+    QuasiRandomDice* _dice;
+    TraceBuffer* _trace;    //< only if tracing was enabled when the battle was created
+    int _hits[2][2];        //< per receiving side and CombatStep::Hits
+    int _supporters[2];     //< artillery support left in this round per side
+};
+
 
 class CombatThread : public QRunnable {
 public:
     CombatThread(const Batallion& attacker, const Batallion& defender, bool isLandBattle, bool isAmphibiousCombat, bool landUnitMustLive, OrderOfLoss ool, int seedHelper);
+    CombatThread(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int seedHelper);
 
     void run();
 
@@ -51,18 +297,22 @@ public:
     const Batallion& defender() const;
     const Batallion& defenderCasualities() const;
 
-private:
-    void runLandBattle();
-    void runSeaBattle();
+    // if enabled, the state before the first regular round and after every round is recorded
+    void setRecordRounds(bool record);
+    const QList<CombatRound>& rounds() const;
 
+private:
     Batallion _attacker;
     Batallion _attackerCasualities;
     Batallion _defender;
     Batallion _defenderCasualities;
-    bool _isLandBattle;
-    bool _isAmphibiousCombat;
-    bool _landUnitMustLive;
+    CombatSettings _settings;
     int _seedHelper;
+    bool _recordRounds;
+    QList<CombatRound> _rounds;
+
+    template <typename Layout>
+    void runBattle();
 };
 
 #endif
@@ -23,18 +23,31 @@
 
 #include "combatwidget.h"
 
+#include "amphibiousassault.h"
+#include "combatscheduler.h"
 #include "controlwidget.h"
 #include "factionwidget.h"
+#include "forceoptimizer.h"
+#include "iconcache.h"
+#include "oddstable.h"
+#include "retreatanalysis.h"
+#include "scenariocomparison.h"
 #include "simulatorapplication.h"
+#include "speculativecache.h"
+#include "sweepwidget.h"
+#include "unitwidget.h"
 
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomNode>
 #include <QFile>
+#include <QFileDialog>
 #include <QHBoxLayout>
 #include <QIcon>
+#include <QInputDialog>
 #include <QMessageBox>
 #include <QtConcurrentRun>
+#include <QTimer>
 #include <QVBoxLayout>
 
 #include <QDateTime>
@@ -42,18 +55,50 @@
 #include <math.h>
 #include <time.h>
 
+namespace {
+    const int BATTLES = 30000;
+    const int MAXBATTLES = 10000000; // with a time limit
+    const int SPECULATIONDELAY = 300; // ms without changes before the speculative runs start
+    const int SPECULATIONS = 9; // the current setup and its closest neighbors
+    const int TABLEBATTLES = 1 << 16; // the exact odds are shown as the results of that many battles
+    const char* ODDSTABLESUFFIX = ".aaot";
+    const char* SCENARIOFILTER = "Scenarios (*.aaacs);;All files (*)";
+
+    QList<QPair<int, int> > unitCounts(const QList<QPair<Unit*, int> >& units) {
+        QList<QPair<int, int> > result;
+        for (int i = 0; i < units.size(); ++i)
+            result.append(qMakePair(units[i].first->id(), units[i].second));
+        return result;
+    }
+
+    bool isSameResult(const CombatStatistics& lhs, const CombatStatistics& rhs) {
+        return (lhs.battles == rhs.battles) && (lhs.attackerWins == rhs.attackerWins) && (lhs.defenderWins == rhs.defenderWins) &&
+            (lhs.draws == rhs.draws) && (lhs.attackerIPCLoss == rhs.attackerIPCLoss) && (lhs.defenderIPCLoss == rhs.defenderIPCLoss) &&
+            (lhs.attackerUnitsLeft == rhs.attackerUnitsLeft) && (lhs.defenderUnitsLeft == rhs.defenderUnitsLeft);
+    }
+}
+
 CombatWidget::CombatWidget(const QString& directory, QWidget* parent)
     : QWidget(parent)
     , _attackerWidget(nullptr)
     , _defenderWidget(nullptr)
     , _controlWidget(nullptr)
+    , _sweepWidget(0)
+    , _speculation(0)
+    , _speculationTimer(0)
+    , _oddsTable(0)
     , _attackerLayout(nullptr)
     , _directory(directory)
     , _ipcFactor(1)
+    , _narrowUnits(true)
+    , _rules(CombatRules::defaultRules())
 {
     initXML(directory + "/" + directory + ".xml");
+    prefetchIcons();
 
-    QHBoxLayout* layout = new QHBoxLayout(this);
+    QVBoxLayout* mainLayout = new QVBoxLayout(this);
+    QHBoxLayout* layout = new QHBoxLayout;
+    mainLayout->addLayout(layout);
     _attackerLayout = new QVBoxLayout;
     
     _controlWidget = new ControlWidget(this);
@@ -65,15 +110,38 @@ CombatWidget::CombatWidget(const QString& directory, QWidget* parent)
     _defenderWidget = new FactionWidget(this, "Defender", FactionSideDefender);
     layout->addWidget(_defenderWidget);
 
-    connect(_controlWidget, SIGNAL(landBattleCheckboxDidChange()), _attackerWidget, SLOT(recreateUnits()));
-    connect(_controlWidget, SIGNAL(landBattleCheckboxDidChange()), _defenderWidget, SLOT(recreateUnits()));
+    connect(_controlWidget, SIGNAL(landBattleCheckboxDidChange()), _attackerWidget, SLOT(updateUnits()));
+    connect(_controlWidget, SIGNAL(landBattleCheckboxDidChange()), _defenderWidget, SLOT(updateUnits()));
     connect(_controlWidget, SIGNAL(switchSides()), this, SLOT(switchCombatSides()));
     connect(_controlWidget, SIGNAL(startCombat()), this, SLOT(startCombat()));
+    connect(_controlWidget, SIGNAL(optimizeForce()), this, SLOT(optimizeForce()));
+    connect(_controlWidget, SIGNAL(analyzeRetreat()), this, SLOT(analyzeRetreat()));
+    connect(_controlWidget, SIGNAL(compareScenarios()), this, SLOT(compareScenarios()));
+    connect(_controlWidget, SIGNAL(amphibiousAssault()), this, SLOT(amphibiousAssault()));
+    connect(_controlWidget, SIGNAL(saveScenario()), this, SLOT(saveScenario()));
+    connect(_controlWidget, SIGNAL(loadScenario()), this, SLOT(loadScenario()));
     connect(_controlWidget, SIGNAL(clear()), this, SLOT(clear()));
     layout->addWidget(_controlWidget);
+
+    _sweepWidget = new SweepWidget(this);
+    _sweepWidget->hide();
+    connect(_controlWidget, SIGNAL(parameterSweepToggled(bool)), _sweepWidget, SLOT(setVisible(bool)));
+    mainLayout->addWidget(_sweepWidget);
+
+    _speculation = new SpeculativeCache(BATTLES, this);
+    _speculationTimer = new QTimer(this);
+    _speculationTimer->setSingleShot(true);
+    _speculationTimer->setInterval(SPECULATIONDELAY);
+    connect(_speculationTimer, SIGNAL(timeout()), this, SLOT(speculate()));
+    connect(_attackerWidget, SIGNAL(unitsChanged()), this, SLOT(unitsChanged()));
+    connect(_defenderWidget, SIGNAL(unitsChanged()), this, SLOT(unitsChanged()));
+
+    _oddsTable = new OddsTable(qApp->mapsDirectory(directory).filePath(directory + ODDSTABLESUFFIX));
+    openOddsTable();
 }
 
 CombatWidget::~CombatWidget() {
+    delete _oddsTable;
     qDeleteAll(_units);
 }
 
@@ -117,6 +185,23 @@ void CombatWidget::initXML(const QString& xmlFile) {
             _ipcFactor = 2;
         //if (ipc != static_cast<float>(static_cast<int>(ipc)))
     }
+    // checked after the loop, as a single unit with half an IPC changes the factor for all of them.
+    // Units that do not fit into the UnitLite fields would be truncated, so they are left out
+    QStringList errors;
+    for (int i = 0; i < _units.size(); ++i) {
+        Unit* u = _units[i];
+        QString error = UnitLite::checkLimits(u, _ipcFactor);
+        if (error.isEmpty())
+            continue;
+        errors.append("'" + u->name() + "': " + error);
+        _idMap.remove(u->id());
+        _units.removeAt(i--);
+        delete u;
+    }
+    if (!errors.isEmpty())
+        QMessageBox::critical(0, "XML Error", "The following units are not supported and were left out:\n" + errors.join("\n"));
+    // the battles of the standard maps run with the compact units
+    _narrowUnits = NarrowUnitLite::fits(_units, _ipcFactor);
 
     QDomElement factionsElem = docElem.firstChildElement("Factions");
     if (factionsElem.isNull()) {
@@ -137,6 +222,16 @@ void CombatWidget::initXML(const QString& xmlFile) {
         }
         _factionsDetail.insert(groupName, f);
     }
+
+    QDomElement rulesElem = docElem.firstChildElement("Rules");
+    if (!rulesElem.isNull()) {
+        QString error;
+        QSharedPointer<const CombatRules> rules = CombatRules::fromXML(rulesElem, error);
+        if (rules)
+            _rules = rules;
+        else
+            QMessageBox::critical(0, "XML Error", "Invalid 'Rules' tag in XML file '" + xmlFile + "': " + error);
+    }
 }
 
 QStringList CombatWidget::factions() const {
@@ -156,12 +251,24 @@ QList<Unit*> CombatWidget::units() const {
 }
 
 QIcon CombatWidget::flag(const QString& faction) const {
-    return QIcon(_directory + "/" + faction + "/" + faction + ".png");
+    return QIcon(IconCache::instance()->pixmap(_directory, faction, faction));
 }
 
-QPixmap CombatWidget::unitIcon(const QString& faction, int unitID) const {
+QPixmap CombatWidget::unitIcon(const QString& faction, int unitID, int width) const {
     QString unitName = nameForID(unitID);
-    return QPixmap(_directory + "/" + faction + "/" + unitName + ".png");
+    return IconCache::instance()->pixmap(_directory, faction, unitName, width);
+}
+
+void CombatWidget::prefetchIcons() {
+    QStringList unitNames;
+    foreach (const Unit* unit, _units)
+        unitNames.append(unit->name());
+
+    IconCache* cache = IconCache::instance();
+    foreach (const QString& faction, _factions) {
+        cache->prefetch(_directory, faction, QStringList(faction));
+        cache->prefetch(_directory, faction, unitNames, UnitWidget::IconWidth);
+    }
 }
 
 QString CombatWidget::nameForID(int id) const {
@@ -184,6 +291,40 @@ OrderOfLoss CombatWidget::orderOfLoss() const {
     return _controlWidget->orderOfLoss();
 }
 
+CombatSettings CombatWidget::combatSettings() const {
+    CombatSettings settings;
+    settings.isLandBattle = isLandBattle();
+    settings.isAmphibiousCombat = isAmphibiousCombat();
+    settings.landUnitMustLive = landUnitMustLive();
+    settings.orderOfLoss = orderOfLoss();
+    settings.maxRounds = _controlWidget->maxRounds();
+    settings.rules = _rules;
+    settings.narrowUnits = _narrowUnits;
+    return settings;
+}
+
+int CombatWidget::ipcFactor() const {
+    return _ipcFactor;
+}
+
+QList<QPair<Unit*, int> > CombatWidget::attackerUnits() const {
+    return _attackerWidget->getUnits();
+}
+
+QList<QPair<Unit*, int> > CombatWidget::defenderUnits() const {
+    return _defenderWidget->getUnits();
+}
+
+Batallion CombatWidget::batallion(const QList<QPair<Unit*, int> >& units) const {
+    Batallion result;
+    QPair<Unit*, int> p;
+    foreach (p, units) {
+        for (int i = 0; i < p.second; ++i)
+            result.append(UnitLite(p.first, _ipcFactor));
+    }
+    return result;
+}
+
 const QString& CombatWidget::directory() const {
     return _directory;
 }
@@ -205,111 +346,537 @@ void CombatWidget::clear() {
     _defenderWidget->clear();
 }
 
-QList<CombatThread*> CombatWidget::startCombat(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits) {
+void CombatWidget::unitsChanged() {
+    // the running speculation is about a setup that is not entered anymore
+    _speculation->stop();
+    _speculationTimer->start();
+}
+
+void CombatWidget::speculate() {
+    QList<QPair<Unit*, int> > units[2] = { _attackerWidget->getUnits(), _defenderWidget->getUnits() };
+    if (units[0].isEmpty() || units[1].isEmpty())
+        return;
+
+    // the current setup first, then one unit more or less of each entered type
+    QList<QPair<Batallion, Batallion> > setups;
+    setups.append(qMakePair(batallion(units[0]), batallion(units[1])));
+    for (int side = 0; side < 2; ++side) {
+        for (int i = 0; i < units[side].size(); ++i) {
+            for (int change = 1; change >= -1; change -= 2) {
+                QList<QPair<Unit*, int> > neighbor[2] = { units[0], units[1] };
+                neighbor[side][i].second += change;
+                if (neighbor[side][i].second == 0)
+                    neighbor[side].removeAt(i);
+                if (!neighbor[side].isEmpty() && (setups.size() < SPECULATIONS))
+                    setups.append(qMakePair(batallion(neighbor[0]), batallion(neighbor[1])));
+            }
+        }
+    }
+    _speculation->speculate(setups, combatSettings(), _controlWidget->samplingMode());
+}
+
+CombatStatistics CombatWidget::startCombat(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits,
+                                           int battles, int timeBudget, quint32 seed, float& attackerWinError, float& defenderWinError)
+{
     _attackerWidget->clearResults();
     _defenderWidget->clearResults();
     qApp->processEvents();
 
-    QList<CombatThread*> results;
-    for (int i = 0; i < 30000; ++i) {
-        CombatThread* result = new CombatThread(attackerUnits, defenderUnits, isLandBattle(), isAmphibiousCombat(), landUnitMustLive(), orderOfLoss(), qrand());
-        results.append(result);
-        QThreadPool::globalInstance()->start(result);
-    }
-    QThreadPool::globalInstance()->waitForDone();
-
-    return results;
-}
-
-CombatWidget::CombatResult CombatWidget::computeCombatResults(const QList<CombatThread*>& results) {
-    int attackerWins = 0;
-    int averageAttackerUnit = 0;
-    int averageAttackerIPCLoss = 0;
-    int defenderWins = 0;
-    int averageDefenderUnit = 0;
-    int averageDefenderIPCLoss = 0;
-    int draw = 0;
-    foreach (const CombatThread* result, results) {
-        const Batallion& attacker = result->attacker();
-        const Batallion& attackerCas = result->attackerCasualities();
-        const Batallion& defender = result->defender();
-        const Batallion& defenderCas = result->defenderCasualities();
-        
-        averageAttackerUnit += (attacker.size());
-        
-        foreach (const UnitLite& unit, attackerCas)
-            averageAttackerIPCLoss += unit.ipcValue();
-        
-        averageDefenderUnit += (defender.size());
-        
-        foreach (const UnitLite& unit, defenderCas)
-            averageDefenderIPCLoss += unit.ipcValue();
-        
-        if ((attacker.size() == 0) && (defender.size() > 0))
-            ++defenderWins;
-        else if ((attacker.size() > 0) && (defender.size() == 0))
-            ++attackerWins;
-        else
-            ++draw;
-    }
+    CombatStatisticsJob job(attackerUnits, defenderUnits, combatSettings(), battles, CombatPriorityInteractive, 250, _controlWidget->samplingMode());
+    job.setSeed(seed);
+    job.setTimeBudget(timeBudget);
+    job.start();
+    job.waitForFinished();
 
-    float attIpc = static_cast<float>(averageAttackerIPCLoss) / static_cast<float>(_ipcFactor);
-    float defIpc = static_cast<float>(averageDefenderIPCLoss) / static_cast<float>(_ipcFactor);
+    attackerWinError = job.winProbabilityError(true);
+    defenderWinError = job.winProbabilityError(false);
+    return job.statistics();
+}
+
+CombatWidget::CombatResult CombatWidget::computeCombatResults(const CombatStatistics& statistics) {
+    float attIpc = static_cast<float>(statistics.attackerIPCLoss) / static_cast<float>(_ipcFactor);
+    float defIpc = static_cast<float>(statistics.defenderIPCLoss) / static_cast<float>(_ipcFactor);
     
     CombatResult result;
-    result.attackerWins = static_cast<float>(attackerWins)/results.size();
-    result.defenderWins = static_cast<float>(defenderWins)/results.size();
-    result.draw = static_cast<float>(draw)/results.size();
-    result.averageAttackerIPC = attIpc/results.size();
-    result.averageAttackerUnit = static_cast<float>(averageAttackerUnit)/results.size();
-    result.averageDefenderIPC = defIpc/results.size();
-    result.averageDefenderUnit = static_cast<float>(averageDefenderUnit)/results.size();
+    result.attackerWins = static_cast<float>(statistics.attackerWins)/statistics.battles;
+    result.defenderWins = static_cast<float>(statistics.defenderWins)/statistics.battles;
+    result.draw = static_cast<float>(statistics.draws)/statistics.battles;
+    result.averageAttackerIPC = attIpc/statistics.battles;
+    result.averageAttackerUnit = static_cast<float>(statistics.attackerUnitsLeft)/statistics.battles;
+    result.averageDefenderIPC = defIpc/statistics.battles;
+    result.averageDefenderUnit = static_cast<float>(statistics.defenderUnitsLeft)/statistics.battles;
     return result;
 }
 
-//#define TIMING
+void CombatWidget::showResults(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits, const CombatStatistics& statistics,
+                               float attackerWinError, float defenderWinError, bool isExact)
+{
+    CombatResult combatResult = computeCombatResults(statistics);
+    int battles = isExact ? 0 : statistics.battles;
 
-void CombatWidget::startCombat() {
-    QList<UnitLite> attackerUnits;
-    
-    QPair<Unit*, int> p;
-    foreach (p, _attackerWidget->getUnits()) {
-        for (int i = 0; i < p.second; ++i)
-            attackerUnits.append(UnitLite(p.first, _ipcFactor));
+    _attackerWidget->setResults(combatResult.attackerWins, attackerWinError, battles, combatResult.draw, combatResult.attackerWins > combatResult.defenderWins,
+        combatResult.averageAttackerUnit, attackerUnits.size(), combatResult.averageAttackerIPC);
+
+    _defenderWidget->setResults(combatResult.defenderWins, defenderWinError, battles, combatResult.draw, combatResult.defenderWins > combatResult.attackerWins, 
+        combatResult.averageDefenderUnit, defenderUnits.size(), combatResult.averageDefenderIPC);
+
+    // only the seeds of the examples were kept, so they are played again to get the details
+    CombatSettings settings = combatSettings();
+    QList<BattleRecord> examples;
+    for (int outcome = BattleOutcomeAttackerWins; outcome <= BattleOutcomeDraw; ++outcome) {
+        foreach (quint32 seed, statistics.examples.seeds(static_cast<BattleOutcome>(outcome)))
+            examples.append(replayBattle(attackerUnits, defenderUnits, settings, seed));
     }
-    QList<UnitLite> defenderUnits;
-    foreach (p, _defenderWidget->getUnits()) {
-        for (int i = 0; i < p.second; ++i)
-            defenderUnits.append(UnitLite(p.first, _ipcFactor));
+    _attackerWidget->setExamples(examples);
+    _defenderWidget->setExamples(examples);
+    _attackerWidget->setSurvivalCurve(statistics.survival);
+    _defenderWidget->setSurvivalCurve(statistics.survival);
+}
+
+bool CombatWidget::lookupOdds(const ScenarioRecord& run, CombatStatistics& statistics) const {
+    ExactOdds odds;
+    if (!_oddsTable->lookup(run.attackerUnits, run.defenderUnits, combatSettings(), odds))
+        return false;
+
+    // no examples or survival curve, as no battle was fought
+    statistics = CombatStatistics();
+    statistics.battles = TABLEBATTLES;
+    statistics.attackerWins = qRound(odds.attackerWinProbability * TABLEBATTLES);
+    statistics.defenderWins = qRound(odds.defenderWinProbability * TABLEBATTLES);
+    statistics.draws = TABLEBATTLES - statistics.attackerWins - statistics.defenderWins;
+    statistics.attackerIPCLoss = qRound64(odds.attackerIPCLoss * TABLEBATTLES);
+    statistics.defenderIPCLoss = qRound64(odds.defenderIPCLoss * TABLEBATTLES);
+    statistics.attackerUnitsLeft = qRound64(odds.attackerUnitsLeft * TABLEBATTLES);
+    statistics.defenderUnitsLeft = qRound64(odds.defenderUnitsLeft * TABLEBATTLES);
+    return true;
+}
+
+void CombatWidget::openOddsTable() {
+    // a table of another version of the map might have been computed with other units
+    if (QFile::exists(_oddsTable->fileName()) && (!_oddsTable->open() || (_oddsTable->mapVersion() != qApp->localMapVersion(_directory))))
+        _oddsTable->close();
+}
+
+bool CombatWidget::generateOddsTable(const QMap<QString, int>& bounds, QString& error) {
+    QList<QPair<Unit*, int> > attackerBounds;
+    QList<QPair<Unit*, int> > defenderBounds;
+    QStringList unknown = bounds.keys();
+    foreach (Unit* unit, _units) {
+        if (!bounds.contains(unit->name()))
+            continue;
+        unknown.removeOne(unit->name());
+        if (unit->canAttack())
+            attackerBounds.append(qMakePair(unit, bounds.value(unit->name())));
+        defenderBounds.append(qMakePair(unit, bounds.value(unit->name())));
+    }
+    if (!unknown.isEmpty()) {
+        error = "The map " + _directory + " has no units named " + unknown.join(", ");
+        return false;
     }
 
+    CombatSettings settings = combatSettings();
+    settings.isLandBattle = true;
+    settings.landUnitMustLive = false;
+    settings.maxRounds = 0;
+    // the mapped file cannot be replaced on every platform
+    _oddsTable->close();
+    bool success = OddsTable::generate(_oddsTable->fileName(), qApp->localMapVersion(_directory), attackerBounds, defenderBounds,
+        _ipcFactor, settings, error);
+    openOddsTable();
+    return success;
+}
+
+ScenarioRecord CombatWidget::scenario() const {
+    ScenarioRecord result;
+    result.map = _directory;
+    result.mapVersion = qApp->localMapVersion(_directory);
+    result.attackerFaction = _attackerWidget->faction();
+    result.defenderFaction = _defenderWidget->faction();
+    result.attackerUnits = unitCounts(_attackerWidget->getUnits());
+    result.defenderUnits = unitCounts(_defenderWidget->getUnits());
+    result.isLandBattle = isLandBattle();
+    result.isAmphibiousCombat = isAmphibiousCombat();
+    result.landUnitMustLive = landUnitMustLive();
+    result.orderOfLoss = orderOfLoss();
+    result.maxRounds = _controlWidget->maxRounds();
+    result.sampling = _controlWidget->samplingMode();
+    return result;
+}
+
+//#define TIMING
+
+void CombatWidget::startCombat() {
+    QList<UnitLite> attackerUnits = batallion(_attackerWidget->getUnits());
+    QList<UnitLite> defenderUnits = batallion(_defenderWidget->getUnits());
+
     qsrand(QDateTime::currentMSecsSinceEpoch());
+    ScenarioRecord run = scenario();
+    run.seed = qrand();
 
 #ifdef TIMING
     QTime t;
     t.start();
 #endif
 
-    QList<CombatThread*> results = startCombat(attackerUnits, defenderUnits);
+    float attackerWinError = 0.f;
+    float defenderWinError = 0.f;
+    CombatStatistics statistics;
+    int timeBudget = _controlWidget->timeBudget();
+    SpeculativeCache::Result speculated;
+    bool isExact = lookupOdds(run, statistics);
+    bool isSpeculated = !isExact && _speculation->take(attackerUnits, defenderUnits, combatSettings(), _controlWidget->samplingMode(), speculated);
+    if (isExact) {
+        run.seed = 0;
+        timeBudget = 0;
+    }
+    else if (isSpeculated) {
+        run.seed = speculated.seed;
+        statistics = speculated.statistics;
+        attackerWinError = speculated.attackerWinError;
+        defenderWinError = speculated.defenderWinError;
+        timeBudget = 0;
+    }
+    else {
+        _speculation->stop();
+        statistics = startCombat(attackerUnits, defenderUnits, (timeBudget > 0) ? MAXBATTLES : BATTLES, timeBudget, run.seed,
+            attackerWinError, defenderWinError);
+    }
 
 #ifdef TIMING
     int combatTime = t.elapsed();
 #endif
 
-    CombatResult combatResult = computeCombatResults(results);
+    showResults(attackerUnits, defenderUnits, statistics, attackerWinError, defenderWinError, isExact);
+    run.statistics = statistics;
+    run.attackerWinError = attackerWinError;
+    run.defenderWinError = defenderWinError;
+    run.isTimed = (timeBudget > 0);
+    run.isExact = isExact;
+    _lastRun = run;
+    _speculationTimer->start();
 
 #ifdef TIMING
     int computeTime = t.elapsed();
 #endif
 
 #ifdef TIMING
-    qDebug("Time elapsed (Combat): %d ms", combatTime);
+    qDebug("Time elapsed (Combat): %d ms for %d battles%s", combatTime, statistics.battles,
+        isExact ? " (odds table)" : (isSpeculated ? " (speculated)" : ""));
     qDebug("Time elapsed (Result): %d ms", computeTime- combatTime);
+    qDebug("Attacker win error: %.3f%% (95%% confidence, %s dice)", attackerWinError * 100,
+        (_controlWidget->samplingMode() == SamplingModeQuasiRandom) ? "quasi-random" : "pseudo-random");
+    qDebug("Queued batches: %d interactive, %d background", CombatScheduler::instance()->queueDepth(CombatPriorityInteractive),
+        CombatScheduler::instance()->queueDepth(CombatPriorityBackground));
+    qDebug("Average wait: %d ms interactive, %d ms background", CombatScheduler::instance()->averageWaitTime(CombatPriorityInteractive),
+        CombatScheduler::instance()->averageWaitTime(CombatPriorityBackground));
 #endif
-    
-    _attackerWidget->setResults(&results, combatResult.attackerWins, combatResult.draw, combatResult.attackerWins > combatResult.defenderWins,
-        combatResult.averageAttackerUnit, attackerUnits.size(), combatResult.averageAttackerIPC);
+}
 
-    _defenderWidget->setResults(&results, combatResult.defenderWins, combatResult.draw, combatResult.defenderWins > combatResult.attackerWins, 
-        combatResult.averageDefenderUnit, defenderUnits.size(), combatResult.averageDefenderIPC);
+void CombatWidget::openScenario(const ScenarioRecord& record, bool replay) {
+    QList<QPair<Unit*, int> > units[2];
+    const QList<QPair<int, int> >* counts[2] = { &record.attackerUnits, &record.defenderUnits };
+    bool isComplete = true;
+    for (int side = 0; side < 2; ++side) {
+        for (int i = 0; i < counts[side]->size(); ++i) {
+            Unit* unit = _idMap.value(counts[side]->at(i).first, 0);
+            if (unit)
+                units[side].append(qMakePair(unit, counts[side]->at(i).second));
+            else
+                isComplete = false;
+        }
+    }
+
+    // the land battle setting determines which of the other settings are available
+    _controlWidget->setLandBattle(record.isLandBattle);
+    _controlWidget->setAmphibiousCombat(record.isAmphibiousCombat);
+    _controlWidget->setLandUnitMustLive(record.landUnitMustLive);
+    _controlWidget->setOrderOfLoss(record.orderOfLoss);
+    _controlWidget->setMaxRounds(record.maxRounds);
+    _controlWidget->setSamplingMode(record.sampling);
+    _attackerWidget->setFaction(record.attackerFaction);
+    _defenderWidget->setFaction(record.defenderFaction);
+    _attackerWidget->setUnits(units[0]);
+    _defenderWidget->setUnits(units[1]);
+
+    Batallion attackerUnits = batallion(units[0]);
+    Batallion defenderUnits = batallion(units[1]);
+    bool isOutdated = !isComplete || (record.mapVersion != qApp->localMapVersion(_directory));
+    if (!replay && !isOutdated) {
+        showResults(attackerUnits, defenderUnits, record.statistics, record.attackerWinError, record.defenderWinError, record.isExact);
+        _lastRun = record;
+        return;
+    }
+
+    ScenarioRecord run = scenario();
+    run.seed = record.seed;
+    if (record.isExact && lookupOdds(run, run.statistics)) {
+        run.seed = 0;
+        run.isExact = true;
+    }
+    else {
+        // a timed run is replayed with the number of battles it managed, without the time limit
+        int battles = ((record.statistics.battles > 0) && !record.isExact) ? record.statistics.battles : BATTLES;
+        run.statistics = startCombat(attackerUnits, defenderUnits, battles, 0, record.seed, run.attackerWinError, run.defenderWinError);
+    }
+    showResults(attackerUnits, defenderUnits, run.statistics, run.attackerWinError, run.defenderWinError, run.isExact);
+    _lastRun = run;
+
+    if (!isComplete)
+        QMessageBox::information(this, "Load scenario", "Some units of the scenario do not exist in this version of the map, so it was simulated without them");
+    else if (isOutdated)
+        QMessageBox::information(this, "Load scenario", "The scenario was saved for another version of the map, so it was simulated again");
+    else if (record.isTimed)
+        QMessageBox::information(this, "Load scenario", "The scenario was simulated with a time limit, so the replay only agrees with the saved results within their error");
+    else if (record.isExact && !run.isExact)
+        QMessageBox::information(this, "Load scenario", "The saved results are exact odds, which were simulated now as the map has no odds table for them");
+    else if (!isSameResult(run.statistics, record.statistics))
+        QMessageBox::warning(this, "Load scenario", "The replay differs from the saved results");
+}
+
+void CombatWidget::saveScenario() {
+    if (_lastRun.statistics.battles == 0) {
+        QMessageBox::information(this, "Save scenario", "Let the units fight first, so that there are results to save");
+        return;
+    }
+
+    // scenarios are appended, so an existing file is not overwritten
+    QString fileName = QFileDialog::getSaveFileName(this, "Save scenario", QString(), SCENARIOFILTER, 0, QFileDialog::DontConfirmOverwrite);
+    if (fileName.isEmpty())
+        return;
+
+    ScenarioFile file(fileName);
+    if (!file.open(QIODevice::ReadWrite) || !file.append(_lastRun))
+        QMessageBox::critical(this, "Save scenario", file.errorString());
+}
+
+void CombatWidget::loadScenario() {
+    QString fileName = QFileDialog::getOpenFileName(this, "Load scenario", QString(), SCENARIOFILTER);
+    if (!fileName.isEmpty())
+        qApp->openScenarioFile(fileName, false);
+}
+
+void CombatWidget::optimizeForce() {
+    QList<QPair<Unit*, int> > available = _attackerWidget->getUnits();
+    if (available.isEmpty()) {
+        QMessageBox::information(this, "Cheapest winning force", "Enter the attacking units which are available first");
+        return;
+    }
+
+    bool ok;
+    double target = QInputDialog::getDouble(this, "Cheapest winning force", "Minimum win probability of the attacker (%):", 90.0, 1.0, 99.9, 1, &ok);
+    if (!ok)
+        return;
+
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    ForceOptimizer optimizer(available, batallion(_defenderWidget->getUnits()), combatSettings(), _ipcFactor);
+    optimizer.setTargetWinProbability(static_cast<float>(target / 100.0));
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QList<ForceCandidate> results = optimizer.optimize();
+    QApplication::restoreOverrideCursor();
+
+    if (results.isEmpty()) {
+        QMessageBox::information(this, "Cheapest winning force", "None of the available forces wins with " + QString::number(target) + "%");
+        return;
+    }
+
+    QString text = "<table><tr><th>IPC</th><th>Win</th><th>95% interval</th><th>Units</th></tr>";
+    foreach (const ForceCandidate& candidate, results) {
+        QStringList units;
+        for (int i = 0; i < candidate.counts.size(); ++i) {
+            if (candidate.counts[i] > 0)
+                units.append(QString::number(candidate.counts[i]) + " " + available[i].first->name());
+        }
+        text += "<tr><td>" + QString::number(candidate.ipcCost) + "</td>" +
+            "<td>" + QString::number(candidate.statistics.attackerWinProbability() * 100, 'f', 1) + "%</td>" +
+            "<td>" + QString::number(candidate.lowerBound * 100, 'f', 1) + "% - " + QString::number(candidate.upperBound * 100, 'f', 1) + "%</td>" +
+            "<td>" + units.join(", ") + "</td></tr>";
+    }
+    text += "</table><p>" + QString::number(optimizer.evaluations()) + " forces evaluated</p>";
+
+    QMessageBox msgBox(QMessageBox::Information, "Cheapest winning force", text);
+    msgBox.setTextFormat(Qt::RichText);
+    msgBox.exec();
+}
+
+void CombatWidget::analyzeRetreat() {
+    Batallion attacker = batallion(_attackerWidget->getUnits());
+    Batallion defender = batallion(_defenderWidget->getUnits());
+    if (attacker.isEmpty() || defender.isEmpty()) {
+        QMessageBox::information(this, "Retreat analysis", "Enter the attacking and the defending units first");
+        return;
+    }
+
+    bool ok;
+    double territoryValue = QInputDialog::getDouble(this, "Retreat analysis", "IPC value of conquering the territory:", 0.0, 0.0, 1000.0, 1, &ok);
+    if (!ok)
+        return;
+
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    RetreatAnalysis analysis(attacker, defender, combatSettings(), _ipcFactor);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    analysis.simulate(30000);
+    analysis.setTerritoryValue(static_cast<float>(territoryValue));
+    QApplication::restoreOverrideCursor();
+
+    QString text = "<table><tr><th>Policy</th><th>Win</th><th>Retreat</th><th>Attacker loss</th><th>Defender loss</th><th>Trade</th></tr>";
+    QList<QPair<QString, RetreatPolicyResult> > policies;
+    policies.append(qMakePair(QString("Fight to the end"), analysis.fightToEnd()));
+    for (int i = 1; i < analysis.maximumAttackerUnits(); ++i)
+        policies.append(qMakePair("Retreat with " + QString::number(i) + " units left", analysis.unitThresholdPolicy(i)));
+    for (int i = 1; i <= 5; ++i)
+        policies.append(qMakePair("Retreat below " + QString::number(i * 10) + "% win odds", analysis.oddsThresholdPolicy(i * 0.1f)));
+    policies.append(qMakePair(QString("<b>Optimal</b>"), analysis.optimalPolicy()));
+
+    typedef QPair<QString, RetreatPolicyResult> Policy;
+    foreach (const Policy& policy, policies) {
+        const RetreatPolicyResult& r = policy.second;
+        text += "<tr><td>" + policy.first + "</td>" +
+            "<td>" + QString::number(r.attackerWinProbability * 100, 'f', 1) + "%</td>" +
+            "<td>" + QString::number(r.retreatProbability * 100, 'f', 1) + "%</td>" +
+            "<td>" + QString::number(r.attackerIPCLoss, 'f', 1) + "</td>" +
+            "<td>" + QString::number(r.defenderIPCLoss, 'f', 1) + "</td>" +
+            "<td>" + QString::number(r.ipcTrade(), 'f', 1) + "</td></tr>";
+    }
+    text += "</table><p>Based on " + QString::number(analysis.battles()) + " battles</p>";
+
+    QMessageBox msgBox(QMessageBox::Information, "Retreat analysis", text);
+    msgBox.setTextFormat(Qt::RichText);
+    msgBox.exec();
+}
+
+void CombatWidget::compareScenarios() {
+    QList<QPair<Unit*, int> > attackerUnits = _attackerWidget->getUnits();
+    QList<QPair<Unit*, int> > defenderUnits = _defenderWidget->getUnits();
+    Batallion attacker = batallion(attackerUnits);
+    Batallion defender = batallion(defenderUnits);
+    if (attacker.isEmpty() || defender.isEmpty()) {
+        QMessageBox::information(this, "Scenario comparison", "Enter the attacking and the defending units first");
+        return;
+    }
+
+    CombatSettings settings = combatSettings();
+    QString ool = (settings.orderOfLoss == OrderOfLossIPC) ? "by IPC" : "by combat value";
+    QString otherOol = (settings.orderOfLoss == OrderOfLossIPC) ? "by combat value" : "by IPC";
+    QStringList variations;
+    QList<QPair<QList<QPair<Unit*, int> >*, int> > additions; //< unit list and index of the added unit per variation
+    variations.append("Order of loss " + otherOol + " instead of " + ool);
+    additions.append(qMakePair(static_cast<QList<QPair<Unit*, int> >*>(0), -1));
+    for (int i = 0; i < attackerUnits.size(); ++i) {
+        if (attackerUnits[i].second > 0) {
+            variations.append("One more " + attackerUnits[i].first->name() + " for the attacker");
+            additions.append(qMakePair(&attackerUnits, i));
+        }
+    }
+    for (int i = 0; i < defenderUnits.size(); ++i) {
+        if (defenderUnits[i].second > 0) {
+            variations.append("One more " + defenderUnits[i].first->name() + " for the defender");
+            additions.append(qMakePair(&defenderUnits, i));
+        }
+    }
+
+    bool ok;
+    QString variation = QInputDialog::getItem(this, "Scenario comparison", "Compare the current setup with:", variations, 0, false, &ok);
+    if (!ok)
+        return;
+
+    ScenarioComparison comparison(_ipcFactor);
+    comparison.addScenario(Scenario("Current setup", attacker, defender, settings));
+    int index = variations.indexOf(variation);
+    if (additions[index].first == 0) {
+        CombatSettings other = settings;
+        other.orderOfLoss = (settings.orderOfLoss == OrderOfLossIPC) ? OrderOfLossValue : OrderOfLossIPC;
+        comparison.addScenario(Scenario("Order of loss " + otherOol, attacker, defender, other));
+    }
+    else {
+        ++(*additions[index].first)[additions[index].second].second;
+        comparison.addScenario(Scenario(variation, batallion(attackerUnits), batallion(defenderUnits), settings));
+    }
+
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    comparison.simulate(5000);
+    QApplication::restoreOverrideCursor();
+
+    QString text = "<table><tr><th>Scenario</th><th>Win</th><th>Attacker loss</th><th>Defender loss</th></tr>";
+    for (int i = 0; i < comparison.scenarioCount(); ++i) {
+        const CombatStatistics& statistics = comparison.statistics(i);
+        text += "<tr><td>" + comparison.scenario(i).name + "</td>" +
+            "<td>" + QString::number(statistics.attackerWinProbability() * 100, 'f', 1) + "%</td>" +
+            "<td>" + QString::number(static_cast<float>(statistics.attackerIPCLoss) / statistics.battles / _ipcFactor, 'f', 1) + "</td>" +
+            "<td>" + QString::number(static_cast<float>(statistics.defenderIPCLoss) / statistics.battles / _ipcFactor, 'f', 1) + "</td></tr>";
+    }
+
+    ScenarioDifference difference = comparison.difference(1);
+    const Estimate& win = difference.attackerWinProbability;
+    const Estimate& attackerLoss = difference.attackerIPCLoss;
+    const Estimate& defenderLoss = difference.defenderIPCLoss;
+    text += "<tr><td><b>Difference</b></td>"
+        "<td>" + QString::number(win.mean * 100, 'f', 1) + "% (" + QString::number(win.lower * 100, 'f', 1) + "% - " + QString::number(win.upper * 100, 'f', 1) + "%)</td>" +
+        "<td>" + QString::number(attackerLoss.mean, 'f', 1) + " (" + QString::number(attackerLoss.lower, 'f', 1) + " - " + QString::number(attackerLoss.upper, 'f', 1) + ")</td>" +
+        "<td>" + QString::number(defenderLoss.mean, 'f', 1) + " (" + QString::number(defenderLoss.lower, 'f', 1) + " - " + QString::number(defenderLoss.upper, 'f', 1) + ")</td></tr>";
+    text += "</table><p>Based on " + QString::number(comparison.battles()) + " battles per scenario fought with the same dice. ";
+    text += "The difference in the win probability is " + QString(win.isSignificant() ? "" : "<b>not</b> ") + "significant (95% confidence).";
+    if (difference.varianceReduction > 1.f)
+        text += " Independent runs would have needed " + QString::number(difference.varianceReduction, 'f', 1) + " times as many battles.";
+    text += "</p>";
+
+    QMessageBox msgBox(QMessageBox::Information, "Scenario comparison", text);
+    msgBox.setTextFormat(Qt::RichText);
+    msgBox.exec();
+}
+
+void CombatWidget::amphibiousAssault() {
+    Batallion attacker = batallion(_attackerWidget->getUnits());
+    Batallion defender = batallion(_defenderWidget->getUnits());
+    if (!isLandBattle()) {
+        if (attacker.isEmpty()) {
+            QMessageBox::information(this, "Amphibious assault", "Enter the attacking fleet first");
+            return;
+        }
+        _assaultFleet = attacker;
+        _assaultSeaDefender = defender;
+        QMessageBox::information(this, "Amphibious assault", "The fleets are kept for the sea battle of the assault. Now enter the land battle and press the button again");
+        return;
+    }
+
+    if (_assaultFleet.isEmpty()) {
+        QMessageBox::information(this, "Amphibious assault", "Enter the sea battle first and press the button there, so that its fleets are kept");
+        return;
+    }
+
+    // the bombarding units come from the fleet, so the ones entered for the land battle are left out
+    Batallion landAttacker;
+    foreach (const UnitLite& unit, attacker) {
+        if (!unit.isSea())
+            landAttacker.append(unit);
+    }
+    if (landAttacker.isEmpty() || defender.isEmpty()) {
+        QMessageBox::information(this, "Amphibious assault", "Enter the landing and the defending units first");
+        return;
+    }
+
+    qsrand(QDateTime::currentMSecsSinceEpoch());
+
+    AmphibiousAssault assault(_assaultFleet, _assaultSeaDefender, landAttacker, defender, combatSettings());
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    assault.simulate(30000);
+    QApplication::restoreOverrideCursor();
+
+    const AssaultStatistics& statistics = assault.statistics();
+    QString text = "<table>";
+    if (!_assaultSeaDefender.isEmpty())
+        text += "<tr><td>Sea zone cleared</td><td>" + QString::number(statistics.landingProbability() * 100, 'f', 1) + "%</td></tr>";
+    text += "<tr><td>Bombarding units per landing</td><td>" + QString::number(statistics.bombardingUnits(), 'f', 2) + "</td></tr>" +
+        "<tr><td>Land battle won after landing</td><td>" + QString::number(statistics.land.attackerWinProbability() * 100, 'f', 1) + "%</td></tr>" +
+        "<tr><td><b>Territory conquered</b></td><td><b>" + QString::number(statistics.captureProbability() * 100, 'f', 1) + "%</b></td></tr>" +
+        "<tr><td>Attacker loss</td><td>" + QString::number(statistics.attackerIPCLoss() / _ipcFactor, 'f', 1) + "</td></tr>" +
+        "<tr><td>Defender loss</td><td>" + QString::number(statistics.defenderIPCLoss() / _ipcFactor, 'f', 1) + "</td></tr>";
+    text += "</table><p>Based on " + QString::number(statistics.assaults) + " assaults. The losses are the ones of both battles</p>";
+
+    QMessageBox msgBox(QMessageBox::Information, "Amphibious assault", text);
+    msgBox.setTextFormat(Qt::RichText);
+    msgBox.exec();
 }
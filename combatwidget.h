@@ -29,11 +29,16 @@
 #include <QDomNode>
 #include <QMap>
 #include "combatthread.h"
+#include "scenariofile.h"
 #include "unit.h"
 
 class ControlWidget;
 class FactionWidget;
+class OddsTable;
+class SpeculativeCache;
+class SweepWidget;
 class QBoxLayout;
+class QTimer;
 
 class CombatWidget : public QWidget {
 Q_OBJECT
@@ -47,19 +52,40 @@ public:
     QStringList factionsForGroup(const QString& group) const;
     QList<Unit*> units() const;
     QIcon flag(const QString& faction) const;
-    QPixmap unitIcon(const QString& faction, int unitID) const;
+    QPixmap unitIcon(const QString& faction, int unitID, int width = 0) const;
 
     bool isLandBattle() const;
     bool isAmphibiousCombat() const;
     bool landUnitMustLive() const;
     OrderOfLoss orderOfLoss() const;
+    CombatSettings combatSettings() const;
+    int ipcFactor() const;
+
+    QList<QPair<Unit*, int> > attackerUnits() const;
+    QList<QPair<Unit*, int> > defenderUnits() const;
+    Batallion batallion(const QList<QPair<Unit*, int> >& units) const;
 
     QString nameForID(int id) const;
 
+    // restores the units and settings of the record and shows its results; they are simulated
+    // again with the record's seed if 'replay' is set or the map has changed since
+    void openScenario(const ScenarioRecord& record, bool replay);
+    // computes the odds table of the map for the current settings, with the unit types named in
+    // 'bounds' up to the given counts per side; returns false and sets 'error' if it fails
+    bool generateOddsTable(const QMap<QString, int>& bounds, QString& error);
+
 private slots:
     void switchCombatSides();
     void startCombat();
+    void optimizeForce();
+    void analyzeRetreat();
+    void compareScenarios();
+    void amphibiousAssault();
+    void saveScenario();
+    void loadScenario();
     void clear();
+    void unitsChanged();
+    void speculate();
 
 private:
     struct CombatResult {
@@ -73,12 +99,24 @@ private:
     };
 
     void initXML(const QString& xmlFile);
-    QList<CombatThread*> startCombat(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits);
-    CombatResult computeCombatResults(const QList<CombatThread*>& results);
+    void prefetchIcons();
+    CombatStatistics startCombat(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits,
+        int battles, int timeBudget, quint32 seed, float& attackerWinError, float& defenderWinError); //< 'timeBudget' in ms, 0 for no limit
+    CombatResult computeCombatResults(const CombatStatistics& statistics);
+    void showResults(const QList<UnitLite>& attackerUnits, const QList<UnitLite>& defenderUnits, const CombatStatistics& statistics,
+        float attackerWinError, float defenderWinError, bool isExact = false);
+    // the odds of the units of 'run' from the odds table; returns false if the table does not contain them
+    bool lookupOdds(const ScenarioRecord& run, CombatStatistics& statistics) const;
+    void openOddsTable();
+    ScenarioRecord scenario() const; //< of the current units and settings, without results
 
     FactionWidget* _attackerWidget;
     FactionWidget* _defenderWidget;
     ControlWidget* _controlWidget;
+    SweepWidget* _sweepWidget;
+    SpeculativeCache* _speculation;
+    QTimer* _speculationTimer; //< waits for the user to stop changing the units
+    OddsTable* _oddsTable; //< only open if the map has one of its current version
     
     QBoxLayout* _attackerLayout;
     QString _directory;
@@ -87,6 +125,11 @@ private:
     QMap<QString, QStringList> _factionsDetail;
     QStringList _factions;
     int _ipcFactor;
+    bool _narrowUnits; //< all units fit into NarrowUnitLite
+    QSharedPointer<const CombatRules> _rules;
+    ScenarioRecord _lastRun; //< the scenario and the results of the last fight
+    Batallion _assaultFleet; //< the sea battle of the next amphibious assault
+    Batallion _assaultSeaDefender;
 };
 
 #endif
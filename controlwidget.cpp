@@ -25,9 +25,11 @@
 
 #include <QCheckBox>
 #include <QComboBox>
+#include <QHBoxLayout>
 #include <QLabel>
 #include <QVBoxLayout>
 #include <QPushButton>
+#include <QSpinBox>
 
 #define OOLIPC "By IPC"
 #define OOLVALUE "By Combat Value"
@@ -38,6 +40,9 @@ ControlWidget::ControlWidget(QWidget* parent)
     , _oneLandUnitMustSurvive(nullptr)
     , _amphibiousCombat(nullptr)
     , _oolType(nullptr)
+    , _quasiRandom(0)
+    , _timeBudget(0)
+    , _maxRounds(0)
 {
     QVBoxLayout* layout = new QVBoxLayout(this);
 
@@ -64,6 +69,29 @@ ControlWidget::ControlWidget(QWidget* parent)
     _oolType->setToolTip("By Combat Value: First the unit with the lesser attack/defense value is chosen. Default in TripleA\nBy IPC: First the cheaper unit is taken as casualty");
     layout->addWidget(_oolType);
 
+    _quasiRandom = new QCheckBox("Quasi-random dice");
+    _quasiRandom->setToolTip("Rolls the dice of the first rounds from scrambled Sobol sequences instead of independently,\nwhich spreads them more evenly over all outcomes and often converges faster");
+    layout->addWidget(_quasiRandom);
+
+    QLabel* timeBudgetLabel = new QLabel("Time limit");
+    layout->addWidget(timeBudgetLabel);
+    _timeBudget = new QSpinBox;
+    _timeBudget->setRange(0, 10000);
+    _timeBudget->setSingleStep(100);
+    _timeBudget->setSuffix(" ms");
+    _timeBudget->setSpecialValueText("None");
+    _timeBudget->setToolTip("Stops the simulation after this time with as many battles as it managed,\ninstead of always simulating the same number of battles");
+    layout->addWidget(_timeBudget);
+
+    QLabel* maxRoundsLabel = new QLabel("Rounds");
+    layout->addWidget(maxRoundsLabel);
+    _maxRounds = new QSpinBox;
+    _maxRounds->setRange(0, 100);
+    _maxRounds->setSpecialValueText("All");
+    _maxRounds->setToolTip("Stops every battle after this many rounds, for example to see the outcome of an attack
+that retreats after the first round. Battles that are not decided by then count as draws");
+    layout->addWidget(_maxRounds);
+
     layout->addStretch(-1);
 
     QPushButton* clearButton = new QPushButton("Clear");
@@ -74,6 +102,44 @@ ControlWidget::ControlWidget(QWidget* parent)
     connect(switchSidesButton, SIGNAL(clicked(bool)), this, SIGNAL(switchSides()));
     layout->addWidget(switchSidesButton);
     
+    QPushButton* optimizeButton = new QPushButton("Cheapest\nwinning force");
+    optimizeButton->setToolTip("Searches the cheapest attacking force out of the entered attacking units\nwhich wins against the defender with a given probability");
+    connect(optimizeButton, SIGNAL(clicked(bool)), this, SIGNAL(optimizeForce()));
+    layout->addWidget(optimizeButton);
+
+    QPushButton* retreatButton = new QPushButton("Retreat\nanalysis");
+    retreatButton->setToolTip("Compares retreat policies for the attacker and computes the optimal one");
+    connect(retreatButton, SIGNAL(clicked(bool)), this, SIGNAL(analyzeRetreat()));
+    layout->addWidget(retreatButton);
+
+    QPushButton* compareButton = new QPushButton("Compare\nscenarios");
+    compareButton->setToolTip("Compares the current setup with a variation of it on the same dice rolls,\nwhich needs far fewer battles to show a significant difference");
+    connect(compareButton, SIGNAL(clicked(bool)), this, SIGNAL(compareScenarios()));
+    layout->addWidget(compareButton);
+
+    QPushButton* assaultButton = new QPushButton("Amphibious\nassault");
+    assaultButton->setToolTip("Press it in a sea battle to keep the fleets, then enter the land battle and press it again.\n"
+        "Simulates the sea battle followed by the landing with the bombarding units that survived it");
+    connect(assaultButton, SIGNAL(clicked(bool)), this, SIGNAL(amphibiousAssault()));
+    layout->addWidget(assaultButton);
+
+    QHBoxLayout* scenarioLayout = new QHBoxLayout;
+    QPushButton* saveButton = new QPushButton("Save");
+    saveButton->setToolTip("Appends the units, settings and results of the last fight to a scenario file");
+    connect(saveButton, SIGNAL(clicked(bool)), this, SIGNAL(saveScenario()));
+    scenarioLayout->addWidget(saveButton);
+    QPushButton* loadButton = new QPushButton("Load");
+    loadButton->setToolTip("Restores a fight and its results from a scenario file");
+    connect(loadButton, SIGNAL(clicked(bool)), this, SIGNAL(loadScenario()));
+    scenarioLayout->addWidget(loadButton);
+    layout->addLayout(scenarioLayout);
+
+    QPushButton* sweepButton = new QPushButton("Parameter sweep");
+    sweepButton->setCheckable(true);
+    sweepButton->setToolTip("Shows the outcome over a range of unit counts for one attacking and one defending unit type");
+    connect(sweepButton, SIGNAL(toggled(bool)), this, SIGNAL(parameterSweepToggled(bool)));
+    layout->addWidget(sweepButton);
+
     QPushButton* fightButton = new QPushButton("Fight!");
     fightButton->setDefault(true);
     connect(fightButton, SIGNAL(clicked(bool)), this, SIGNAL(startCombat()));
@@ -100,6 +166,44 @@ OrderOfLoss ControlWidget::orderOfLoss() const {
         return OrderOfLossValue;
 }
 
+SamplingMode ControlWidget::samplingMode() const {
+    return _quasiRandom->isChecked() ? SamplingModeQuasiRandom : SamplingModePseudoRandom;
+}
+
+int ControlWidget::timeBudget() const {
+    return _timeBudget->value();
+}
+
+int ControlWidget::maxRounds() const {
+    return _maxRounds->value();
+}
+
+void ControlWidget::setLandBattle(bool landBattle) {
+    _landBattle->setChecked(landBattle);
+}
+
+void ControlWidget::setAmphibiousCombat(bool amphibiousCombat) {
+    if (_amphibiousCombat->isEnabled())
+        _amphibiousCombat->setChecked(amphibiousCombat);
+}
+
+void ControlWidget::setLandUnitMustLive(bool landUnitMustLive) {
+    if (_oneLandUnitMustSurvive->isEnabled())
+        _oneLandUnitMustSurvive->setChecked(landUnitMustLive);
+}
+
+void ControlWidget::setOrderOfLoss(OrderOfLoss orderOfLoss) {
+    _oolType->setCurrentIndex(_oolType->findText(orderOfLoss == OrderOfLossIPC ? OOLIPC : OOLVALUE));
+}
+
+void ControlWidget::setSamplingMode(SamplingMode sampling) {
+    _quasiRandom->setChecked(sampling == SamplingModeQuasiRandom);
+}
+
+void ControlWidget::setMaxRounds(int maxRounds) {
+    _maxRounds->setValue(maxRounds);
+}
+
 void ControlWidget::landBattleCheckboxChanged(int state) {
     if (state == 0) { // not Land Battle
         _oneLandUnitMustSurvive->setDisabled(true);
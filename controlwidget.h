@@ -29,6 +29,7 @@
 
 class QCheckBox;
 class QComboBox;
+class QSpinBox;
 
 class ControlWidget : public QWidget {
 Q_OBJECT
@@ -39,11 +40,28 @@ public:
     bool isAmphibiousCombat() const;
     bool landUnitMustLive() const;
     OrderOfLoss orderOfLoss() const;
+    SamplingMode samplingMode() const;
+    int timeBudget() const; //< ms, 0 without a limit
+    int maxRounds() const; //< 0 without a limit
+
+    void setLandBattle(bool landBattle);
+    void setAmphibiousCombat(bool amphibiousCombat);
+    void setLandUnitMustLive(bool landUnitMustLive);
+    void setOrderOfLoss(OrderOfLoss orderOfLoss);
+    void setSamplingMode(SamplingMode sampling);
+    void setMaxRounds(int maxRounds);
     
 signals:
     void landBattleCheckboxDidChange();
     void switchSides();
     void startCombat();
+    void optimizeForce();
+    void analyzeRetreat();
+    void compareScenarios();
+    void amphibiousAssault();
+    void saveScenario();
+    void loadScenario();
+    void parameterSweepToggled(bool);
     void clear();
 
 private slots:
@@ -54,6 +72,9 @@ private:
     QCheckBox* _oneLandUnitMustSurvive;
     QCheckBox* _amphibiousCombat;
     QComboBox* _oolType;
+    QCheckBox* _quasiRandom;
+    QSpinBox* _timeBudget;
+    QSpinBox* _maxRounds;
 
     bool _oneLandUnitOldValue;
     bool _amphibiousOldValue;
@@ -0,0 +1,60 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_DICEGENERATOR_H
+#define BOCK_DICEGENERATOR_H
+
+#include <QtGlobal>
+
+// Seedable random number generator for the dice (PCG32 by Melissa O'Neill). Unlike qrand its
+// sequence does not depend on the C library, so a seed produces the same battles on every
+// platform and compiler, and every battle can carry its own generator instead of relying on
+// thread local state
+class DiceGenerator {
+public:
+    DiceGenerator(quint32 seed);
+
+    quint32 next();
+    int roll(); //< a fair die, 1 to 6
+
+private:
+    quint64 _state;
+};
+
+inline quint32 DiceGenerator::next() {
+    quint64 old = _state;
+    _state = old * Q_UINT64_C(6364136223846793005) + Q_UINT64_C(1442695040888963407);
+    quint32 shifted = static_cast<quint32>(((old >> 18) ^ old) >> 27);
+    quint32 rotation = static_cast<quint32>(old >> 59);
+    return (shifted >> rotation) | (shifted << ((32 - rotation) & 31));
+}
+
+inline int DiceGenerator::roll() {
+    // the lowest 2^32 mod 6 = 4 products are rejected, so that all faces are equally likely
+    quint64 product = static_cast<quint64>(next()) * 6;
+    while (static_cast<quint32>(product) < 4)
+        product = static_cast<quint64>(next()) * 6;
+    return static_cast<int>(product >> 32) + 1;
+}
+
+#endif
@@ -0,0 +1,389 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "enginecomparison.h"
+
+#include "combatscheduler.h"
+#include "unit.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace {
+    const int QUASIRANDOMSEQUENCES = 16;
+    const int MAXIMUMITERATIONS = 1000;
+    const double EPSILON = 1e-12;
+
+    // regularized upper incomplete gamma function Q(a, x)
+    double gammaQ(double a, double x) {
+        if (x <= 0.0)
+            return 1.0;
+
+        if (x < a + 1.0) {
+            // series of P(a, x)
+            double term = 1.0 / a;
+            double sum = term;
+            for (int n = 1; n < MAXIMUMITERATIONS; ++n) {
+                term *= x / (a + n);
+                sum += term;
+                if (fabs(term) < fabs(sum) * EPSILON)
+                    break;
+            }
+            return 1.0 - sum * exp(-x + a * log(x) - lgamma(a));
+        }
+        else {
+            // continued fraction of Q(a, x) by the modified Lentz method
+            const double tiny = 1e-300;
+            double b = x + 1.0 - a;
+            double c = 1.0 / tiny;
+            double d = 1.0 / b;
+            double h = d;
+            for (int n = 1; n < MAXIMUMITERATIONS; ++n) {
+                double an = -n * (n - a);
+                b += 2.0;
+                d = an * d + b;
+                if (fabs(d) < tiny)
+                    d = tiny;
+                c = b + an / c;
+                if (fabs(c) < tiny)
+                    c = tiny;
+                d = 1.0 / d;
+                double delta = d * c;
+                h *= delta;
+                if (fabs(delta - 1.0) < EPSILON)
+                    break;
+            }
+            return exp(-x + a * log(x) - lgamma(a)) * h;
+        }
+    }
+
+    // probability that the Kolmogorov distribution exceeds 'lambda'
+    double kolmogorovQ(double lambda) {
+        if (lambda < 0.2)
+            return 1.0;
+        double sum = 0.0;
+        double sign = 1.0;
+        for (int j = 1; j <= 100; ++j) {
+            double term = sign * exp(-2.0 * j * j * lambda * lambda);
+            sum += term;
+            if (fabs(term) < EPSILON)
+                break;
+            sign = -sign;
+        }
+        return qBound(0.0, 2.0 * sum, 1.0);
+    }
+
+    struct Compare {
+        typedef void result_type;
+
+        Compare(CombatEngine reference, CombatEngine candidate, int battles)
+            : reference(reference)
+            , candidate(candidate)
+            , battles(battles)
+        {}
+
+        template <typename T>
+        void operator()(T& scenario) {
+            OutcomeHistogram lhs = reference(scenario.attacker, scenario.defender, scenario.settings, battles, scenario.seed);
+            OutcomeHistogram rhs = candidate(scenario.attacker, scenario.defender, scenario.settings, battles, ~scenario.seed);
+            scenario.pValues[0] = outcomeTest(lhs, rhs);
+            scenario.pValues[1] = lossTest(lhs.attackerIPCLoss, lhs.battles, rhs.attackerIPCLoss, rhs.battles);
+            scenario.pValues[2] = lossTest(lhs.defenderIPCLoss, lhs.battles, rhs.defenderIPCLoss, rhs.battles);
+        }
+
+        CombatEngine reference;
+        CombatEngine candidate;
+        int battles;
+    };
+
+    struct Test {
+        double pValue;
+        int scenario;
+        int test;
+
+        bool operator<(const Test& rhs) const {
+            return pValue < rhs.pValue;
+        }
+    };
+}
+
+OutcomeHistogram::OutcomeHistogram()
+    : battles(0)
+{
+    outcomes[OutcomeAttackerWins] = 0;
+    outcomes[OutcomeDefenderWins] = 0;
+    outcomes[OutcomeDraw] = 0;
+}
+
+template <typename Layout>
+void OutcomeHistogram::addResult(const BasicBattle<Layout>& battle) {
+    ++battles;
+    if ((battle.attacker().size() == 0) && (battle.defender().size() > 0))
+        ++outcomes[OutcomeDefenderWins];
+    else if ((battle.attacker().size() > 0) && (battle.defender().size() == 0))
+        ++outcomes[OutcomeAttackerWins];
+    else
+        ++outcomes[OutcomeDraw];
+
+    int loss = 0;
+    foreach (const BasicUnitLite<Layout>& unit, battle.attackerCasualities())
+        loss += unit.ipcValue();
+    ++attackerIPCLoss[loss];
+    loss = 0;
+    foreach (const BasicUnitLite<Layout>& unit, battle.defenderCasualities())
+        loss += unit.ipcValue();
+    ++defenderIPCLoss[loss];
+}
+
+void OutcomeHistogram::merge(const OutcomeHistogram& other) {
+    battles += other.battles;
+    for (int i = 0; i < 3; ++i)
+        outcomes[i] += other.outcomes[i];
+    for (QMap<int, int>::const_iterator it = other.attackerIPCLoss.begin(); it != other.attackerIPCLoss.end(); ++it)
+        attackerIPCLoss[it.key()] += it.value();
+    for (QMap<int, int>::const_iterator it = other.defenderIPCLoss.begin(); it != other.defenderIPCLoss.end(); ++it)
+        defenderIPCLoss[it.key()] += it.value();
+}
+
+namespace {
+    template <typename Layout>
+    OutcomeHistogram pseudoRandom(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+                                  int battles, quint32 seed)
+    {
+        OutcomeHistogram result;
+        DiceGenerator seeds(seed);
+        for (int i = 0; i < battles; ++i) {
+            BasicBattle<Layout> battle(attacker, defender, settings, seeds.next());
+            battle.run();
+            result.addResult(battle);
+        }
+        return result;
+    }
+
+    template <typename Layout>
+    OutcomeHistogram quasiRandom(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+                                 int battles, quint32 seed)
+    {
+        OutcomeHistogram result;
+        DiceGenerator seeds(seed);
+        for (int i = 0; i < QUASIRANDOMSEQUENCES; ++i) {
+            SobolSequence sequence;
+            sequence.scramble(seeds.next());
+            QuasiRandomDice dice(sequence, 0, seeds.next());
+            int points = battles / QUASIRANDOMSEQUENCES + ((i < battles % QUASIRANDOMSEQUENCES) ? 1 : 0);
+            for (int j = 0; j < points; ++j) {
+                if (j > 0)
+                    dice.nextBattle();
+                BasicBattle<Layout> battle(attacker, defender, settings, 0);
+                battle.setDice(&dice);
+                battle.run();
+                result.addResult(battle);
+            }
+        }
+        return result;
+    }
+}
+
+OutcomeHistogram pseudoRandomEngine(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+                                    int battles, quint32 seed)
+{
+    if (settings.narrowUnits)
+        return pseudoRandom<UnitLayoutNarrow>(attacker, defender, settings, battles, seed);
+    return pseudoRandom<UnitLayoutWide>(attacker, defender, settings, battles, seed);
+}
+
+OutcomeHistogram quasiRandomEngine(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+                                   int battles, quint32 seed)
+{
+    if (settings.narrowUnits)
+        return quasiRandom<UnitLayoutNarrow>(attacker, defender, settings, battles, seed);
+    return quasiRandom<UnitLayoutWide>(attacker, defender, settings, battles, seed);
+}
+
+double outcomeTest(const OutcomeHistogram& lhs, const OutcomeHistogram& rhs) {
+    if ((lhs.battles == 0) || (rhs.battles == 0))
+        return 1.0;
+
+    // chi-squared statistic for two samples of different size
+    double lhsFactor = sqrt(static_cast<double>(rhs.battles) / lhs.battles);
+    double rhsFactor = sqrt(static_cast<double>(lhs.battles) / rhs.battles);
+    double chiSquared = 0.0;
+    int bins = 0;
+    for (int i = 0; i < 3; ++i) {
+        int total = lhs.outcomes[i] + rhs.outcomes[i];
+        if (total == 0)
+            continue;
+        double difference = lhsFactor * lhs.outcomes[i] - rhsFactor * rhs.outcomes[i];
+        chiSquared += difference * difference / total;
+        ++bins;
+    }
+    if (bins < 2)
+        return 1.0;
+    return gammaQ(0.5 * (bins - 1), 0.5 * chiSquared);
+}
+
+double lossTest(const QMap<int, int>& lhs, int lhsBattles, const QMap<int, int>& rhs, int rhsBattles) {
+    if ((lhsBattles == 0) || (rhsBattles == 0))
+        return 1.0;
+
+    QList<int> losses = lhs.keys() + rhs.keys();
+    qSort(losses);
+    double lhsCumulative = 0.0;
+    double rhsCumulative = 0.0;
+    double distance = 0.0;
+    int previous = -1;
+    foreach (int loss, losses) {
+        if (loss == previous)
+            continue;
+        previous = loss;
+        lhsCumulative += static_cast<double>(lhs.value(loss)) / lhsBattles;
+        rhsCumulative += static_cast<double>(rhs.value(loss)) / rhsBattles;
+        distance = qMax(distance, fabs(lhsCumulative - rhsCumulative));
+    }
+
+    double n = static_cast<double>(lhsBattles) * rhsBattles / (lhsBattles + rhsBattles);
+    return kolmogorovQ((sqrt(n) + 0.12 + 0.11 / sqrt(n)) * distance);
+}
+
+EngineComparison::EngineComparison(const QList<Unit*>& units, int ipcFactor)
+    : _units(units)
+    , _ipcFactor(ipcFactor)
+    , _narrowUnits(NarrowUnitLite::fits(units, ipcFactor))
+    , _maximumUnits(12)
+    , _tests(0)
+{}
+
+void EngineComparison::setMaximumUnits(int units) {
+    _maximumUnits = units;
+}
+
+QStringList EngineComparison::compare(CombatEngine reference, CombatEngine candidate, int scenarios, int battles,
+                                      double alpha, quint32 seed)
+{
+    DiceGenerator random(seed);
+    QList<Scenario> list;
+    for (int i = 0; i < scenarios; ++i) {
+        Scenario scenario = randomScenario(random);
+        if (!scenario.attacker.isEmpty() && !scenario.defender.isEmpty())
+            list.append(scenario);
+    }
+    blockingCombatMap(list, Compare(reference, candidate, battles), CombatPriorityInteractive);
+
+    QList<Test> tests;
+    for (int i = 0; i < list.size(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            Test test;
+            test.pValue = list[i].pValues[j];
+            test.scenario = i;
+            test.test = j;
+            tests.append(test);
+        }
+    }
+    _tests = tests.size();
+
+    // Holm-Bonferroni: reject the smallest p-values as long as they stay below alpha / remaining tests
+    std::sort(tests.begin(), tests.end());
+    const char* names[3] = { "outcome", "attacker IPC loss", "defender IPC loss" };
+    QStringList result;
+    for (int i = 0; i < tests.size(); ++i) {
+        const Test& test = tests[i];
+        if (test.pValue > alpha / (tests.size() - i))
+            break;
+        result.append(list[test.scenario].description + ": " + names[test.test] + " differs (p = " +
+            QString::number(test.pValue, 'g', 3) + ")");
+    }
+    return result;
+}
+
+int EngineComparison::tests() const {
+    return _tests;
+}
+
+EngineComparison::Scenario EngineComparison::randomScenario(DiceGenerator& random) const {
+    Scenario result;
+    result.settings.narrowUnits = _narrowUnits;
+    result.settings.isLandBattle = (random.next() % 2) == 0;
+    result.settings.orderOfLoss = (random.next() % 2) == 0 ? OrderOfLossIPC : OrderOfLossValue;
+    if (result.settings.isLandBattle) {
+        result.settings.isAmphibiousCombat = (random.next() % 2) == 0;
+        result.settings.landUnitMustLive = (random.next() % 2) == 0;
+    }
+    result.seed = random.next();
+
+    // the same units that the faction widgets offer, and only units that can attack for the attacker
+    QList<Unit*> attackers;
+    QList<Unit*> defenders;
+    foreach (Unit* unit, _units) {
+        bool offered = result.settings.isLandBattle ? (!unit->isSea() || unit->canBombard()) : (unit->isSea() || unit->isAir());
+        if (offered && unit->canAttack() && !unit->isAA())
+            attackers.append(unit);
+        if (result.settings.isLandBattle ? !unit->isSea() : (unit->isSea() || unit->isAir()))
+            defenders.append(unit);
+    }
+    if (attackers.isEmpty() || defenders.isEmpty())
+        return result;
+
+    QString attackerDescription;
+    QString defenderDescription;
+    result.attacker = randomBatallion(attackers, 1 + random.next() % _maximumUnits, random, attackerDescription);
+    result.defender = randomBatallion(defenders, 1 + random.next() % _maximumUnits, random, defenderDescription);
+
+    QStringList flags;
+    flags.append(result.settings.isLandBattle ? "land" : "sea");
+    if (result.settings.isAmphibiousCombat)
+        flags.append("amphibious");
+    if (result.settings.landUnitMustLive)
+        flags.append("land unit must live");
+    flags.append(result.settings.orderOfLoss == OrderOfLossIPC ? "order of loss by IPC" : "order of loss by value");
+    result.description = attackerDescription + " vs. " + defenderDescription + " (" + flags.join(", ") + ")";
+    return result;
+}
+
+Batallion EngineComparison::randomBatallion(const QList<Unit*>& candidates, int units, DiceGenerator& random,
+                                            QString& description) const
+{
+    // a few unit types per side, so that the scenarios stay readable
+    int types = 1 + random.next() % qMin(3, candidates.size());
+    QList<Unit*> chosen;
+    while (chosen.size() < types) {
+        Unit* unit = candidates[random.next() % candidates.size()];
+        if (!chosen.contains(unit))
+            chosen.append(unit);
+    }
+
+    QVector<int> counts(types, 0);
+    for (int i = 0; i < units; ++i)
+        ++counts[random.next() % types];
+
+    Batallion result;
+    QStringList parts;
+    for (int i = 0; i < types; ++i) {
+        if (counts[i] == 0)
+            continue;
+        for (int j = 0; j < counts[i]; ++j)
+            result.append(UnitLite(chosen[i], _ipcFactor));
+        parts.append(QString::number(counts[i]) + " " + chosen[i]->name());
+    }
+    description = parts.join(", ");
+    return result;
+}
@@ -0,0 +1,105 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_ENGINECOMPARISON_H
+#define BOCK_ENGINECOMPARISON_H
+
+#include "combatthread.h"
+#include <QList>
+#include <QMap>
+#include <QStringList>
+
+class Unit;
+
+// Distribution of the outcomes of many battles of one setup. IPC losses are stored in multiples
+// of the map's ipc factor
+struct OutcomeHistogram {
+    enum Outcome {
+        OutcomeAttackerWins,
+        OutcomeDefenderWins,
+        OutcomeDraw
+    };
+
+    OutcomeHistogram();
+
+    template <typename Layout>
+    void addResult(const BasicBattle<Layout>& battle);
+    void merge(const OutcomeHistogram& other);
+
+    int battles;
+    int outcomes[3];
+    QMap<int, int> attackerIPCLoss; //< loss -> number of battles
+    QMap<int, int> defenderIPCLoss;
+};
+
+// An implementation of the combat rules; the same seed has to give the same battles
+typedef OutcomeHistogram (*CombatEngine)(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+    int battles, quint32 seed);
+
+OutcomeHistogram pseudoRandomEngine(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+    int battles, quint32 seed);
+// 16 scrambled Sobol sequences with 'battles' / 16 points each
+OutcomeHistogram quasiRandomEngine(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings,
+    int battles, quint32 seed);
+
+// p-values of the hypothesis that two histograms come from the same distribution
+double outcomeTest(const OutcomeHistogram& lhs, const OutcomeHistogram& rhs); //< chi-squared test of homogeneity
+double lossTest(const QMap<int, int>& lhs, int lhsBattles, const QMap<int, int>& rhs, int rhsBattles); //< two sample Kolmogorov-Smirnov
+
+// Runs random scenarios through two engines and checks that the distributions of the outcome and
+// of both IPC losses agree. The scenarios mix the map's units in sizes from one to 'maximumUnits'
+// units per side with random rule flags. The family-wise error rate over all tests is controlled
+// with Holm's method, so an agreeing engine fails with a probability of at most 'alpha' in total.
+// The KS test is conservative for the discrete losses
+class EngineComparison {
+public:
+    EngineComparison(const QList<Unit*>& units, int ipcFactor);
+
+    void setMaximumUnits(int units);
+
+    // returns a description of every failed test
+    QStringList compare(CombatEngine reference, CombatEngine candidate, int scenarios, int battles,
+        double alpha = 0.01, quint32 seed = 1);
+    int tests() const; //< of the last comparison
+
+private:
+    struct Scenario {
+        QString description;
+        Batallion attacker;
+        Batallion defender;
+        CombatSettings settings;
+        quint32 seed;
+        double pValues[3];
+    };
+
+    Scenario randomScenario(DiceGenerator& random) const;
+    Batallion randomBatallion(const QList<Unit*>& candidates, int units, DiceGenerator& random, QString& description) const;
+
+    QList<Unit*> _units;
+    int _ipcFactor;
+    bool _narrowUnits;
+    int _maximumUnits;
+    int _tests;
+};
+
+#endif
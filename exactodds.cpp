@@ -0,0 +1,178 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "exactodds.h"
+
+#include "combatrules.h"
+
+namespace {
+    const double STALEMATE = 1e-12; //< below this probability of a hit per round, nobody hits anymore
+
+    // the opening steps must not do anything and the round must be one fire step per side at most
+    // followed by one land casualty step per side
+    bool findFireSteps(const CombatProgram& program, const CombatStep* fire[2]) {
+        fire[CombatStep::SideAttacker] = 0;
+        fire[CombatStep::SideDefender] = 0;
+
+        foreach (const CombatStep& step, program.opening) {
+            if ((step.type != CombatStep::TypeAAFire) && (step.type != CombatStep::TypeBombardment))
+                return false;
+        }
+
+        bool hasCasualties[2] = { false, false };
+        for (int i = 0; i < program.round.size(); ++i) {
+            const CombatStep& step = program.round[i];
+            if (step.type == CombatStep::TypeFire) {
+                if (fire[step.side] || hasCasualties[0] || hasCasualties[1] || (step.hits != CombatStep::HitsRegular))
+                    return false;
+                fire[step.side] = &step;
+            }
+            else if (step.type == CombatStep::TypeCasualties) {
+                if (hasCasualties[step.side] || (step.hits != CombatStep::HitsRegular) ||
+                    (step.selection != CombatStep::SelectionLand) || step.ifNoDestroyer)
+                    return false;
+                hasCasualties[step.side] = true;
+            }
+            else
+                return false;
+        }
+        return hasCasualties[CombatStep::SideAttacker] && hasCasualties[CombatStep::SideDefender];
+    }
+
+    bool hasSupportedUnits(const Batallion& units) {
+        foreach (const UnitLite& unit, units) {
+            if (unit.isAA() || unit.canBombard() || unit.isTwoHit() || unit.isSea() || unit.isSub())
+                return false;
+        }
+        return true;
+    }
+
+    // the units in the order in which they are lost, which is the one of a single casualty step
+    // that takes all of them
+    Batallion casualtyOrder(const Batallion& units, bool isDefender, OrderOfLoss ool) {
+        QVector<UnitLite> buffer = units.toVector();
+        QVector<UnitLite> casualtyBuffer = buffer;
+        UnitArray bat(buffer.data(), buffer.size());
+        UnitArray casualties(casualtyBuffer.data(), casualtyBuffer.size());
+        bat.assign(units);
+        applyCasualtyLand(bat, casualties, units.size(), isDefender, ool, false);
+        return casualties.toBatallion();
+    }
+}
+
+ExactOdds::ExactOdds()
+    : attackerWinProbability(0.0)
+    , defenderWinProbability(0.0)
+    , drawProbability(0.0)
+    , attackerUnitsLeft(0.0)
+    , defenderUnitsLeft(0.0)
+    , attackerIPCLoss(0.0)
+    , defenderIPCLoss(0.0)
+{}
+
+bool ExactOddsSolver::isSupported(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings) {
+    if (!settings.isLandBattle || settings.landUnitMustLive || (settings.maxRounds > 0) || !settings.rules)
+        return false;
+    const CombatStep* fire[2];
+    return findFireSteps(settings.rules->landBattle(), fire) && hasSupportedUnits(attacker) && hasSupportedUnits(defender);
+}
+
+bool ExactOddsSolver::solve(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, ExactOdds& result) {
+    if (!isSupported(attacker, defender, settings))
+        return false;
+
+    const CombatStep* fire[2];
+    findFireSteps(settings.rules->landBattle(), fire);
+
+    // hits[side][k] are the hits of 'side' after it lost its first k units, ipc[side][k] the
+    // value of these units
+    const Batallion* units[2] = { &attacker, &defender };
+    QVector<HitDistribution> hits[2];
+    QVector<double> ipc[2];
+    for (int side = 0; side < 2; ++side) {
+        const int size = units[side]->size();
+        const Batallion order = casualtyOrder(*units[side], side == CombatStep::SideDefender, settings.orderOfLoss);
+        hits[side].resize(size + 1);
+        ipc[side].resize(size + 1);
+        ipc[side][0] = 0.0;
+        for (int k = 0; k <= size; ++k) {
+            if (k > 0)
+                ipc[side][k] = ipc[side][k - 1] + order[k - 1].ipcValue();
+            if (!fire[side] || (k == size))
+                continue;
+            // the units are only sorted once the first of them is lost, which matters for the
+            // units that get artillery support
+            const Batallion remaining = (k == 0) ? *units[side] : order.mid(k);
+            hits[side][k] = _kernel.distribution(remaining, *fire[side], settings.isAmphibiousCombat);
+        }
+    }
+
+    // probability[i * (defenderSize + 1) + j] of a round beginning with i attacker and j
+    // defender casualties. Casualties never come back, so a state only passes its probability
+    // on to the states after it
+    const int attackerSize = attacker.size();
+    const int defenderSize = defender.size();
+    QVector<double> probability((attackerSize + 1) * (defenderSize + 1), 0.0);
+    probability[0] = 1.0;
+    result = ExactOdds();
+
+    for (int i = 0; i <= attackerSize; ++i) {
+        for (int j = 0; j <= defenderSize; ++j) {
+            const double p = probability[i * (defenderSize + 1) + j];
+            if (p == 0.0)
+                continue;
+
+            const HitDistribution& attackerHits = hits[CombatStep::SideAttacker][i];
+            const HitDistribution& defenderHits = hits[CombatStep::SideDefender][j];
+            const bool isOver = (i == attackerSize) || (j == defenderSize);
+            const double noHits = isOver ? 1.0 : attackerHits.probability(0) * defenderHits.probability(0);
+
+            if (noHits > 1.0 - STALEMATE) {
+                if (i == attackerSize && j < defenderSize)
+                    result.defenderWinProbability += p;
+                else if (i < attackerSize && j == defenderSize)
+                    result.attackerWinProbability += p;
+                else
+                    result.drawProbability += p;
+                result.attackerUnitsLeft += p * (attackerSize - i);
+                result.defenderUnitsLeft += p * (defenderSize - j);
+                result.attackerIPCLoss += p * ipc[CombatStep::SideAttacker][i];
+                result.defenderIPCLoss += p * ipc[CombatStep::SideDefender][j];
+                continue;
+            }
+
+            const double scale = p / (1.0 - noHits);
+            for (int a = attackerHits.minimumHits(); a <= attackerHits.maximumHits(); ++a) {
+                const double pa = scale * attackerHits.probability(a);
+                const int nextJ = qMin(j + a, defenderSize);
+                for (int d = defenderHits.minimumHits(); d <= defenderHits.maximumHits(); ++d) {
+                    if ((a == 0) && (d == 0))
+                        continue;
+                    const int nextI = qMin(i + d, attackerSize);
+                    probability[nextI * (defenderSize + 1) + nextJ] += pa * defenderHits.probability(d);
+                }
+            }
+        }
+    }
+    return true;
+}
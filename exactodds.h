@@ -0,0 +1,62 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_EXACTODDS_H
+#define BOCK_EXACTODDS_H
+
+#include "combatthread.h"
+#include "hitdistribution.h"
+
+// Exact outcome of a battle; the IPC losses are in multiples of the map's ipc factor
+struct ExactOdds {
+    ExactOdds();
+
+    double attackerWinProbability;
+    double defenderWinProbability;
+    double drawProbability;
+    double attackerUnitsLeft;
+    double defenderUnitsLeft;
+    double attackerIPCLoss;
+    double defenderIPCLoss;
+};
+
+// Computes the odds of a land battle without rolling any dice. The casualties of a side are
+// always taken in the same order, so the state of the battle at the beginning of a round is the
+// number of casualties of both sides, and the battle is a Markov chain over these states whose
+// transitions are the hit distributions of both fire steps. A round in which no side hits does
+// not change the state and is divided out. A battle in which no side can hit anymore is a draw.
+// Only the land battles of the form "every side fires, then every side takes its casualties"
+// without AA guns, bombardment, two hit units, a round limit or the rule that a land unit must
+// survive are supported; for everything else the battle has to be simulated
+class ExactOddsSolver {
+public:
+    static bool isSupported(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings);
+
+    // returns false if the battle is not supported
+    bool solve(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, ExactOdds& result);
+
+private:
+    HitKernel _kernel;
+};
+
+#endif
@@ -31,16 +31,205 @@
 #include <QGridLayout>
 #include <QGroupBox>
 #include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
 #include <QPushButton>
 #include <QScrollArea>
+#include <QToolTip>
 
+namespace {
+    const int LABELSPACE = 30; //< space for the axis labels in pixels
+}
 
-DetailedInformationWidget::DetailedInformationWidget(QWidget* parent)
+SurvivalView::SurvivalView(int ipcFactor, QWidget* parent)
     : QWidget(parent)
+    , _ipcFactor(ipcFactor)
+{
+    setMouseTracking(true);
+    setMinimumSize(200, 120);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+}
+
+void SurvivalView::setSurvivalCurve(const SurvivalCurve& curve) {
+    _curve = curve;
+    update();
+}
+
+QSize SurvivalView::sizeHint() const {
+    return QSize(400, 180);
+}
+
+QRect SurvivalView::plotRect() const {
+    return rect().adjusted(LABELSPACE, LABELSPACE / 2, -LABELSPACE / 2, -LABELSPACE);
+}
+
+QPointF SurvivalView::point(int round, float value) const {
+    QRect plot = plotRect();
+    float x = plot.left() + static_cast<float>(round * plot.width()) / qMax(1, _curve.rounds() - 1);
+    float y = plot.bottom() - value * plot.height();
+    return QPointF(x, y);
+}
+
+float SurvivalView::fraction(bool attacker, int round) const {
+    float start = _curve.expectedUnits(attacker, 0);
+    return (start > 0.f) ? _curve.expectedUnits(attacker, round) / start : 0.f;
+}
+
+void SurvivalView::paintEvent(QPaintEvent*) {
+    int rounds = _curve.rounds();
+    if ((_curve.battles == 0) || (rounds < 2))
+        return;
+
+    QPainter painter(this);
+    QRect plot = plotRect();
+    painter.setPen(palette().color(QPalette::Mid));
+    painter.drawRect(plot);
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawText(QRect(0, plot.top() - LABELSPACE / 2, LABELSPACE - 2, LABELSPACE), Qt::AlignRight | Qt::AlignVCenter, "100%");
+    painter.drawText(QRect(0, plot.bottom() - LABELSPACE / 2, LABELSPACE - 2, LABELSPACE), Qt::AlignRight | Qt::AlignVCenter, "0%");
+    for (int round = 0; round < rounds; ++round) {
+        QPointF p = point(round, 0.f);
+        painter.drawText(QRectF(p.x() - LABELSPACE / 2, plot.bottom(), LABELSPACE, LABELSPACE), Qt::AlignCenter, QString::number(round));
+    }
+
+    QPolygonF running;
+    QPolygonF attacker;
+    QPolygonF defender;
+    for (int round = 0; round < rounds; ++round) {
+        running << point(round, _curve.runningProbability(round));
+        attacker << point(round, fraction(true, round));
+        defender << point(round, fraction(false, round));
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    const QColor colors[] = { Qt::gray, QColor(0xAA, 0, 0), QColor(0, 0, 0xAA) };
+    const char* names[] = { "Battle running", "Attacker units", "Defender units" };
+    const QPolygonF* lines[] = { &running, &attacker, &defender };
+    for (int i = 0; i < 3; ++i) {
+        painter.setPen(QPen(colors[i], 2));
+        painter.drawPolyline(*lines[i]);
+        painter.drawText(QRect(plot.right() - 120, plot.top() + 4 + i * 14, 116, 14), Qt::AlignRight | Qt::AlignVCenter, names[i]);
+    }
+}
+
+void SurvivalView::mouseMoveEvent(QMouseEvent* event) {
+    int rounds = _curve.rounds();
+    if ((_curve.battles == 0) || (rounds < 2))
+        return;
+
+    float step = point(1, 0.f).x() - point(0, 0.f).x();
+    int round = qBound(0, qRound((event->pos().x() - plotRect().left()) / step), rounds - 1);
+    QString text = ((round == 0) ? QString("Start") : "After round " + QString::number(round)) +
+        "\nBattle running: " + QString::number(_curve.runningProbability(round) * 100, 'f', 1) + "%" +
+        "\nAttacker: " + QString::number(_curve.expectedUnits(true, round), 'f', 2) + " units, " +
+            QString::number(_curve.expectedIPC(true, round) / _ipcFactor, 'f', 1) + " IPC" +
+        "\nDefender: " + QString::number(_curve.expectedUnits(false, round), 'f', 2) + " units, " +
+            QString::number(_curve.expectedIPC(false, round) / _ipcFactor, 'f', 1) + " IPC";
+    QToolTip::showText(event->globalPos(), text, this);
+}
+
+
+DetailedInformationWidget::DetailedInformationWidget(CombatWidget* combatWidget, FactionSide side, QWidget* parent)
+    : QWidget(parent, Qt::Tool)
+    , _combatWidget(combatWidget)
+    , _side(side)
+    , _survivalView(0)
+    , _exampleBox(0)
+    , _exampleText(0)
 {
+    setWindowTitle(side == FactionSideAttacker ? "Detailed information (Attacker)" : "Detailed information (Defender)");
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    _survivalView = new SurvivalView(combatWidget->ipcFactor());
+    layout->addWidget(_survivalView);
+
+    _exampleBox = new QComboBox;
+    connect(_exampleBox, SIGNAL(currentIndexChanged(int)), this, SLOT(showExample(int)));
+    layout->addWidget(_exampleBox);
+
+    _exampleText = new QLabel;
+    _exampleText->setTextFormat(Qt::RichText);
+    _exampleText->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    _exampleText->setWordWrap(true);
+    QScrollArea* scrollArea = new QScrollArea;
+    scrollArea->setWidget(_exampleText);
+    scrollArea->setWidgetResizable(true);
+    layout->addWidget(scrollArea);
+    resize(400, 400);
+}
+
+void DetailedInformationWidget::setExamples(const QList<BattleRecord>& examples) {
+    _examples = examples;
+    _exampleBox->clear();
+    int number[3] = { 0, 0, 0 };
+    foreach (const BattleRecord& example, examples) {
+        QString outcome;
+        if (example.outcome == BattleOutcomeDraw)
+            outcome = "Draw";
+        else if ((example.outcome == BattleOutcomeAttackerWins) == (_side == FactionSideAttacker))
+            outcome = "Win";
+        else
+            outcome = "Loss";
+        _exampleBox->addItem(outcome + " " + QString::number(++number[example.outcome]) +
+            " (" + QString::number(example.rounds.size() - 1) + " rounds)");
+    }
+}
+
+void DetailedInformationWidget::setSurvivalCurve(const SurvivalCurve& curve) {
+    _survivalView->setSurvivalCurve(curve);
+}
+
+void DetailedInformationWidget::clearResults() {
+    _survivalView->setSurvivalCurve(SurvivalCurve());
+    _examples.clear();
+    _exampleBox->clear();
+    _exampleText->setText("");
+}
+
+void DetailedInformationWidget::showExample(int index) {
+    if ((index < 0) || (index >= _examples.size())) {
+        _exampleText->setText("");
+        return;
+    }
+
+    const BattleRecord& example = _examples[index];
+    float ipcFactor = static_cast<float>(_combatWidget->ipcFactor());
+    QString text = "<table><tr><th>Round</th><th>Attacker units</th><th>Defender units</th><th>Attacker IPC loss</th><th>Defender IPC loss</th></tr>";
+    for (int i = 0; i < example.rounds.size(); ++i) {
+        const CombatRound& round = example.rounds[i];
+        text += "<tr><td>" + (i == 0 ? QString("Start") : QString::number(i)) + "</td>" +
+            "<td>" + QString::number(round.attackerUnits) + "</td>" +
+            "<td>" + QString::number(round.defenderUnits) + "</td>" +
+            "<td>" + QString::number(round.attackerIPCLoss / ipcFactor) + "</td>" +
+            "<td>" + QString::number(round.defenderIPCLoss / ipcFactor) + "</td></tr>";
+    }
+    text += "</table>";
+    text += "<p><b>Attacker left:</b> " + unitList(example.attacker) + "<br>";
+    text += "<b>Attacker lost:</b> " + unitList(example.attackerCasualities) + "<br>";
+    text += "<b>Defender left:</b> " + unitList(example.defender) + "<br>";
+    text += "<b>Defender lost:</b> " + unitList(example.defenderCasualities) + "</p>";
+    text += "<p>Seed " + QString::number(example.seed) + "</p>";
+    _exampleText->setText(text);
+}
+
+QString DetailedInformationWidget::unitList(const Batallion& units) const {
+    QList<int> ids;
+    QMap<int, int> counts;
+    foreach (const UnitLite& unit, units) {
+        if (!counts.contains(unit.id()))
+            ids.append(unit.id());
+        ++counts[unit.id()];
+    }
+    if (ids.isEmpty())
+        return "-";
+
+    QStringList result;
+    foreach (int id, ids)
+        result.append(QString::number(counts[id]) + " " + _combatWidget->nameForID(id));
+    return result.join(", ");
 }
 
-InformationWidget::InformationWidget(QWidget* parent)
+InformationWidget::InformationWidget(CombatWidget* combatWidget, FactionSide side, QWidget* parent)
     : QGroupBox(parent)
     , _winResult(nullptr)
     , _drawResult(nullptr)
@@ -48,7 +237,7 @@ InformationWidget::InformationWidget(QWidget* parent)
     , _ipcLoss(nullptr)
     , _detailedInformationWidget(nullptr)
 {
-    _detailedInformationWidget = new DetailedInformationWidget(this);
+    _detailedInformationWidget = new DetailedInformationWidget(combatWidget, side, this);
 
     QVBoxLayout* mainLayout = new QVBoxLayout(this);
     QHBoxLayout* line1 = new QHBoxLayout;
@@ -81,7 +270,7 @@ InformationWidget::InformationWidget(QWidget* parent)
     mainLayout->addWidget(detailedInformationButton);
 }
 
-void InformationWidget::setResult(QList<CombatThread*>* results, float winPercentage, float drawPercentage,
+void InformationWidget::setResult(float winPercentage, float winError, int battles, float drawPercentage,
                                   bool doesWin, float averageUnitLeft, int totalUnitsAtStart, float averageIPCLoss)
 {
     QString win = QString::number(winPercentage * 100) + "%";
@@ -91,6 +280,11 @@ void InformationWidget::setResult(QList<CombatThread*>* results, float winPercen
         _winResult->setText("<font color=#00AA00>" + win + "</font>");
     else
         _winResult->setText("<font color=#AA0000>" + win + "</font>");
+    if (battles == 0)
+        _winResult->setToolTip("Exact odds from the odds table of the map");
+    else
+        _winResult->setToolTip(QString(QChar(0x00B1)) + " " + QString::number(winError * 100, 'f', 2) + "% (95% confidence, " +
+            QString::number(battles) + " battles)");
 
     _drawResult->setText(draw);
 
@@ -98,8 +292,18 @@ void InformationWidget::setResult(QList<CombatThread*>* results, float winPercen
     _ipcLoss->setText(QString::number(averageIPCLoss));
 }
 
+void InformationWidget::setExamples(const QList<BattleRecord>& examples) {
+    _detailedInformationWidget->setExamples(examples);
+}
+
+void InformationWidget::setSurvivalCurve(const SurvivalCurve& curve) {
+    _detailedInformationWidget->setSurvivalCurve(curve);
+}
+
 void InformationWidget::clearResults() {
+    _detailedInformationWidget->clearResults();
     _winResult->setText("");
+    _winResult->setToolTip("");
     _drawResult->setText("");
     _unitLeft->setText("");
     _ipcLoss->setText("");
@@ -125,13 +329,13 @@ FactionWidget::FactionWidget(CombatWidget* parent, const QString& title, Faction
 
     _factionBox = new QComboBox;
     initFactions();
-    connect(_factionBox, SIGNAL(currentIndexChanged(const QString&)), this, SLOT(recreateUnits()));
+    connect(_factionBox, SIGNAL(currentIndexChanged(const QString&)), this, SLOT(updateUnits()));
     layout->addWidget(_factionBox);
 
     QGroupBox* unitsGroupBox = new QGroupBox;
     QScrollArea* unitsScrollArea = new QScrollArea;
     _unitsLayout = new QGridLayout(unitsGroupBox);
-    createUnits();
+    updateUnits();
     unitsScrollArea->setMinimumWidth(300);
     unitsScrollArea->setWidgetResizable(true);
     unitsScrollArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
@@ -140,7 +344,7 @@ FactionWidget::FactionWidget(CombatWidget* parent, const QString& title, Faction
     unitsGroupBox->setLayout(_unitsLayout);
     layout->addWidget(unitsScrollArea);
 
-    _infoWidget = new InformationWidget(this);
+    _infoWidget = new InformationWidget(_parent, _side, this);
     _infoWidget->setEnabled(false);
     layout->addWidget(_infoWidget);
 }
@@ -159,22 +363,15 @@ void FactionWidget::initFactions() {
     }
 }
 
-void FactionWidget::createUnits() {
-    const QString& faction = _factionBox->currentText();
-    if (_parent->groups().contains(faction)) {
-        QStringList factions = _parent->factionsForGroup(faction);
-        foreach (const QString& f, factions)
-            createUnits(f);
-    }
-    else
-        createUnits(faction);
-}
+const QList<UnitWidget*>& FactionWidget::createUnits(const QString& faction) {
+    if (_unitWidgetPool.contains(faction))
+        return _unitWidgetPool[faction];
 
-void FactionWidget::createUnits(const QString& faction) {
+    QList<UnitWidget*>& unitWidgets = _unitWidgetPool[faction];
     QList<Unit*> units = _parent->units();
 
     foreach (Unit* unit, units) {
-        QPixmap pm = _parent->unitIcon(faction, unit->id());
+        QPixmap pm = _parent->unitIcon(faction, unit->id(), UnitWidget::IconWidth);
         if (pm.isNull())
             continue;
 
@@ -184,36 +381,58 @@ void FactionWidget::createUnits(const QString& faction) {
         if ((_side == FactionSideDefender) && (unit->defenseValue() == 0))
             continue;
 
-        if (_parent->isLandBattle()) {
-            if (unit->isSea()) {
-                if (_side == FactionSideDefender)
-                    continue;
+        UnitWidget* unitWidget = new UnitWidget(this, unit, pm);
+        unitWidget->hide();
+        unitWidgets.append(unitWidget);
+    }
+    return unitWidgets;
+}
+
+bool FactionWidget::isUnitVisible(const Unit* unit) const {
+    if (_parent->isLandBattle()) {
+        if (unit->isSea()) {
+            if (_side == FactionSideDefender)
+                return false;
             else if (!unit->canBombard())
-                continue;
-            }
+                return false;
         }
-        else {
-            if (!unit->isSea() && !unit->isAir())
-                continue;
-        }
-
-        UnitWidget* unitWidget = new UnitWidget(this, unit, pm);
-        _unitsLayout->addWidget(unitWidget, _unitWidgets.size() / 2, _unitWidgets.size() % 2);
-        _unitWidgets.append(unitWidget);
     }
+    else {
+        if (!unit->isSea() && !unit->isAir())
+            return false;
+    }
+    return true;
 }
 
-void FactionWidget::deleteUnits() {
+void FactionWidget::updateUnits() {
+    QStringList factions;
+    const QString& faction = _factionBox->currentText();
+    if (_parent->groups().contains(faction))
+        factions = _parent->factionsForGroup(faction);
+    else
+        factions.append(faction);
+
+    QList<UnitWidget*> visibleWidgets;
+    foreach (const QString& f, factions) {
+        foreach (UnitWidget* unitWidget, createUnits(f)) {
+            if (isUnitVisible(unitWidget->widgetUnit()))
+                visibleWidgets.append(unitWidget);
+        }
+    }
+
+    // the widgets are only moved around in the grid; their entered amounts are kept
     foreach (UnitWidget* unitWidget, _unitWidgets) {
         _unitsLayout->removeWidget(unitWidget);
-        delete unitWidget;
+        if (!visibleWidgets.contains(unitWidget))
+            unitWidget->hide();
     }
-    _unitWidgets.clear();
-}
-
-void FactionWidget::recreateUnits() {
-    deleteUnits();
-    createUnits();
+    for (int i = 0; i < visibleWidgets.size(); ++i) {
+        UnitWidget* unitWidget = visibleWidgets[i];
+        _unitsLayout->addWidget(unitWidget, i / 2, i % 2);
+        unitWidget->show();
+    }
+    _unitWidgets = visibleWidgets;
+    emit unitsChanged();
 }
 
 QList<QPair<Unit*, int> > FactionWidget::getUnits() const {
@@ -227,12 +446,16 @@ QList<QPair<Unit*, int> > FactionWidget::getUnits() const {
 }
 
 void FactionWidget::setUnits(const QList<QPair<Unit*, int> >& units) {
+    // the pooled widgets might still hold amounts from an earlier use of this faction
+    foreach (UnitWidget* w, _unitWidgets)
+        w->setAmount(0);
+
     QPair<Unit*, int> p;
     foreach (p, units) {
         Unit* u = p.first;
         int n = p.second;
         foreach (UnitWidget* w, _unitWidgets) {
-            if (w->widgetUnit() == u) {
+            if ((w->widgetUnit() == u) && (w->units().second == 0)) {
                 w->setAmount(n);
                 break;
             }
@@ -241,8 +464,9 @@ void FactionWidget::setUnits(const QList<QPair<Unit*, int> >& units) {
 }
 
 void FactionWidget::clear() {
-    foreach (UnitWidget* unitWidget, _unitWidgets) {
-        unitWidget->setAmount(0);
+    foreach (const QList<UnitWidget*>& unitWidgets, _unitWidgetPool) {
+        foreach (UnitWidget* unitWidget, unitWidgets)
+            unitWidget->setAmount(0);
     }
 }
 
@@ -256,11 +480,11 @@ void FactionWidget::setFaction(const QString& faction) {
     _factionBox->setCurrentIndex(index);
 }
 
-void FactionWidget::setResults(QList<CombatThread*>* results, float winPercentage, float drawPercentage,
+void FactionWidget::setResults(float winPercentage, float winError, int battles, float drawPercentage,
                                bool doesWin, float averageUnitLeft, int totalUnitsAtStart, float averageIPCLoss)
 {
     _infoWidget->setEnabled(true);
-    _infoWidget->setResult(results, winPercentage, drawPercentage,
+    _infoWidget->setResult(winPercentage, winError, battles, drawPercentage,
         doesWin, averageUnitLeft, totalUnitsAtStart,averageIPCLoss);
     //QString win = QString::number(winPercentage * 100) + "%";
     //QString draw = QString::number(drawPercentage * 100) + "%";
@@ -276,6 +500,14 @@ void FactionWidget::setResults(QList<CombatThread*>* results, float winPercentag
     //ipcLoss_->setText(QString::number(averageIPCLoss));
 }
 
+void FactionWidget::setExamples(const QList<BattleRecord>& examples) {
+    _infoWidget->setExamples(examples);
+}
+
+void FactionWidget::setSurvivalCurve(const SurvivalCurve& curve) {
+    _infoWidget->setSurvivalCurve(curve);
+}
+
 void FactionWidget::clearResults() {
     _infoWidget->clearResults();
 }
@@ -26,9 +26,9 @@
 
 #include <QGroupBox>
 
+#include "combatthread.h"
 #include "unit.h"
 
-class CombatThread;
 class CombatWidget;
 class QComboBox;
 class QGridLayout;
@@ -42,18 +42,61 @@ enum FactionSide {
 
 class InformationWidget;
 
-class DetailedInformationWidget : public QWidget{
+// Plots a SurvivalCurve: the probability that the battle is still running after each round and
+// the expected survivors of both sides relative to the start
+class SurvivalView : public QWidget {
+Q_OBJECT
+public:
+    SurvivalView(int ipcFactor, QWidget* parent = 0);
+
+    void setSurvivalCurve(const SurvivalCurve& curve);
+    QSize sizeHint() const;
+
+protected:
+    void paintEvent(QPaintEvent* event);
+    void mouseMoveEvent(QMouseEvent* event);
+
+private:
+    QRect plotRect() const;
+    QPointF point(int round, float value) const;
+    float fraction(bool attacker, int round) const; //< of the units at the start
+
+    SurvivalCurve _curve;
+    int _ipcFactor;
+};
+
+// Shows the course of the last run's battles and a few of them as examples, as seen from one side
+class DetailedInformationWidget : public QWidget {
+Q_OBJECT
 public:
-    DetailedInformationWidget(QWidget* parent);
+    DetailedInformationWidget(CombatWidget* combatWidget, FactionSide side, QWidget* parent);
+
+    void setExamples(const QList<BattleRecord>& examples);
+    void setSurvivalCurve(const SurvivalCurve& curve);
+    void clearResults();
+
+private slots:
+    void showExample(int index);
 
+private:
+    QString unitList(const Batallion& units) const;
+
+    CombatWidget* _combatWidget;
+    FactionSide _side;
+    SurvivalView* _survivalView;
+    QComboBox* _exampleBox;
+    QLabel* _exampleText;
+    QList<BattleRecord> _examples;
 };
 
 class InformationWidget : public QGroupBox {
 Q_OBJECT
 public:
-    InformationWidget(QWidget* parent);
-    void setResult(QList<CombatThread*>* results, float winPercentage, float drawPercentage, bool doesWin,
+    InformationWidget(CombatWidget* combatWidget, FactionSide side, QWidget* parent);
+    void setResult(float winPercentage, float winError, int battles, float drawPercentage, bool doesWin,
         float averageUnitLeft, int totalUnitsAtStart, float averageIPCLoss);
+    void setExamples(const QList<BattleRecord>& examples);
+    void setSurvivalCurve(const SurvivalCurve& curve);
     void clearResults();
 
 private slots:
@@ -79,18 +122,24 @@ public:
     void setFaction(const QString& faction);
     void clear();
 
-    void setResults(QList<CombatThread*>* results, float winPercentage, float drawPercentage, bool doesWin,
+    // 'winError' is the half width of the 95% confidence interval of 'winPercentage' after 'battles' battles;
+    // 'battles' is 0 for exact odds
+    void setResults(float winPercentage, float winError, int battles, float drawPercentage, bool doesWin,
         float averageUnitLeft, int totalUnitsAtStart, float averageIPCLoss);
+    void setExamples(const QList<BattleRecord>& examples);
+    void setSurvivalCurve(const SurvivalCurve& curve);
     void clearResults();
 
+signals:
+    void unitsChanged(); //< an amount was changed or other units are shown
+
 private slots:
-    void recreateUnits();
+    void updateUnits();
 
 private:
     void initFactions();
-    void createUnits();
-    void createUnits(const QString& faction);
-    void deleteUnits();
+    const QList<UnitWidget*>& createUnits(const QString& faction);
+    bool isUnitVisible(const Unit* unit) const;
 
     QGridLayout* _unitsLayout;
     QComboBox* _factionBox;
@@ -98,7 +147,8 @@ private:
     FactionSide _side;
     InformationWidget* _infoWidget;
     
-    QList<UnitWidget*> _unitWidgets;
+    QList<UnitWidget*> _unitWidgets; //< the currently visible widgets
+    QMap<QString, QList<UnitWidget*> > _unitWidgetPool; //< all widgets created so far, per faction
 };
 
 #endif
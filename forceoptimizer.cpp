@@ -0,0 +1,234 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "forceoptimizer.h"
+
+#include "combatscheduler.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace {
+    const int QUICKBATTLES = 400;
+    const int PRECISEBATTLES = 4000;
+
+    struct QueueEntry {
+        QVector<int> counts;
+        float cost;
+        int lastIndex; //< only counts at or behind this index are incremented to avoid duplicates
+
+        bool operator<(const QueueEntry& rhs) const {
+            // std::priority_queue is a max-heap
+            return cost > rhs.cost;
+        }
+    };
+
+    bool isContainedIn(const QVector<int>& lhs, const QVector<int>& rhs) {
+        for (int i = 0; i < lhs.size(); ++i) {
+            if (lhs[i] > rhs[i])
+                return false;
+        }
+        return true;
+    }
+
+    struct Evaluate {
+        typedef void result_type;
+
+        Evaluate(const Batallion& defender, const CombatSettings& settings)
+            : defender(defender)
+            , settings(settings)
+        {}
+
+        template <typename T>
+        void operator()(T& evaluation) {
+            CombatStatistics s = simulateCombat(evaluation.attacker, defender, settings, evaluation.battles, evaluation.seed);
+            evaluation.candidate.statistics.merge(s);
+        }
+
+        const Batallion& defender;
+        const CombatSettings& settings;
+    };
+
+    bool lessThanCandidate(const ForceCandidate& lhs, const ForceCandidate& rhs) {
+        if (lhs.ipcCost != rhs.ipcCost)
+            return lhs.ipcCost < rhs.ipcCost;
+        return lhs.statistics.attackerWinProbability() > rhs.statistics.attackerWinProbability();
+    }
+}
+
+ForceOptimizer::ForceOptimizer(const QList<QPair<Unit*, int> >& available, const Batallion& defender,
+                               const CombatSettings& settings, int ipcFactor)
+    : _available(available)
+    , _defender(defender)
+    , _settings(settings)
+    , _ipcFactor(ipcFactor)
+    , _target(0.9f)
+    , _maximumResults(10)
+    , _maximumEvaluations(2000)
+    , _evaluations(0)
+{}
+
+void ForceOptimizer::setTargetWinProbability(float probability) {
+    _target = probability;
+}
+
+void ForceOptimizer::setMaximumResults(int results) {
+    _maximumResults = results;
+}
+
+void ForceOptimizer::setMaximumEvaluations(int evaluations) {
+    _maximumEvaluations = evaluations;
+}
+
+int ForceOptimizer::evaluations() const {
+    return _evaluations;
+}
+
+const QList<QPair<Unit*, int> >& ForceOptimizer::available() const {
+    return _available;
+}
+
+float ForceOptimizer::cost(const QVector<int>& counts) const {
+    float result = 0.f;
+    for (int i = 0; i < counts.size(); ++i)
+        result += counts[i] * _available[i].first->ipcValue();
+    return result;
+}
+
+bool ForceOptimizer::isDominatedByWinner(const QVector<int>& counts) const {
+    foreach (const QVector<int>& winner, _winners) {
+        if (isContainedIn(winner, counts))
+            return true;
+    }
+    return false;
+}
+
+bool ForceOptimizer::isDominatedByLoser(const QVector<int>& counts) const {
+    foreach (const QVector<int>& loser, _losers) {
+        if (isContainedIn(counts, loser))
+            return true;
+    }
+    return false;
+}
+
+Batallion ForceOptimizer::batallion(const QVector<int>& counts) const {
+    Batallion result;
+    for (int i = 0; i < counts.size(); ++i) {
+        for (int j = 0; j < counts[i]; ++j)
+            result.append(UnitLite(_available[i].first, _ipcFactor));
+    }
+    return result;
+}
+
+void ForceOptimizer::evaluate(QList<Evaluation>& evaluations, int battles) {
+    for (int i = 0; i < evaluations.size(); ++i) {
+        evaluations[i].battles = battles;
+        evaluations[i].seed = qrand();
+    }
+    blockingCombatMap(evaluations, Evaluate(_defender, _settings), CombatPriorityInteractive);
+}
+
+QList<ForceCandidate> ForceOptimizer::optimize() {
+    _winners.clear();
+    _losers.clear();
+    _evaluations = 0;
+    QList<ForceCandidate> results;
+
+    // the candidates are generated lazily in the order of increasing cost
+    std::priority_queue<QueueEntry> queue;
+    QueueEntry empty;
+    empty.counts = QVector<int>(_available.size(), 0);
+    empty.cost = 0.f;
+    empty.lastIndex = 0;
+    queue.push(empty);
+
+    const int batchSize = CombatScheduler::instance()->threadCount() * 2;
+
+    while (!queue.empty() && (results.size() < _maximumResults) && (_evaluations < _maximumEvaluations)) {
+        QList<Evaluation> batch;
+        while (!queue.empty() && (batch.size() < batchSize)) {
+            QueueEntry entry = queue.top();
+            queue.pop();
+
+            // every force generated from a winning one contains it and is more expensive
+            if (isDominatedByWinner(entry.counts))
+                continue;
+
+            for (int i = entry.lastIndex; i < entry.counts.size(); ++i) {
+                if (entry.counts[i] < _available[i].second) {
+                    QueueEntry next = entry;
+                    ++next.counts[i];
+                    next.cost = cost(next.counts);
+                    next.lastIndex = i;
+                    queue.push(next);
+                }
+            }
+
+            bool isEmpty = std::count(entry.counts.begin(), entry.counts.end(), 0) == entry.counts.size();
+            if (isEmpty || isDominatedByLoser(entry.counts))
+                continue;
+
+            Evaluation evaluation;
+            evaluation.candidate.counts = entry.counts;
+            evaluation.candidate.ipcCost = entry.cost;
+            evaluation.attacker = batallion(entry.counts);
+            batch.append(evaluation);
+        }
+        if (batch.isEmpty())
+            continue;
+
+        _evaluations += batch.size();
+
+        // cheap estimate first; only candidates which might reach the target get precise numbers
+        evaluate(batch, QUICKBATTLES);
+        QList<Evaluation> precise;
+        foreach (const Evaluation& evaluation, batch) {
+            float lower, upper;
+            evaluation.candidate.statistics.attackerWinInterval(lower, upper);
+            if (upper < _target)
+                _losers.append(evaluation.candidate.counts);
+            else
+                precise.append(evaluation);
+        }
+        evaluate(precise, PRECISEBATTLES);
+
+        foreach (const Evaluation& evaluation, precise) {
+            ForceCandidate candidate = evaluation.candidate;
+            // a cheaper winner of the same batch might be contained in this one
+            if (isDominatedByWinner(candidate.counts))
+                continue;
+            if (candidate.statistics.attackerWinProbability() >= _target) {
+                candidate.statistics.attackerWinInterval(candidate.lowerBound, candidate.upperBound);
+                _winners.append(candidate.counts);
+                results.append(candidate);
+            }
+            else
+                _losers.append(candidate.counts);
+        }
+    }
+
+    qSort(results.begin(), results.end(), lessThanCandidate);
+    while (results.size() > _maximumResults)
+        results.removeLast();
+    return results;
+}
@@ -0,0 +1,87 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_FORCEOPTIMIZER_H
+#define BOCK_FORCEOPTIMIZER_H
+
+#include "combatthread.h"
+#include "unit.h"
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+struct ForceCandidate {
+    QVector<int> counts; //< number of units per available unit type
+    float ipcCost;
+    CombatStatistics statistics;
+    float lowerBound;
+    float upperBound;
+};
+
+// Searches for the cheapest attacking forces (by IPC) out of the available units that win
+// against the defender with at least the target probability. It relies on the monotonicity
+// of the win probability: a force that contains a winning force is never cheaper, and a force
+// that is contained in a losing force does not need to be simulated. Each candidate is first
+// estimated with a few battles and only simulated precisely if it is close to the target.
+class ForceOptimizer {
+public:
+    ForceOptimizer(const QList<QPair<Unit*, int> >& available, const Batallion& defender,
+        const CombatSettings& settings, int ipcFactor);
+
+    void setTargetWinProbability(float probability);
+    void setMaximumResults(int results);
+    void setMaximumEvaluations(int evaluations);
+
+    QList<ForceCandidate> optimize();
+    int evaluations() const;
+
+    const QList<QPair<Unit*, int> >& available() const;
+
+private:
+    struct Evaluation {
+        ForceCandidate candidate;
+        Batallion attacker;
+        int battles;
+        int seed;
+    };
+
+    float cost(const QVector<int>& counts) const;
+    bool isDominatedByWinner(const QVector<int>& counts) const;
+    bool isDominatedByLoser(const QVector<int>& counts) const;
+    Batallion batallion(const QVector<int>& counts) const;
+    void evaluate(QList<Evaluation>& evaluations, int battles);
+
+    QList<QPair<Unit*, int> > _available;
+    Batallion _defender;
+    CombatSettings _settings;
+    int _ipcFactor;
+    float _target;
+    int _maximumResults;
+    int _maximumEvaluations;
+    int _evaluations;
+
+    QList<QVector<int> > _winners;
+    QList<QVector<int> > _losers;
+};
+
+#endif
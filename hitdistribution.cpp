@@ -0,0 +1,158 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "hitdistribution.h"
+
+#include <math.h>
+
+namespace {
+    const double EPSILON = 1e-15;
+    const int KEYBITS = 10; //< per target value, so up to 1023 dice each are memoized
+}
+
+HitDistribution::HitDistribution()
+    : _first(0)
+    , _probabilities(1, 1.0)
+{}
+
+HitDistribution::HitDistribution(const int dice[7])
+    : _first(dice[6])
+    , _probabilities(1, 1.0)
+{
+    // dice that hit on 6 always hit, the ones on 0 never
+    for (int target = 1; target <= 5; ++target) {
+        if (dice[target] == 0)
+            continue;
+        HitDistribution group;
+        group.binomial(dice[target], target);
+        convolve(group);
+    }
+}
+
+int HitDistribution::minimumHits() const {
+    return _first;
+}
+
+int HitDistribution::maximumHits() const {
+    return _first + _probabilities.size() - 1;
+}
+
+double HitDistribution::probability(int hits) const {
+    int i = hits - _first;
+    if ((i < 0) || (i >= _probabilities.size()))
+        return 0.0;
+    return _probabilities[i];
+}
+
+double HitDistribution::expectedHits() const {
+    double result = 0.0;
+    for (int i = 0; i < _probabilities.size(); ++i)
+        result += (_first + i) * _probabilities[i];
+    return result;
+}
+
+void HitDistribution::binomial(int dice, int target) {
+    // starts at the most likely number of hits, as the probabilities at the ends underflow for
+    // many dice, and walks outwards with the ratio of neighboring binomial coefficients
+    double p = target / 6.0;
+    int mode = qMin(dice, static_cast<int>(floor((dice + 1) * p)));
+    double peak = exp(lgamma(dice + 1.0) - lgamma(mode + 1.0) - lgamma(dice - mode + 1.0) +
+        mode * log(p) + (dice - mode) * log(1.0 - p));
+    double odds = p / (1.0 - p);
+
+    QVector<double> lower;
+    for (double q = peak, k = mode; k > 0; --k) {
+        q *= k / (dice - k + 1.0) / odds;
+        if (q < EPSILON)
+            break;
+        lower.append(q);
+    }
+
+    _first = mode - lower.size();
+    _probabilities.clear();
+    for (int i = lower.size() - 1; i >= 0; --i)
+        _probabilities.append(lower[i]);
+    _probabilities.append(peak);
+    for (double q = peak, k = mode; k < dice; ++k) {
+        q *= (dice - k) / (k + 1.0) * odds;
+        if (q < EPSILON)
+            break;
+        _probabilities.append(q);
+    }
+}
+
+void HitDistribution::convolve(const HitDistribution& other) {
+    QVector<double> result(_probabilities.size() + other._probabilities.size() - 1, 0.0);
+    for (int i = 0; i < _probabilities.size(); ++i) {
+        double p = _probabilities[i];
+        for (int j = 0; j < other._probabilities.size(); ++j)
+            result[i + j] += p * other._probabilities[j];
+    }
+    _first += other._first;
+    _probabilities = result;
+    trim();
+}
+
+void HitDistribution::trim() {
+    int begin = 0;
+    int end = _probabilities.size();
+    while ((end - begin > 1) && (_probabilities[begin] < EPSILON))
+        ++begin;
+    while ((end - begin > 1) && (_probabilities[end - 1] < EPSILON))
+        --end;
+    if ((begin > 0) || (end < _probabilities.size())) {
+        _probabilities = _probabilities.mid(begin, end - begin);
+        _first += begin;
+    }
+}
+
+HitKernel::HitKernel() {}
+
+const HitDistribution& HitKernel::distribution(const int dice[7]) {
+    quint64 key = 0;
+    for (int target = 1; target <= 6; ++target) {
+        if (dice[target] >= (1 << KEYBITS)) {
+            _uncached = HitDistribution(dice);
+            return _uncached;
+        }
+        key = (key << KEYBITS) | static_cast<quint64>(dice[target]);
+    }
+
+    if (!_distributions.contains(key))
+        _distributions.insert(key, HitDistribution(dice));
+    return _distributions[key];
+}
+
+const HitDistribution& HitKernel::distribution(const Batallion& units, const CombatStep& step, bool isAmphibiousCombat) {
+    int dice[7];
+    countFireDice(units, step, isAmphibiousCombat, dice);
+    return distribution(dice);
+}
+
+int HitKernel::size() const {
+    return _distributions.size();
+}
+
+void HitKernel::clear() {
+    _distributions.clear();
+}
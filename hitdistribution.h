@@ -0,0 +1,75 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_HITDISTRIBUTION_H
+#define BOCK_HITDISTRIBUTION_H
+
+#include "combatthread.h"
+#include <QHash>
+#include <QVector>
+
+// Exact distribution of the number of hits of a fire step. The dice that hit on the same value
+// follow a binomial distribution, and the distribution of all hits is the product of the
+// generating functions of these binomials, whose coefficients are convolved. The probabilities
+// at both ends that are below 1e-15 are dropped, so a salvo of a few hundred dice only keeps the
+// few dozen hit counts that can actually happen
+class HitDistribution {
+public:
+    HitDistribution(); //< no dice, so no hits
+    explicit HitDistribution(const int dice[7]); //< 'dice[t]' dice that hit on t or less
+
+    int minimumHits() const; //< with a probability that was kept
+    int maximumHits() const;
+    double probability(int hits) const;
+    double expectedHits() const;
+
+private:
+    void binomial(int dice, int target); //< replaces the distribution
+    void convolve(const HitDistribution& other);
+    void trim();
+
+    int _first; //< hits of the first probability
+    QVector<double> _probabilities;
+};
+
+// Hit distributions of fire steps, memoized by the dice per target value. In an exact or hybrid
+// odds calculation the same compositions fire in many states of the battle, so each distribution
+// is computed only once. Not thread safe; every thread needs its own kernel
+class HitKernel {
+public:
+    HitKernel();
+
+    // the distribution stays valid until the next call
+    const HitDistribution& distribution(const int dice[7]);
+    // of 'units' firing in 'step' at the beginning of a round
+    const HitDistribution& distribution(const Batallion& units, const CombatStep& step, bool isAmphibiousCombat);
+
+    int size() const; //< number of memoized distributions
+    void clear();
+
+private:
+    QHash<quint64, HitDistribution> _distributions;
+    HitDistribution _uncached; //< for more dice per target than fit into a key
+};
+
+#endif
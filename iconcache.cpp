@@ -0,0 +1,146 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "iconcache.h"
+
+#include <QCoreApplication>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+namespace {
+    const int DEFAULTMEMORYLIMIT = 16 * 1024; // in kilobytes
+
+    QImage loadImage(const QString& fileName, int width) {
+        QImage image(fileName);
+        if (!image.isNull() && (width > 0))
+            image = image.scaledToWidth(width);
+        return image;
+    }
+}
+
+IconCache* IconCache::instance() {
+    // owned by the application, so that the pixmaps are released before the application is gone
+    static IconCache* cache = new IconCache;
+    return cache;
+}
+
+IconCache::IconCache()
+    : QObject(QCoreApplication::instance())
+    , _generation(0)
+{
+    _pixmaps.setMaxCost(DEFAULTMEMORYLIMIT);
+}
+
+QString IconCache::key(const QString& map, const QString& faction, const QString& unit, int width) {
+    return map + "/" + faction + "/" + unit + "@" + QString::number(width);
+}
+
+QString IconCache::fileName(const QString& map, const QString& faction, const QString& unit) {
+    return map + "/" + faction + "/" + unit + ".png";
+}
+
+QPixmap IconCache::pixmap(const QString& map, const QString& faction, const QString& unit, int width) {
+    const QString& k = key(map, faction, unit, width);
+
+    if (_missing.contains(k))
+        return QPixmap();
+
+    if (QPixmap* pm = _pixmaps.object(k))
+        return *pm;
+
+    // a prefetch of this picture is still running, so wait for it instead of loading it twice
+    if (_pending.contains(k))
+        return insert(k, _pending.take(k).future.result());
+
+    return insert(k, loadImage(fileName(map, faction, unit), width));
+}
+
+void IconCache::prefetch(const QString& map, const QString& faction, const QStringList& units, int width) {
+    foreach (const QString& unit, units) {
+        const QString& k = key(map, faction, unit, width);
+        if (_missing.contains(k) || _pixmaps.contains(k) || _pending.contains(k))
+            continue;
+
+        Prefetch prefetch;
+        prefetch.key = k;
+        prefetch.generation = _generation;
+        prefetch.future = QtConcurrent::run(loadImage, fileName(map, faction, unit), width);
+        QFutureWatcher<QImage>* watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, SIGNAL(finished()), this, SLOT(imageLoaded()));
+        watcher->setFuture(prefetch.future);
+        _pending.insert(k, prefetch);
+        _watchers.insert(watcher, prefetch);
+    }
+}
+
+void IconCache::imageLoaded() {
+    QFutureWatcher<QImage>* watcher = static_cast<QFutureWatcher<QImage>*>(QObject::sender());
+    const Prefetch& prefetch = _watchers.take(watcher);
+    // the picture might have been requested (and inserted) in the meantime, or its map might have
+    // been removed and prefetched again since
+    QHash<QString, Prefetch>::iterator it = _pending.find(prefetch.key);
+    if ((it != _pending.end()) && (it.value().generation == prefetch.generation)) {
+        _pending.erase(it);
+        insert(prefetch.key, watcher->result());
+    }
+    watcher->deleteLater();
+}
+
+QPixmap IconCache::insert(const QString& key, const QImage& image) {
+    if (image.isNull()) {
+        _missing.insert(key);
+        return QPixmap();
+    }
+
+    QPixmap* pm = new QPixmap(QPixmap::fromImage(image));
+    int cost = qMax(1, image.byteCount() / 1024);
+    QPixmap result = *pm;
+    _pixmaps.insert(key, pm, cost);
+    return result;
+}
+
+void IconCache::removeMap(const QString& map) {
+    ++_generation;
+    const QString& prefix = map + "/";
+    foreach (const QString& k, _pixmaps.keys()) {
+        if (k.startsWith(prefix))
+            _pixmaps.remove(k);
+    }
+    foreach (const QString& k, _missing.toList()) {
+        if (k.startsWith(prefix))
+            _missing.remove(k);
+    }
+    // the running prefetches still read the old files; their results are ignored
+    foreach (const QString& k, _pending.keys()) {
+        if (k.startsWith(prefix))
+            _pending.remove(k);
+    }
+}
+
+int IconCache::memoryLimit() const {
+    return _pixmaps.maxCost();
+}
+
+void IconCache::setMemoryLimit(int kilobytes) {
+    _pixmaps.setMaxCost(kilobytes);
+}
@@ -0,0 +1,79 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_ICONCACHE_H
+#define BOCK_ICONCACHE_H
+
+#include <QObject>
+
+#include <QCache>
+#include <QFuture>
+#include <QHash>
+#include <QImage>
+#include <QPixmap>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class QFutureWatcherBase;
+
+// Process-wide cache of the decoded unit pictures and faction flags, keyed by map, faction, unit
+// and width. Prefetched pictures are decoded in the thread pool instead of the GUI thread.
+// removeMap drops everything of a map whose files were downloaded again, including the results
+// of prefetches that are still running.
+class IconCache : public QObject {
+Q_OBJECT
+public:
+    static IconCache* instance();
+
+    QPixmap pixmap(const QString& map, const QString& faction, const QString& unit, int width = 0);
+    void prefetch(const QString& map, const QString& faction, const QStringList& units, int width = 0);
+    void removeMap(const QString& map);
+
+    int memoryLimit() const;
+    void setMemoryLimit(int kilobytes);
+
+private slots:
+    void imageLoaded();
+
+private:
+    IconCache();
+
+    static QString key(const QString& map, const QString& faction, const QString& unit, int width);
+    static QString fileName(const QString& map, const QString& faction, const QString& unit);
+    QPixmap insert(const QString& key, const QImage& image);
+
+    struct Prefetch {
+        QString key;
+        int generation; //< the cache's generation when the prefetch was started
+        QFuture<QImage> future;
+    };
+
+    QCache<QString, QPixmap> _pixmaps;
+    QSet<QString> _missing; //< pictures which do not exist on the disk
+    QHash<QString, Prefetch> _pending;
+    QHash<QFutureWatcherBase*, Prefetch> _watchers;
+    int _generation; //< increased by removeMap, so the prefetches of older files are ignored
+};
+
+#endif
@@ -0,0 +1,332 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "mapdownloader.h"
+
+#include <QCryptographicHash>
+#include <QDomDocument>
+#include <QDomElement>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+namespace {
+    const int MAXATTEMPTS = 3;
+    const QString PARTSUFFIX = ".part";
+    const QString VALIDATORSUFFIX = ".part.validator"; //< ETag or Last-Modified date of the '.part' file
+
+    QByteArray readValidator(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+        return file.readAll();
+    }
+
+    // the total size in the 'Content-Range: bytes */size' header of a 416 reply, -1 if unknown
+    qint64 totalSize(QNetworkReply* reply) {
+        QByteArray range = reply->rawHeader("Content-Range");
+        int slash = range.indexOf('/');
+        if (slash < 0)
+            return -1;
+        bool ok;
+        qint64 result = range.mid(slash + 1).trimmed().toLongLong(&ok);
+        return ok ? result : -1;
+    }
+}
+
+MapDownloader::MapDownloader(QNetworkAccessManager* manager, const QDir& mapsDirectory, QObject* parent)
+    : QObject(parent)
+    , _manager(manager)
+    , _mapsDirectory(mapsDirectory)
+    , _indexReply(0)
+    , _maximumConcurrentDownloads(4)
+    , _skippedFiles(0)
+    , _failed(false)
+{}
+
+MapDownloader::~MapDownloader() {
+    // the '.part' files are kept, so that the transfers can be resumed the next time
+    foreach (QNetworkReply* reply, _running.keys()) {
+        reply->disconnect(this);
+        reply->abort();
+    }
+    qDeleteAll(_files);
+}
+
+QByteArray MapDownloader::checksum(const QString& fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    while (!file.atEnd())
+        hash.addData(file.read(64 * 1024));
+    return hash.result().toHex();
+}
+
+bool MapDownloader::isRunning() const {
+    return (_indexReply != 0) || !_queue.isEmpty() || !_running.isEmpty();
+}
+
+int MapDownloader::maximumConcurrentDownloads() const {
+    return _maximumConcurrentDownloads;
+}
+
+void MapDownloader::setMaximumConcurrentDownloads(int downloads) {
+    _maximumConcurrentDownloads = qMax(1, downloads);
+}
+
+void MapDownloader::downloadMap(const QString& map, const QString& version, const QString& baseURL) {
+    if (isRunning())
+        return;
+
+    _map = map;
+    _version = version;
+    _baseURL = baseURL;
+    _skippedFiles = 0;
+    _failed = false;
+    _listedFiles.clear();
+
+    _indexReply = _manager->get(QNetworkRequest(QUrl(_baseURL + map + "/INDEX")));
+    connect(_indexReply, SIGNAL(finished()), this, SLOT(indexFinished()));
+}
+
+void MapDownloader::indexFinished() {
+    QNetworkReply* reply = _indexReply;
+    _indexReply = 0;
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        emit message("Could not download the index of '" + _map + "': " + reply->errorString());
+        emit finished(_map, false);
+        return;
+    }
+
+    QDomDocument doc("document");
+    QString errorMessage;
+    int errorLine;
+    if (!doc.setContent(reply->readAll(), &errorMessage, &errorLine)) {
+        emit message("XML Error in the index of '" + _map + "': " + errorMessage + " (line " + QString::number(errorLine) + ")");
+        emit finished(_map, false);
+        return;
+    }
+
+    QDir mapsDir = _mapsDirectory;
+    mapsDir.mkdir(_map);
+    mapsDir.cd(_map);
+    const QString& baseUrl = _baseURL + _map + "/";
+
+    QDomElement docElem = doc.documentElement();
+    QDomNodeList factions = docElem.childNodes();
+    for (int i = 0; i < factions.size(); ++i) {
+        const QDomElement& factionElem = factions.at(i).toElement();
+        if (factionElem.isNull())
+            continue;
+        const QString& factionName = factionElem.nodeName();
+        mapsDir.mkdir(factionName);
+        QDomNodeList files = factionElem.childNodes();
+        for (int j = 0; j < files.size(); ++j) {
+            const QDomElement& fileElem = files.at(j).toElement();
+            if (fileElem.isNull())
+                continue;
+            const QString& fileName = factionName + "/" + fileElem.nodeName() + ".png";
+            _listedFiles.insert(QDir::cleanPath(mapsDir.absoluteFilePath(fileName)));
+            addJob(baseUrl + fileName, mapsDir.absoluteFilePath(fileName), fileElem.attribute("md5").toLatin1());
+        }
+    }
+    const QString& xmlName = _map + ".xml";
+    _listedFiles.insert(QDir::cleanPath(mapsDir.absoluteFilePath(xmlName)));
+    addJob(baseUrl + xmlName, mapsDir.absoluteFilePath(xmlName), docElem.attribute("md5").toLatin1());
+
+    if (_skippedFiles > 0)
+        emit message(QString::number(_skippedFiles) + " files of '" + _map + "' are up to date");
+
+    startJobs();
+}
+
+void MapDownloader::addJob(const QString& url, const QString& target, const QByteArray& checksum) {
+    if (!checksum.isEmpty() && QFile::exists(target) && (MapDownloader::checksum(target) == checksum.toLower())) {
+        ++_skippedFiles;
+        return;
+    }
+
+    Job job;
+    job.url = QUrl(url);
+    job.target = target;
+    job.checksum = checksum.toLower();
+    job.attempts = 0;
+    _queue.enqueue(job);
+}
+
+void MapDownloader::startJobs() {
+    while (!_queue.isEmpty() && (_running.size() < _maximumConcurrentDownloads))
+        startJob(_queue.dequeue());
+
+    if (_queue.isEmpty() && _running.isEmpty())
+        finishMap();
+}
+
+void MapDownloader::startJob(const Job& job) {
+    QNetworkRequest request(job.url);
+    // resume an interrupted transfer. With If-Range the server sends the whole file instead if it
+    // changed since the '.part' file was started. Without a validator only the checksum could
+    // tell that the parts do not belong together, so without either the file starts over
+    qint64 partSize = QFileInfo(job.target + PARTSUFFIX).size();
+    if (partSize > 0) {
+        QByteArray validator = readValidator(job.target + VALIDATORSUFFIX);
+        if (!validator.isEmpty() || !job.checksum.isEmpty()) {
+            request.setRawHeader("Range", "bytes=" + QByteArray::number(partSize) + "-");
+            if (!validator.isEmpty())
+                request.setRawHeader("If-Range", validator);
+        }
+        else
+            removePartFile(job.target);
+    }
+
+    QNetworkReply* reply = _manager->get(request);
+    Job j = job;
+    ++j.attempts;
+    _running.insert(reply, j);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
+
+bool MapDownloader::openPartFile(QNetworkReply* reply) {
+    if (_files.contains(reply))
+        return true;
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QString& target = _running[reply].target;
+    QFile* file = new QFile(target + PARTSUFFIX);
+    // 206 means the server honored the range request, everything else starts from scratch
+    QIODevice::OpenMode mode = (status == 206) ? QIODevice::Append : (QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!file->open(mode)) {
+        delete file;
+        return false;
+    }
+    _files.insert(reply, file);
+
+    if (status != 206) {
+        // weak ETags cannot be used with If-Range
+        QByteArray validator = reply->rawHeader("ETag");
+        if (validator.isEmpty() || validator.startsWith("W/"))
+            validator = reply->rawHeader("Last-Modified");
+        QFile validatorFile(target + VALIDATORSUFFIX);
+        if (validator.isEmpty())
+            validatorFile.remove();
+        else if (validatorFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            validatorFile.write(validator);
+    }
+    return true;
+}
+
+void MapDownloader::removePartFile(const QString& target) {
+    QFile::remove(target + PARTSUFFIX);
+    QFile::remove(target + VALIDATORSUFFIX);
+}
+
+void MapDownloader::readyRead() {
+    QNetworkReply* reply = static_cast<QNetworkReply*>(QObject::sender());
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((status != 200) && (status != 206))
+        return;
+
+    if (!openPartFile(reply)) {
+        reply->abort();
+        return;
+    }
+    _files[reply]->write(reply->readAll());
+}
+
+void MapDownloader::replyFinished() {
+    QNetworkReply* reply = static_cast<QNetworkReply*>(QObject::sender());
+    reply->deleteLater();
+    Job job = _running.take(reply);
+    const QString& partName = job.target + PARTSUFFIX;
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((reply->error() == QNetworkReply::NoError) && ((status == 200) || (status == 206)) && openPartFile(reply))
+        _files[reply]->write(reply->readAll());
+
+    if (QFile* file = _files.take(reply)) {
+        file->close();
+        delete file;
+    }
+
+    bool complete = (reply->error() == QNetworkReply::NoError);
+    if (status == 416) {
+        // the range started at the end of the file, so the '.part' file might hold all of it. That
+        // is only trusted if the checksum or the size the server reports confirms it
+        complete = !job.checksum.isEmpty() || (totalSize(reply) == QFileInfo(partName).size());
+        if (!complete)
+            removePartFile(job.target);
+    }
+    if (complete && !job.checksum.isEmpty() && (checksum(partName) != job.checksum)) {
+        emit message("Checksum mismatch for " + job.target);
+        removePartFile(job.target);
+        complete = false;
+    }
+
+    if (complete) {
+        QFile::remove(job.target);
+        QFile::remove(job.target + VALIDATORSUFFIX);
+        QFile::rename(partName, job.target);
+        emit message("Downloaded " + job.target);
+    }
+    else if (job.attempts < MAXATTEMPTS) {
+        _queue.enqueue(job);
+    }
+    else {
+        emit message("Failed to download " + job.target + ": " + reply->errorString());
+        _failed = true;
+    }
+
+    startJobs();
+}
+
+void MapDownloader::removeUnlistedFiles(const QString& path) {
+    QDir dir(path);
+    foreach (const QFileInfo& info, dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden)) {
+        if (info.isDir()) {
+            removeUnlistedFiles(info.absoluteFilePath());
+            dir.rmdir(info.fileName()); //< only succeeds if nothing is left in it
+        }
+        else if (!_listedFiles.contains(QDir::cleanPath(info.absoluteFilePath()))) {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
+
+void MapDownloader::finishMap() {
+    if (!_failed) {
+        // images and '.part' files of an older version of the map would otherwise stay around for
+        // good. The VERSION file is not listed either and is written anew right after
+        removeUnlistedFiles(_mapsDirectory.absoluteFilePath(_map));
+        QFile versionFile(_mapsDirectory.absoluteFilePath(_map + "/VERSION"));
+        versionFile.open(QIODevice::WriteOnly);
+        versionFile.write(_version.toLocal8Bit());
+    }
+    emit finished(_map, !_failed);
+}
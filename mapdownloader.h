@@ -0,0 +1,105 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_MAPDOWNLOADER_H
+#define BOCK_MAPDOWNLOADER_H
+
+#include <QObject>
+
+#include <QByteArray>
+#include <QDir>
+#include <QHash>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QUrl>
+
+class QFile;
+class QNetworkAccessManager;
+class QNetworkReply;
+
+// Downloads (or updates) a map described by its INDEX file. The files are downloaded with a
+// bounded number of parallel requests and streamed into '<file>.part' files which are renamed
+// once the transfer is complete. An interrupted transfer is resumed from the '.part' file if the
+// server can tell that the file did not change since (If-Range with the ETag or Last-Modified
+// date the '.part' file was started with) or if a checksum verifies the result.
+// If the INDEX provides 'md5' attributes, the files are verified and files which are already
+// present with the correct checksum are not downloaded again. Once all files are there, the files
+// of the map's directory that the INDEX does not list anymore are removed.
+class MapDownloader : public QObject {
+Q_OBJECT
+public:
+    // the maps are stored in subdirectories of 'mapsDirectory'
+    MapDownloader(QNetworkAccessManager* manager, const QDir& mapsDirectory, QObject* parent = 0);
+    ~MapDownloader();
+
+    // downloads the files listed in '<baseURL><map>/INDEX'
+    void downloadMap(const QString& map, const QString& version, const QString& baseURL);
+    bool isRunning() const;
+
+    int maximumConcurrentDownloads() const;
+    void setMaximumConcurrentDownloads(int downloads);
+
+    static QByteArray checksum(const QString& fileName);
+
+signals:
+    void message(QString);
+    void finished(QString map, bool success);
+
+private slots:
+    void indexFinished();
+    void readyRead();
+    void replyFinished();
+
+private:
+    struct Job {
+        QUrl url;
+        QString target;
+        QByteArray checksum; //< expected md5 as hex string, empty if unknown
+        int attempts;
+    };
+
+    void addJob(const QString& url, const QString& target, const QByteArray& checksum);
+    void startJobs();
+    void startJob(const Job& job);
+    bool openPartFile(QNetworkReply* reply);
+    void removePartFile(const QString& target);
+    void removeUnlistedFiles(const QString& path);
+    void finishMap();
+
+    QNetworkAccessManager* _manager;
+    QDir _mapsDirectory;
+    QString _baseURL;
+    QString _map;
+    QString _version;
+    QNetworkReply* _indexReply;
+    QQueue<Job> _queue;
+    QHash<QNetworkReply*, Job> _running;
+    QHash<QNetworkReply*, QFile*> _files;
+    QSet<QString> _listedFiles; //< the files of the INDEX, with clean absolute paths
+    int _maximumConcurrentDownloads;
+    int _skippedFiles;
+    bool _failed;
+};
+
+#endif
@@ -0,0 +1,385 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "oddstable.h"
+
+#include "combatscheduler.h"
+#include <QtEndian>
+
+namespace {
+    const char MAGIC[4] = { 'A', 'A', 'O', 'T' };
+    const int ENTRYSIZE = 6 * sizeof(quint16);
+    const qint64 MAXBATTLES = 1 << 24;
+    // the odds are stored as fixed point numbers
+    const double PROBABILITYSCALE = 65535.0;
+    const double UNITSCALE = 256.0; //< up to 255 units per side
+    const double IPCSCALE = 16.0; //< up to 4095 times the ipc factor per side
+
+    enum Flag {
+        FlagAmphibiousCombat = 1 << 0,
+        FlagOrderOfLossIPC = 1 << 1
+    };
+
+    template <typename T>
+    void write(QByteArray& data, T value) {
+        int size = data.size();
+        data.resize(size + sizeof(T));
+        qToLittleEndian<T>(value, reinterpret_cast<uchar*>(data.data() + size));
+    }
+
+    // stops at the end of the data and remembers that it did
+    class HeaderReader {
+    public:
+        HeaderReader(const uchar* data, qint64 size)
+            : _data(data)
+            , _end(data + size)
+            , _isValid(true)
+        {}
+
+        template <typename T>
+        T read() {
+            if (_end - _data < static_cast<qint64>(sizeof(T))) {
+                _isValid = false;
+                _data = _end;
+                return 0;
+            }
+            T value = qFromLittleEndian<T>(_data);
+            _data += sizeof(T);
+            return value;
+        }
+
+        QString readString() {
+            int size = read<quint16>();
+            if (_end - _data < size) {
+                _isValid = false;
+                _data = _end;
+                return QString();
+            }
+            QString result = QString::fromUtf8(reinterpret_cast<const char*>(_data), size);
+            _data += size;
+            return result;
+        }
+
+        const uchar* position() const { return _data; }
+        qint64 remaining() const { return _end - _data; }
+        bool isValid() const { return _isValid; }
+
+    private:
+        const uchar* _data;
+        const uchar* _end;
+        bool _isValid;
+    };
+
+    // stops counting above MAXBATTLES, so the product of two counts does not overflow
+    qint64 compositions(const QList<QPair<int, int> >& bounds) {
+        qint64 result = 1;
+        for (int i = 0; (i < bounds.size()) && (result <= MAXBATTLES); ++i)
+            result *= bounds[i].second + 1;
+        return result;
+    }
+
+    QList<QPair<int, int> > unitBounds(const QList<QPair<Unit*, int> >& bounds) {
+        QList<QPair<int, int> > result;
+        for (int i = 0; i < bounds.size(); ++i)
+            result.append(qMakePair(bounds[i].first->id(), bounds[i].second));
+        return result;
+    }
+
+    // the units of the composition 'index'; the first unit type is the lowest digit
+    Batallion batallion(const QList<QPair<Unit*, int> >& bounds, int index, int ipcFactor) {
+        Batallion result;
+        for (int i = 0; i < bounds.size(); ++i) {
+            int base = bounds[i].second + 1;
+            for (int j = 0; j < index % base; ++j)
+                result.append(UnitLite(bounds[i].first, ipcFactor));
+            index /= base;
+        }
+        return result;
+    }
+
+    void encode(const ExactOdds& odds, QByteArray& data) {
+        write<quint16>(data, qRound(odds.attackerWinProbability * PROBABILITYSCALE));
+        write<quint16>(data, qRound(odds.defenderWinProbability * PROBABILITYSCALE));
+        write<quint16>(data, qRound(odds.attackerUnitsLeft * UNITSCALE));
+        write<quint16>(data, qRound(odds.defenderUnitsLeft * UNITSCALE));
+        write<quint16>(data, qRound(odds.attackerIPCLoss * IPCSCALE));
+        write<quint16>(data, qRound(odds.defenderIPCLoss * IPCSCALE));
+    }
+
+    ExactOdds decode(const uchar* data) {
+        ExactOdds result;
+        result.attackerWinProbability = qFromLittleEndian<quint16>(data) / PROBABILITYSCALE;
+        result.defenderWinProbability = qFromLittleEndian<quint16>(data + 2) / PROBABILITYSCALE;
+        result.drawProbability = qMax(0.0, 1.0 - result.attackerWinProbability - result.defenderWinProbability);
+        result.attackerUnitsLeft = qFromLittleEndian<quint16>(data + 4) / UNITSCALE;
+        result.defenderUnitsLeft = qFromLittleEndian<quint16>(data + 6) / UNITSCALE;
+        result.attackerIPCLoss = qFromLittleEndian<quint16>(data + 8) / IPCSCALE;
+        result.defenderIPCLoss = qFromLittleEndian<quint16>(data + 10) / IPCSCALE;
+        return result;
+    }
+}
+
+struct ComputeOdds {
+    typedef void result_type;
+
+    struct Chunk {
+        int first; //< attacker composition
+        int count;
+        QByteArray entries;
+    };
+
+    ComputeOdds(const QList<QPair<Unit*, int> >& attackerBounds, const QVector<Batallion>& defenders, int ipcFactor,
+                const CombatSettings& settings)
+        : attackerBounds(attackerBounds)
+        , defenders(defenders)
+        , ipcFactor(ipcFactor)
+        , settings(settings)
+    {}
+
+    void operator()(Chunk& chunk) {
+        ExactOddsSolver solver;
+        chunk.entries.reserve(chunk.count * defenders.size() * ENTRYSIZE);
+        for (int i = chunk.first; i < chunk.first + chunk.count; ++i) {
+            Batallion attacker = batallion(attackerBounds, i, ipcFactor);
+            foreach (const Batallion& defender, defenders) {
+                ExactOdds odds;
+                solver.solve(attacker, defender, settings, odds);
+                encode(odds, chunk.entries);
+            }
+        }
+    }
+
+    const QList<QPair<Unit*, int> >& attackerBounds;
+    const QVector<Batallion>& defenders;
+    int ipcFactor;
+    const CombatSettings& settings;
+};
+
+OddsTable::OddsTable(const QString& fileName)
+    : _file(fileName)
+    , _data(0)
+    , _isAmphibiousCombat(false)
+    , _orderOfLoss(OrderOfLossValue)
+    , _entries(0)
+{
+    _compositions[0] = 0;
+    _compositions[1] = 0;
+}
+
+OddsTable::~OddsTable() {
+    close();
+}
+
+bool OddsTable::open() {
+    close();
+    if (!_file.open(QIODevice::ReadOnly)) {
+        _errorString = _file.errorString();
+        return false;
+    }
+    _data = _file.map(0, _file.size());
+    if (!_data) {
+        _errorString = _file.errorString();
+        close();
+        return false;
+    }
+    if (!readHeader()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void OddsTable::close() {
+    if (_data)
+        _file.unmap(_data);
+    _data = 0;
+    _entries = 0;
+    _file.close();
+}
+
+bool OddsTable::isOpen() const {
+    return _entries != 0;
+}
+
+QString OddsTable::fileName() const {
+    return _file.fileName();
+}
+
+const QString& OddsTable::errorString() const {
+    return _errorString;
+}
+
+QString OddsTable::mapVersion() const {
+    return _mapVersion;
+}
+
+int OddsTable::battles() const {
+    return isOpen() ? _compositions[0] * _compositions[1] : 0;
+}
+
+bool OddsTable::lookup(const QList<QPair<int, int> >& attacker, const QList<QPair<int, int> >& defender, const CombatSettings& settings,
+                       ExactOdds& result) const
+{
+    if (!isOpen() || !settings.isLandBattle || settings.landUnitMustLive || (settings.maxRounds > 0) ||
+        (settings.isAmphibiousCombat != _isAmphibiousCombat) || (settings.orderOfLoss != _orderOfLoss))
+        return false;
+
+    int attackerIndex = composition(CombatStep::SideAttacker, attacker);
+    int defenderIndex = composition(CombatStep::SideDefender, defender);
+    if ((attackerIndex < 0) || (defenderIndex < 0))
+        return false;
+
+    result = decode(_entries + (static_cast<qint64>(attackerIndex) * _compositions[1] + defenderIndex) * ENTRYSIZE);
+    return true;
+}
+
+bool OddsTable::generate(const QString& fileName, const QString& mapVersion, const QList<QPair<Unit*, int> >& attackerBounds,
+                         const QList<QPair<Unit*, int> >& defenderBounds, int ipcFactor, const CombatSettings& settings, QString& error)
+{
+    const QList<QPair<Unit*, int> >* bounds[2] = { &attackerBounds, &defenderBounds };
+    qint64 count[2] = { compositions(unitBounds(attackerBounds)), compositions(unitBounds(defenderBounds)) };
+    if (count[0] * count[1] > MAXBATTLES) {
+        error = "There are more than " + QString::number(MAXBATTLES) + " battles within these bounds, which is the most a table can hold";
+        return false;
+    }
+
+    Batallion largest[2];
+    for (int side = 0; side < 2; ++side) {
+        largest[side] = batallion(*bounds[side], count[side] - 1, ipcFactor);
+        int ipc = 0;
+        foreach (const UnitLite& unit, largest[side])
+            ipc += unit.ipcValue();
+        if ((largest[side].size() * UNITSCALE > 65535) || (ipc * IPCSCALE > 65535)) {
+            error = "The table cannot store battles with that many units";
+            return false;
+        }
+    }
+    if (!ExactOddsSolver::isSupported(largest[0], largest[1], settings)) {
+        error = "The odds of these units cannot be computed exactly with the rules of the map";
+        return false;
+    }
+
+    QVector<Batallion> defenders;
+    for (int i = 0; i < count[1]; ++i)
+        defenders.append(batallion(defenderBounds, i, ipcFactor));
+
+    // every chunk encodes the entries of a range of attacker compositions, so the chunks are
+    // written one after the other
+    int nChunks = qMin<qint64>(CombatScheduler::instance()->threadCount() * 4, count[0]);
+    QList<ComputeOdds::Chunk> chunks;
+    int first = 0;
+    for (int i = 0; i < nChunks; ++i) {
+        ComputeOdds::Chunk chunk;
+        chunk.first = first;
+        chunk.count = count[0] / nChunks + ((i < count[0] % nChunks) ? 1 : 0);
+        first += chunk.count;
+        chunks.append(chunk);
+    }
+    blockingCombatMap(chunks, ComputeOdds(attackerBounds, defenders, ipcFactor, settings), CombatPriorityInteractive);
+
+    QByteArray header(MAGIC, sizeof(MAGIC));
+    write<quint16>(header, Version);
+    quint8 flags = 0;
+    if (settings.isAmphibiousCombat)
+        flags |= FlagAmphibiousCombat;
+    if (settings.orderOfLoss == OrderOfLossIPC)
+        flags |= FlagOrderOfLossIPC;
+    write<quint8>(header, flags);
+    write<quint8>(header, 0);
+    QByteArray version = mapVersion.toUtf8();
+    write<quint16>(header, version.size());
+    header.append(version.constData(), version.size());
+    for (int side = 0; side < 2; ++side) {
+        write<quint16>(header, bounds[side]->size());
+        for (int i = 0; i < bounds[side]->size(); ++i) {
+            write<quint16>(header, bounds[side]->at(i).first->id());
+            write<quint16>(header, bounds[side]->at(i).second);
+        }
+    }
+
+    QFile file(fileName);
+    bool success = file.open(QIODevice::WriteOnly) && (file.write(header) == header.size());
+    for (int i = 0; success && (i < chunks.size()); ++i)
+        success = (file.write(chunks[i].entries) == chunks[i].entries.size());
+    if (!success) {
+        error = file.errorString();
+        file.close();
+        file.remove();
+    }
+    return success;
+}
+
+bool OddsTable::readHeader() {
+    if ((_file.size() < static_cast<qint64>(sizeof(MAGIC))) || (memcmp(_data, MAGIC, sizeof(MAGIC)) != 0)) {
+        _errorString = _file.fileName() + " is no odds table";
+        return false;
+    }
+    HeaderReader reader(_data + sizeof(MAGIC), _file.size() - sizeof(MAGIC));
+    if (reader.read<quint16>() > Version) {
+        _errorString = _file.fileName() + " was written by a newer version of the simulator";
+        return false;
+    }
+
+    quint8 flags = reader.read<quint8>();
+    reader.read<quint8>();
+    _isAmphibiousCombat = (flags & FlagAmphibiousCombat) != 0;
+    _orderOfLoss = (flags & FlagOrderOfLossIPC) ? OrderOfLossIPC : OrderOfLossValue;
+    _mapVersion = reader.readString();
+
+    qint64 count[2];
+    for (int side = 0; side < 2; ++side) {
+        _bounds[side].clear();
+        int types = reader.read<quint16>();
+        for (int i = 0; (i < types) && reader.isValid(); ++i) {
+            int id = reader.read<quint16>();
+            int maximum = reader.read<quint16>();
+            _bounds[side].append(qMakePair(id, maximum));
+        }
+        count[side] = compositions(_bounds[side]);
+    }
+
+    if (!reader.isValid() || (count[0] * count[1] > MAXBATTLES) || (reader.remaining() < count[0] * count[1] * ENTRYSIZE)) {
+        _errorString = _file.fileName() + " is incomplete";
+        return false;
+    }
+    _compositions[0] = count[0];
+    _compositions[1] = count[1];
+    _entries = reader.position();
+    return true;
+}
+
+int OddsTable::composition(int side, const QList<QPair<int, int> >& units) const {
+    int result = 0;
+    for (int i = 0; i < units.size(); ++i) {
+        if (units[i].second == 0)
+            continue;
+        int stride = 1;
+        int k = 0;
+        while ((k < _bounds[side].size()) && (_bounds[side][k].first != units[i].first))
+            stride *= _bounds[side][k++].second + 1;
+        if ((k == _bounds[side].size()) || (units[i].second > _bounds[side][k].second))
+            return -1;
+        result += units[i].second * stride;
+    }
+    return result;
+}
@@ -0,0 +1,84 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_ODDSTABLE_H
+#define BOCK_ODDSTABLE_H
+
+#include "exactodds.h"
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class Unit;
+
+// Exact odds of every land battle between compositions of a few unit types of a map, computed
+// in advance. Every unit type has a maximum count per side, and the compositions within these
+// bounds are numbered like the digits of a number whose digit k has the base 'maximum k + 1',
+// so the odds of a battle are found with one multiplication per unit type. The file starts with
+// a magic number, the format version, the settings and the map version the odds were computed
+// for and the unit types of both sides with their bounds, followed by 12 bytes per battle. All
+// numbers are little endian. The file is memory mapped, so opening it reads only the header
+class OddsTable {
+public:
+    enum { Version = 1 };
+
+    OddsTable(const QString& fileName);
+    ~OddsTable();
+
+    bool open(); //< read only
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+    const QString& errorString() const;
+
+    QString mapVersion() const;
+    int battles() const;
+
+    // 'attacker' and 'defender' are unit ids and counts; returns false if the settings are not
+    // the ones of the table or a unit type or count is not covered by it
+    bool lookup(const QList<QPair<int, int> >& attacker, const QList<QPair<int, int> >& defender, const CombatSettings& settings,
+        ExactOdds& result) const;
+
+    // computes the odds of all compositions of the unit types up to their maximum counts and
+    // writes them to 'fileName'. Returns false and sets 'error' if the battles cannot be computed
+    // exactly, there are too many of them or the file cannot be written
+    static bool generate(const QString& fileName, const QString& mapVersion, const QList<QPair<Unit*, int> >& attackerBounds,
+        const QList<QPair<Unit*, int> >& defenderBounds, int ipcFactor, const CombatSettings& settings, QString& error);
+
+private:
+    bool readHeader();
+    int composition(int side, const QList<QPair<int, int> >& units) const; //< -1 if not covered
+
+    QFile _file;
+    uchar* _data;
+    QString _errorString;
+    QString _mapVersion;
+    bool _isAmphibiousCombat;
+    OrderOfLoss _orderOfLoss;
+    QList<QPair<int, int> > _bounds[2]; //< per CombatStep::Side, unit id and maximum count
+    int _compositions[2];
+    const uchar* _entries;
+};
+
+#endif
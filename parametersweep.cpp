@@ -0,0 +1,242 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "parametersweep.h"
+
+#include "combatscheduler.h"
+
+#include <QMetaObject>
+
+namespace {
+    const int FIRSTPASSBATTLES = 200;
+    const int PASSES = 4;      //< every following pass uses four times as many battles
+    const int BATCHBATTLES = 800; //< larger cells are split, so that interactive jobs are not held up
+    const float CONTOUR = 0.5f;
+
+    struct RunJob {
+        void operator()(ParameterSweep::Job& job) {
+            job.result = simulateCombat(job.attacker, job.defender, job.settings, job.battles, job.seed);
+        }
+    };
+}
+
+class SweepPass : public CombatMapJob<ParameterSweep::Job, RunJob> {
+public:
+    SweepPass(ParameterSweep* sweep, QList<ParameterSweep::Job>& jobs, int generation)
+        : CombatMapJob<ParameterSweep::Job, RunJob>(jobs, RunJob(), CombatPriorityBackground)
+        , _sweep(sweep)
+        , _generation(generation)
+    {}
+
+    ~SweepPass() {
+        cancel();
+        waitForFinished();
+    }
+
+protected:
+    void runBatch(int batch) {
+        CombatMapJob<ParameterSweep::Job, RunJob>::runBatch(batch);
+        QMetaObject::invokeMethod(_sweep, "resultReady", Qt::QueuedConnection, Q_ARG(int, _generation), Q_ARG(int, batch));
+    }
+
+    void finished() {
+        QMetaObject::invokeMethod(_sweep, "passFinished", Qt::QueuedConnection, Q_ARG(int, _generation));
+    }
+
+private:
+    ParameterSweep* _sweep;
+    int _generation;
+};
+
+SweepCell::SweepCell()
+    : attackerCount(0)
+    , defenderCount(0)
+{}
+
+ParameterSweep::ParameterSweep(QObject* parent)
+    : QObject(parent)
+    , _attackerUnit(0)
+    , _defenderUnit(0)
+    , _ipcFactor(1)
+    , _attackerMin(0)
+    , _defenderMin(0)
+    , _columns(0)
+    , _rows(0)
+    , _pass(0)
+    , _stopped(true)
+    , _passJob(0)
+    , _generation(0)
+{}
+
+ParameterSweep::~ParameterSweep() {
+    stop();
+}
+
+void ParameterSweep::start(const Batallion& attacker, const Unit* attackerUnit, int attackerMin, int attackerMax,
+                           const Batallion& defender, const Unit* defenderUnit, int defenderMin, int defenderMax,
+                           const CombatSettings& settings, int ipcFactor)
+{
+    stop();
+
+    _attacker = attacker;
+    _defender = defender;
+    _attackerUnit = attackerUnit;
+    _defenderUnit = defenderUnit;
+    _settings = settings;
+    _ipcFactor = ipcFactor;
+    _attackerMin = attackerMin;
+    _defenderMin = defenderMin;
+    _columns = qMax(0, attackerMax - attackerMin + 1);
+    _rows = qMax(0, defenderMax - defenderMin + 1);
+
+    _cells.clear();
+    _cells.resize(_columns * _rows);
+    for (int row = 0; row < _rows; ++row) {
+        for (int column = 0; column < _columns; ++column) {
+            SweepCell& c = _cells[row * _columns + column];
+            c.attackerCount = attackerMin + column;
+            c.defenderCount = defenderMin + row;
+        }
+    }
+
+    _pass = 0;
+    _stopped = false;
+    startPass();
+}
+
+void ParameterSweep::stop() {
+    _stopped = true;
+    ++_generation;
+    if (_passJob) {
+        _passJob->cancel();
+        _passJob->waitForFinished();
+        delete _passJob;
+        _passJob = 0;
+    }
+}
+
+bool ParameterSweep::isRunning() const {
+    return !_stopped;
+}
+
+int ParameterSweep::columns() const {
+    return _columns;
+}
+
+int ParameterSweep::rows() const {
+    return _rows;
+}
+
+const SweepCell& ParameterSweep::cell(int column, int row) const {
+    return _cells[row * _columns + column];
+}
+
+int ParameterSweep::pass() const {
+    return _pass;
+}
+
+bool ParameterSweep::needsRefinement(int column, int row) const {
+    const CombatStatistics& s = cell(column, row).statistics;
+    float lower, upper;
+    s.attackerWinInterval(lower, upper);
+    if ((lower <= CONTOUR) && (upper >= CONTOUR))
+        return true;
+
+    // the contour passes between this cell and one of its neighbors
+    bool isAbove = s.attackerWinProbability() > CONTOUR;
+    const int neighbors[4][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+    for (int i = 0; i < 4; ++i) {
+        int c = column + neighbors[i][0];
+        int r = row + neighbors[i][1];
+        if ((c < 0) || (c >= _columns) || (r < 0) || (r >= _rows))
+            continue;
+        if ((cell(c, r).statistics.attackerWinProbability() > CONTOUR) != isAbove)
+            return true;
+    }
+    return false;
+}
+
+void ParameterSweep::startPass() {
+    int battles = FIRSTPASSBATTLES;
+    for (int i = 0; i < _pass; ++i)
+        battles *= 4;
+
+    _jobs.clear();
+    for (int row = 0; row < _rows; ++row) {
+        for (int column = 0; column < _columns; ++column) {
+            if ((_pass > 0) && !needsRefinement(column, row))
+                continue;
+
+            const SweepCell& c = cell(column, row);
+            Job job;
+            job.cell = row * _columns + column;
+            job.attacker = _attacker;
+            for (int i = 0; i < c.attackerCount; ++i)
+                job.attacker.append(UnitLite(_attackerUnit, _ipcFactor));
+            job.defender = _defender;
+            for (int i = 0; i < c.defenderCount; ++i)
+                job.defender.append(UnitLite(_defenderUnit, _ipcFactor));
+            job.settings = _settings;
+            for (int remaining = battles; remaining > 0; remaining -= BATCHBATTLES) {
+                job.battles = qMin(remaining, BATCHBATTLES);
+                job.seed = qrand();
+                _jobs.append(job);
+            }
+        }
+    }
+
+    if (_jobs.isEmpty()) {
+        _stopped = true;
+        emit finished();
+        return;
+    }
+    _passJob = new SweepPass(this, _jobs, _generation);
+    _passJob->start();
+}
+
+void ParameterSweep::resultReady(int generation, int index) {
+    if (generation != _generation)
+        return;
+
+    const Job& job = _jobs.at(index);
+    SweepCell& c = _cells[job.cell];
+    c.statistics.merge(job.result);
+    emit cellUpdated(job.cell % _columns, job.cell / _columns);
+}
+
+void ParameterSweep::passFinished(int generation) {
+    if ((generation != _generation) || _stopped)
+        return;
+
+    _passJob->waitForFinished();
+    delete _passJob;
+    _passJob = 0;
+
+    ++_pass;
+    if (_pass < PASSES)
+        startPass();
+    else {
+        _stopped = true;
+        emit finished();
+    }
+}
@@ -0,0 +1,105 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_PARAMETERSWEEP_H
+#define BOCK_PARAMETERSWEEP_H
+
+#include <QObject>
+
+#include "combatthread.h"
+#include <QList>
+#include <QVector>
+
+class SweepPass;
+
+struct SweepCell {
+    SweepCell();
+
+    int attackerCount;
+    int defenderCount;
+    CombatStatistics statistics;
+};
+
+// Evaluates a battle over a grid of unit counts for one attacking and one defending unit type.
+// All cells get a few battles first; further passes spend more battles only on the cells close
+// to the 50% contour. The cells are simulated in parallel and reported as they are finished.
+class ParameterSweep : public QObject {
+Q_OBJECT
+public:
+    struct Job {
+        int cell;
+        Batallion attacker;
+        Batallion defender;
+        CombatSettings settings;
+        int battles;
+        int seed;
+        CombatStatistics result;
+    };
+
+    ParameterSweep(QObject* parent = 0);
+    ~ParameterSweep();
+
+    void start(const Batallion& attacker, const Unit* attackerUnit, int attackerMin, int attackerMax,
+        const Batallion& defender, const Unit* defenderUnit, int defenderMin, int defenderMax,
+        const CombatSettings& settings, int ipcFactor);
+    void stop();
+    bool isRunning() const;
+
+    int columns() const; //< number of different attacker counts
+    int rows() const;    //< number of different defender counts
+    const SweepCell& cell(int column, int row) const;
+    int pass() const;
+
+signals:
+    void cellUpdated(int column, int row);
+    void finished();
+
+private slots:
+    // invoked from the scheduler threads; 'generation' identifies the pass that sent them
+    void resultReady(int generation, int index);
+    void passFinished(int generation);
+
+private:
+    void startPass();
+    bool needsRefinement(int column, int row) const;
+
+    Batallion _attacker;
+    Batallion _defender;
+    const Unit* _attackerUnit;
+    const Unit* _defenderUnit;
+    CombatSettings _settings;
+    int _ipcFactor;
+    int _attackerMin;
+    int _defenderMin;
+    int _columns;
+    int _rows;
+    int _pass;
+    bool _stopped;
+
+    QVector<SweepCell> _cells;
+    QList<Job> _jobs;
+    SweepPass* _passJob;
+    int _generation;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "quasirandom.h"
+
+#include <math.h>
+
+namespace {
+    // degree, coefficients and initial direction numbers m_1..m_degree of the primitive
+    // polynomials of the dimensions 2 to 21 (new-joe-kuo-6.21201)
+    struct Polynomial {
+        int degree;
+        quint32 coefficients;
+        quint32 m[7];
+    };
+
+    const Polynomial polynomials[SobolSequence::Dimensions - 1] = {
+        { 1,  0, { 1 } },
+        { 2,  1, { 1, 3 } },
+        { 3,  1, { 1, 3, 1 } },
+        { 3,  2, { 1, 1, 1 } },
+        { 4,  1, { 1, 1, 3, 3 } },
+        { 4,  4, { 1, 3, 5, 13 } },
+        { 5,  2, { 1, 1, 5, 5, 17 } },
+        { 5,  4, { 1, 1, 5, 5, 5 } },
+        { 5,  7, { 1, 1, 7, 11, 19 } },
+        { 5, 11, { 1, 1, 5, 1, 1 } },
+        { 5, 13, { 1, 1, 1, 3, 11 } },
+        { 5, 14, { 1, 3, 5, 5, 31 } },
+        { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+        { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+        { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+        { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+        { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+        { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+        { 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+        { 7,  4, { 1, 3, 7, 13, 13, 15, 69 } }
+    };
+
+    int parity(quint32 value) {
+        value ^= value >> 16;
+        value ^= value >> 8;
+        value ^= value >> 4;
+        value ^= value >> 2;
+        value ^= value >> 1;
+        return static_cast<int>(value & 1);
+    }
+
+    const int MISSTABLESIZE = 64;
+
+    // probability that none of 'dice' dice hits on 'target' or less
+    struct MissTable {
+        MissTable() {
+            for (int target = 0; target < 6; ++target) {
+                for (int dice = 0; dice < MISSTABLESIZE; ++dice)
+                    probability[target][dice] = pow(1.0 - target / 6.0, dice);
+            }
+        }
+
+        double operator()(int dice, int target) const {
+            if (dice < MISSTABLESIZE)
+                return probability[target][dice];
+            return pow(1.0 - target / 6.0, dice);
+        }
+
+        double probability[6][MISSTABLESIZE];
+    };
+
+    int trailingZeros(quint32 value) {
+        int result = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            ++result;
+        }
+        return result;
+    }
+}
+
+SobolSequence::SobolSequence() {
+    // the first dimension is the van der Corput sequence
+    for (int i = 0; i < 32; ++i)
+        _directions[0][i] = 1u << (31 - i);
+    _shift[0] = 0;
+
+    for (int d = 1; d < Dimensions; ++d) {
+        const Polynomial& p = polynomials[d - 1];
+        quint32* v = _directions[d];
+        for (int i = 0; i < p.degree; ++i)
+            v[i] = p.m[i] << (31 - i);
+        for (int i = p.degree; i < 32; ++i) {
+            v[i] = v[i - p.degree] ^ (v[i - p.degree] >> p.degree);
+            for (int k = 1; k < p.degree; ++k) {
+                if ((p.coefficients >> (p.degree - 1 - k)) & 1)
+                    v[i] ^= v[i - k];
+            }
+        }
+        _shift[d] = 0;
+    }
+}
+
+void SobolSequence::scramble(quint32 seed) {
+    DiceGenerator random(seed);
+    for (int d = 0; d < Dimensions; ++d) {
+        // lower triangular matrix with a unit diagonal; row i determines the i-th most significant bit
+        quint32 rows[32];
+        for (int i = 0; i < 32; ++i) {
+            quint32 diagonal = 1u << (31 - i);
+            quint32 above = (i == 0) ? 0u : (random.next() & ~(diagonal | (diagonal - 1)));
+            rows[i] = diagonal | above;
+        }
+        for (int j = 0; j < 32; ++j) {
+            quint32 scrambled = 0;
+            for (int i = 0; i < 32; ++i)
+                scrambled |= static_cast<quint32>(parity(rows[i] & _directions[d][j])) << (31 - i);
+            _directions[d][j] = scrambled;
+        }
+        _shift[d] = random.next();
+    }
+}
+
+void SobolSequence::point(int index, quint32* coordinates) const {
+    // points are enumerated in Gray code order
+    quint32 gray = static_cast<quint32>(index) ^ (static_cast<quint32>(index) >> 1);
+    for (int d = 0; d < Dimensions; ++d) {
+        quint32 x = _shift[d];
+        for (int i = 0; i < 32; ++i) {
+            if ((gray >> i) & 1)
+                x ^= _directions[d][i];
+        }
+        coordinates[d] = x;
+    }
+}
+
+void SobolSequence::next(int index, quint32* coordinates) const {
+    int bit = trailingZeros(static_cast<quint32>(index));
+    for (int d = 0; d < Dimensions; ++d)
+        coordinates[d] ^= _directions[d][bit];
+}
+
+QuasiRandomDice::QuasiRandomDice(const SobolSequence& sequence, int first, quint32 seed)
+    : _sequence(sequence)
+    , _random(seed)
+    , _index(first)
+    , _dimension(0)
+{
+    _sequence.point(_index, _point);
+}
+
+int QuasiRandomDice::hits(int dice, int target) {
+    if ((dice == 0) || (target <= 0))
+        return 0;
+    if (target >= 6)
+        return dice;
+
+    static const MissTable miss;
+    double probability = miss(dice, target);
+
+    // for a few hundred dice the probability of no hit at all underflows, and the inversion
+    // starting from it would turn every coordinate into a hit of all dice
+    if ((_dimension >= SobolSequence::Dimensions) || (probability == 0.0)) {
+        _dimension = qMin(_dimension + 1, static_cast<int>(SobolSequence::Dimensions));
+        int result = 0;
+        for (int i = 0; i < dice; ++i) {
+            if (_random.roll() <= target)
+                ++result;
+        }
+        return result;
+    }
+
+    double u = _point[_dimension++] / 4294967296.0;
+    double odds = target / (6.0 - target);
+    double cumulative = probability;
+    int result = 0;
+    while ((u >= cumulative) && (result < dice)) {
+        probability *= (dice - result) / (result + 1.0) * odds;
+        ++result;
+        cumulative += probability;
+    }
+    return result;
+}
+
+void QuasiRandomDice::nextBattle() {
+    ++_index;
+    _sequence.next(_index, _point);
+    _dimension = 0;
+}
@@ -0,0 +1,84 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_QUASIRANDOM_H
+#define BOCK_QUASIRANDOM_H
+
+#include "dicegenerator.h"
+
+enum SamplingMode {
+    SamplingModePseudoRandom,
+    SamplingModeQuasiRandom
+};
+
+// Scrambled Sobol sequence. Each point provides the dice of one battle, so the dice of the first
+// rounds are spread evenly over all possible outcomes instead of being drawn independently. The direction numbers are the ones of Joe and Kuo;
+// every scrambled copy is an independent randomization of the same sequence, so the spread of
+// the results of several copies estimates the error of their mean
+class SobolSequence {
+public:
+    enum { Dimensions = 21 };
+
+    SobolSequence();
+
+    // random linear matrix scrambling and digital shift
+    void scramble(quint32 seed);
+
+    // writes the point 'index' to 'coordinates'
+    void point(int index, quint32* coordinates) const;
+    // turns the point 'index - 1' into the point 'index' in place
+    void next(int index, quint32* coordinates) const;
+
+private:
+    quint32 _directions[Dimensions][32];
+    quint32 _shift[Dimensions];
+};
+
+// Dice of consecutive battles taken from consecutive points of a SobolSequence, one coordinate
+// per call of roll or hits. Once the coordinates of a point are used up, the dice are rolled with
+// a DiceGenerator seeded with 'seed'
+class QuasiRandomDice {
+public:
+    QuasiRandomDice(const SobolSequence& sequence, int first, quint32 seed);
+
+    void nextBattle(); //< moves on to the next point
+    int roll();
+    // number of hits of 'dice' dice that hit on 'target' or less, drawn from a single coordinate
+    // by inverting the binomial distribution
+    int hits(int dice, int target);
+
+private:
+    const SobolSequence& _sequence;
+    DiceGenerator _random;
+    int _index;
+    int _dimension;
+    quint32 _point[SobolSequence::Dimensions];
+};
+
+inline int QuasiRandomDice::roll() {
+    if (_dimension < SobolSequence::Dimensions)
+        return static_cast<int>((static_cast<quint64>(_point[_dimension++]) * 6) >> 32) + 1;
+    return _random.roll();
+}
+
+#endif
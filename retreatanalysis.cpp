@@ -0,0 +1,342 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "retreatanalysis.h"
+
+#include "combatscheduler.h"
+
+#include <algorithm>
+
+namespace {
+    struct Simulate {
+        typedef void result_type;
+
+        Simulate(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings)
+            : attacker(attacker)
+            , defender(defender)
+            , settings(settings)
+        {}
+
+        template <typename T>
+        void operator()(T& chunk) {
+            DiceGenerator seeds(chunk.seed);
+            for (int i = 0; i < chunk.battles; ++i) {
+                CombatThread combat(attacker, defender, settings, seeds.next());
+                combat.setRecordRounds(true);
+                combat.run();
+
+                const QList<CombatRound>& rounds = combat.rounds();
+                int previous = -1;
+                for (int j = 0; j < rounds.size(); ++j) {
+                    const CombatRound& round = rounds[j];
+                    int key = (round.attackerUnits << 16) | round.defenderUnits;
+                    typename T::StateType& state = chunk.states[key];
+                    state.attackerUnits = round.attackerUnits;
+                    state.defenderUnits = round.defenderUnits;
+                    ++state.visits;
+                    state.attackerIPCLoss += round.attackerIPCLoss;
+                    state.defenderIPCLoss += round.defenderIPCLoss;
+                    if (j == 0)
+                        ++state.initial;
+                    else
+                        ++chunk.states[previous].successors[key];
+                    previous = key;
+                }
+            }
+        }
+
+        const Batallion& attacker;
+        const Batallion& defender;
+        const CombatSettings& settings;
+    };
+
+    template <typename T>
+    bool lessThanUnits(const T& lhs, const T& rhs) {
+        return (lhs.attackerUnits + lhs.defenderUnits) < (rhs.attackerUnits + rhs.defenderUnits);
+    }
+}
+
+RetreatPolicyResult::RetreatPolicyResult()
+    : attackerWinProbability(0.f)
+    , retreatProbability(0.f)
+    , attackerIPCLoss(0.f)
+    , defenderIPCLoss(0.f)
+{}
+
+float RetreatPolicyResult::ipcTrade() const {
+    return defenderIPCLoss - attackerIPCLoss;
+}
+
+RetreatAnalysis::State::State()
+    : attackerUnits(0)
+    , defenderUnits(0)
+    , visits(0)
+    , initial(0)
+    , attackerIPCLoss(0)
+    , defenderIPCLoss(0)
+{}
+
+RetreatAnalysis::Value::Value()
+    : win(0.f)
+    , retreat(0.f)
+    , attackerLoss(0.f)
+    , defenderLoss(0.f)
+{}
+
+void RetreatAnalysis::Value::add(const Value& other, float weight) {
+    win += weight * other.win;
+    retreat += weight * other.retreat;
+    attackerLoss += weight * other.attackerLoss;
+    defenderLoss += weight * other.defenderLoss;
+}
+
+RetreatAnalysis::RetreatAnalysis(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int ipcFactor)
+    : _attacker(attacker)
+    , _defender(defender)
+    , _settings(settings)
+    , _ipcFactor(ipcFactor)
+    , _territoryValue(0.f)
+    , _battles(0)
+{}
+
+void RetreatAnalysis::setTerritoryValue(float value) {
+    _territoryValue = value;
+    computeOptimalPolicy();
+}
+
+void RetreatAnalysis::simulate(int battles) {
+    int nChunks = CombatScheduler::instance()->threadCount() * 4;
+    QList<Chunk> chunks;
+    for (int i = 0; i < nChunks; ++i) {
+        Chunk chunk;
+        chunk.battles = battles / nChunks + ((i < battles % nChunks) ? 1 : 0);
+        chunk.seed = qrand();
+        chunks.append(chunk);
+    }
+    blockingCombatMap(chunks, Simulate(_attacker, _defender, _settings), CombatPriorityInteractive);
+
+    QHash<int, State> states;
+    foreach (const Chunk& chunk, chunks) {
+        for (QHash<int, State>::const_iterator it = chunk.states.begin(); it != chunk.states.end(); ++it) {
+            const State& source = it.value();
+            State& target = states[it.key()];
+            target.attackerUnits = source.attackerUnits;
+            target.defenderUnits = source.defenderUnits;
+            target.visits += source.visits;
+            target.initial += source.initial;
+            target.attackerIPCLoss += source.attackerIPCLoss;
+            target.defenderIPCLoss += source.defenderIPCLoss;
+            for (QHash<int, int>::const_iterator s = source.successors.begin(); s != source.successors.end(); ++s)
+                target.successors[s.key()] += s.value();
+        }
+    }
+    _battles = battles;
+
+    // every round removes units, so successors always come before their predecessors
+    _states = states.values().toVector();
+    std::stable_sort(_states.begin(), _states.end(), lessThanUnits<State>);
+    _index.clear();
+    for (int i = 0; i < _states.size(); ++i)
+        _index.insert(key(_states[i].attackerUnits, _states[i].defenderUnits), i);
+
+    QVector<bool> neverRetreat(_states.size(), false);
+    evaluate(neverRetreat, &_fightToEnd);
+    computeOptimalPolicy();
+}
+
+int RetreatAnalysis::battles() const {
+    return _battles;
+}
+
+int RetreatAnalysis::maximumAttackerUnits() const {
+    int result = 0;
+    foreach (const State& state, _states) {
+        if (state.initial > 0)
+            result = qMax(result, state.attackerUnits);
+    }
+    return result;
+}
+
+RetreatPolicyResult RetreatAnalysis::fightToEnd() const {
+    return evaluate(QVector<bool>(_states.size(), false));
+}
+
+RetreatPolicyResult RetreatAnalysis::unitThresholdPolicy(int attackerUnits) const {
+    QVector<bool> retreat(_states.size(), false);
+    for (int i = 0; i < _states.size(); ++i)
+        retreat[i] = !isTerminal(_states[i]) && (_states[i].attackerUnits <= attackerUnits);
+    return evaluate(retreat);
+}
+
+RetreatPolicyResult RetreatAnalysis::oddsThresholdPolicy(float probability) const {
+    QVector<bool> retreat(_states.size(), false);
+    for (int i = 0; i < _states.size(); ++i)
+        retreat[i] = !isTerminal(_states[i]) && (_fightToEnd[i].win < probability);
+    return evaluate(retreat);
+}
+
+RetreatPolicyResult RetreatAnalysis::optimalPolicy() const {
+    return evaluate(_optimal);
+}
+
+bool RetreatAnalysis::isOptimalRetreat(int attackerUnits, int defenderUnits) const {
+    int i = _index.value(key(attackerUnits, defenderUnits), -1);
+    if (i == -1)
+        return false;
+    return _optimal[i];
+}
+
+int RetreatAnalysis::key(int attackerUnits, int defenderUnits) {
+    return (attackerUnits << 16) | defenderUnits;
+}
+
+bool RetreatAnalysis::isTerminal(const State& state) const {
+    return (state.attackerUnits == 0) || (state.defenderUnits == 0) || state.successors.isEmpty();
+}
+
+RetreatAnalysis::Value RetreatAnalysis::retreatValue(const State& state) const {
+    Value result;
+    result.retreat = 1.f;
+    result.attackerLoss = static_cast<float>(state.attackerIPCLoss) / state.visits;
+    result.defenderLoss = static_cast<float>(state.defenderIPCLoss) / state.visits;
+    return result;
+}
+
+RetreatAnalysis::Value RetreatAnalysis::terminalValue(const State& state) const {
+    Value result;
+    result.win = ((state.attackerUnits > 0) && (state.defenderUnits == 0)) ? 1.f : 0.f;
+    result.attackerLoss = static_cast<float>(state.attackerIPCLoss) / state.visits;
+    result.defenderLoss = static_cast<float>(state.defenderIPCLoss) / state.visits;
+    return result;
+}
+
+float RetreatAnalysis::score(const Value& value) const {
+    return (value.defenderLoss - value.attackerLoss) / _ipcFactor + value.win * _territoryValue;
+}
+
+RetreatAnalysis::Value RetreatAnalysis::leaveValue(int state, const QVector<Value>& values, float& pStay) const {
+    const State& s = _states[state];
+    int departures = 0;
+    int stay = 0;
+    for (QHash<int, int>::const_iterator it = s.successors.begin(); it != s.successors.end(); ++it) {
+        departures += it.value();
+        if (it.key() == key(s.attackerUnits, s.defenderUnits))
+            stay = it.value();
+    }
+
+    Value result;
+    for (QHash<int, int>::const_iterator it = s.successors.begin(); it != s.successors.end(); ++it) {
+        int j = _index.value(it.key());
+        if (j != state)
+            result.add(values[j], static_cast<float>(it.value()) / departures);
+    }
+    pStay = static_cast<float>(stay) / departures;
+    return result;
+}
+
+RetreatPolicyResult RetreatAnalysis::evaluate(const QVector<bool>& retreat, QVector<Value>* values) const {
+    QVector<Value> v(_states.size());
+    Value total;
+    int starts = 0;
+
+    for (int i = 0; i < _states.size(); ++i) {
+        const State& state = _states[i];
+        Value fight; //< value of fighting one more round and following the policy afterwards
+
+        if (isTerminal(state)) {
+            v[i] = terminalValue(state);
+            fight = v[i];
+        }
+        else {
+            float pStay;
+            fight = leaveValue(i, v, pStay);
+            if (retreat[i]) {
+                v[i] = retreatValue(state);
+                fight.add(v[i], pStay);
+            }
+            else {
+                if (pStay == 1.f) {
+                    // nobody ever scores a hit; the battle cannot be decided
+                    fight = retreatValue(state);
+                    fight.retreat = 0.f;
+                }
+                else {
+                    Value scaled;
+                    scaled.add(fight, 1.f / (1.f - pStay));
+                    fight = scaled;
+                }
+                v[i] = fight;
+            }
+        }
+
+        if (state.initial > 0) {
+            total.add(fight, static_cast<float>(state.initial));
+            starts += state.initial;
+        }
+    }
+
+    if (values)
+        *values = v;
+
+    RetreatPolicyResult result;
+    if (starts == 0)
+        return result;
+    result.attackerWinProbability = total.win / starts;
+    result.retreatProbability = total.retreat / starts;
+    result.attackerIPCLoss = total.attackerLoss / starts / _ipcFactor;
+    result.defenderIPCLoss = total.defenderLoss / starts / _ipcFactor;
+    return result;
+}
+
+void RetreatAnalysis::computeOptimalPolicy() {
+    // the same backwards pass as in evaluate, but choosing the better option in every state
+    _optimal.fill(false, _states.size());
+    QVector<Value> v(_states.size());
+
+    for (int i = 0; i < _states.size(); ++i) {
+        const State& state = _states[i];
+        if (isTerminal(state)) {
+            v[i] = terminalValue(state);
+            continue;
+        }
+
+        float pStay;
+        Value fight = leaveValue(i, v, pStay);
+
+        Value retreat = retreatValue(state);
+        if (pStay == 1.f) {
+            v[i] = retreat;
+            _optimal[i] = true;
+            continue;
+        }
+        Value scaled;
+        scaled.add(fight, 1.f / (1.f - pStay));
+
+        if (score(retreat) > score(scaled)) {
+            v[i] = retreat;
+            _optimal[i] = true;
+        }
+        else
+            v[i] = scaled;
+    }
+}
@@ -0,0 +1,123 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_RETREATANALYSIS_H
+#define BOCK_RETREATANALYSIS_H
+
+#include "combatthread.h"
+#include <QHash>
+#include <QVector>
+
+struct RetreatPolicyResult {
+    RetreatPolicyResult();
+
+    float ipcTrade() const; //< defender loss - attacker loss
+
+    float attackerWinProbability;
+    float retreatProbability;
+    float attackerIPCLoss;
+    float defenderIPCLoss;
+};
+
+// Evaluates retreat policies for the attacker. The battles are simulated only once while the
+// number of units left on both sides is recorded after every round. The recorded transitions
+// between these states form an empirical Markov chain on which every policy is evaluated with
+// a single backwards pass over the states, instead of simulating each policy again. The
+// attacker can retreat at the end of each round, but not before the first round
+class RetreatAnalysis {
+public:
+    RetreatAnalysis(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int ipcFactor);
+
+    // IPC value of conquering the territory, added to the trade when optimizing the policy
+    void setTerritoryValue(float value);
+
+    void simulate(int battles);
+    int battles() const;
+    int maximumAttackerUnits() const;
+
+    RetreatPolicyResult fightToEnd() const;
+    // retreat as soon as the attacker has 'attackerUnits' or fewer units left
+    RetreatPolicyResult unitThresholdPolicy(int attackerUnits) const;
+    // retreat as soon as the win probability when fighting to the end drops below 'probability'
+    RetreatPolicyResult oddsThresholdPolicy(float probability) const;
+    // policy maximizing the expected IPC trade plus the territory value times the win probability
+    RetreatPolicyResult optimalPolicy() const;
+    bool isOptimalRetreat(int attackerUnits, int defenderUnits) const;
+
+private:
+    struct State {
+        State();
+
+        int attackerUnits;
+        int defenderUnits;
+        int visits;
+        int initial; //< number of battles starting their regular rounds in this state
+        qint64 attackerIPCLoss;
+        qint64 defenderIPCLoss;
+        QHash<int, int> successors;
+    };
+
+    struct Value {
+        Value();
+
+        void add(const Value& other, float weight);
+
+        float win;
+        float retreat;
+        float attackerLoss;
+        float defenderLoss;
+    };
+
+    struct Chunk {
+        typedef State StateType;
+
+        int battles;
+        int seed;
+        QHash<int, State> states;
+    };
+
+    static int key(int attackerUnits, int defenderUnits);
+    bool isTerminal(const State& state) const;
+    Value retreatValue(const State& state) const;
+    Value terminalValue(const State& state) const;
+    float score(const Value& value) const;
+    // value of the rounds after 'state' that end up in a different state, weighted by their
+    // probability; 'pStay' is the probability that a round changes nothing
+    Value leaveValue(int state, const QVector<Value>& values, float& pStay) const;
+    RetreatPolicyResult evaluate(const QVector<bool>& retreat, QVector<Value>* values = 0) const;
+    void computeOptimalPolicy();
+
+    Batallion _attacker;
+    Batallion _defender;
+    CombatSettings _settings;
+    int _ipcFactor;
+    float _territoryValue;
+    int _battles;
+
+    QVector<State> _states; //< sorted by the total number of units
+    QHash<int, int> _index;
+    QVector<Value> _fightToEnd;
+    QVector<bool> _optimal;
+};
+
+#endif
@@ -0,0 +1,214 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "scenariocomparison.h"
+
+#include "combatscheduler.h"
+
+#include <math.h>
+
+namespace {
+    const float Z = 1.96f; //< 95% confidence
+
+    struct Simulate {
+        typedef void result_type;
+
+        Simulate(const QList<Scenario>& scenarios)
+            : scenarios(scenarios)
+        {}
+
+        template <typename T>
+        void operator()(T& chunk) {
+            // the scenarios are variations of one setup on the same map
+            if (scenarios.first().settings.narrowUnits)
+                simulate<UnitLayoutNarrow>(chunk);
+            else
+                simulate<UnitLayoutWide>(chunk);
+        }
+
+        template <typename Layout, typename T>
+        void simulate(T& chunk) {
+            int n = scenarios.size();
+            chunk.statistics.fill(typename T::StatisticsType(), n);
+            chunk.outcomes.fill(typename T::OutcomeType(), n);
+            chunk.differences.fill(typename T::OutcomeType(), n);
+            QVector<int> win(n);
+            QVector<int> attackerLoss(n);
+            QVector<int> defenderLoss(n);
+
+            DiceGenerator seeds(chunk.seed);
+            for (int i = 0; i < chunk.battles; ++i) {
+                quint32 seed = seeds.next();
+                for (int j = 0; j < n; ++j) {
+                    const Scenario& scenario = scenarios[j];
+                    BasicBattle<Layout> battle(scenario.attacker, scenario.defender, scenario.settings, seed);
+                    battle.run();
+                    chunk.statistics[j].addResult(battle);
+
+                    win[j] = (battle.attacker().size() > 0 && battle.defender().size() == 0) ? 1 : 0;
+                    attackerLoss[j] = 0;
+                    foreach (const BasicUnitLite<Layout>& unit, battle.attackerCasualities())
+                        attackerLoss[j] += unit.ipcValue();
+                    defenderLoss[j] = 0;
+                    foreach (const BasicUnitLite<Layout>& unit, battle.defenderCasualities())
+                        defenderLoss[j] += unit.ipcValue();
+
+                    typename T::OutcomeType& outcome = chunk.outcomes[j];
+                    outcome.win.add(win[j]);
+                    outcome.attackerIPCLoss.add(attackerLoss[j]);
+                    outcome.defenderIPCLoss.add(defenderLoss[j]);
+
+                    typename T::OutcomeType& difference = chunk.differences[j];
+                    difference.win.add(win[j] - win[0]);
+                    difference.attackerIPCLoss.add(attackerLoss[j] - attackerLoss[0]);
+                    difference.defenderIPCLoss.add(defenderLoss[j] - defenderLoss[0]);
+                }
+            }
+        }
+
+        const QList<Scenario>& scenarios;
+    };
+}
+
+Scenario::Scenario() {}
+
+Scenario::Scenario(const QString& name, const Batallion& attacker, const Batallion& defender, const CombatSettings& settings)
+    : name(name)
+    , attacker(attacker)
+    , defender(defender)
+    , settings(settings)
+{}
+
+Estimate::Estimate()
+    : mean(0.f)
+    , lower(0.f)
+    , upper(0.f)
+{}
+
+bool Estimate::isSignificant() const {
+    return (lower > 0.f) || (upper < 0.f);
+}
+
+ScenarioComparison::Moments::Moments()
+    : count(0)
+    , sum(0.0)
+    , sumSquares(0.0)
+{}
+
+void ScenarioComparison::Moments::add(double value) {
+    ++count;
+    sum += value;
+    sumSquares += value * value;
+}
+
+void ScenarioComparison::Moments::merge(const Moments& other) {
+    count += other.count;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+}
+
+double ScenarioComparison::Moments::variance() const {
+    if (count < 2)
+        return 0.0;
+    double mean = sum / count;
+    return qMax(0.0, (sumSquares - count * mean * mean) / (count - 1));
+}
+
+Estimate ScenarioComparison::Moments::estimate(float scale) const {
+    Estimate result;
+    if (count == 0)
+        return result;
+    float mean = static_cast<float>(sum / count);
+    float halfWidth = Z * static_cast<float>(sqrt(variance() / count));
+    result.mean = mean / scale;
+    result.lower = (mean - halfWidth) / scale;
+    result.upper = (mean + halfWidth) / scale;
+    return result;
+}
+
+ScenarioComparison::ScenarioComparison(int ipcFactor)
+    : _ipcFactor(ipcFactor)
+    , _battles(0)
+{}
+
+void ScenarioComparison::addScenario(const Scenario& scenario) {
+    _scenarios.append(scenario);
+}
+
+int ScenarioComparison::scenarioCount() const {
+    return _scenarios.size();
+}
+
+const Scenario& ScenarioComparison::scenario(int i) const {
+    return _scenarios.at(i);
+}
+
+void ScenarioComparison::simulate(int battles) {
+    int nChunks = CombatScheduler::instance()->threadCount() * 4;
+    QList<Chunk> chunks;
+    for (int i = 0; i < nChunks; ++i) {
+        Chunk chunk;
+        chunk.battles = battles / nChunks + ((i < battles % nChunks) ? 1 : 0);
+        chunk.seed = qrand();
+        chunks.append(chunk);
+    }
+    blockingCombatMap(chunks, Simulate(_scenarios), CombatPriorityInteractive);
+
+    int n = _scenarios.size();
+    _statistics.fill(CombatStatistics(), n);
+    _outcomes.fill(Outcome(), n);
+    _differences.fill(Outcome(), n);
+    foreach (const Chunk& chunk, chunks) {
+        for (int i = 0; i < n; ++i) {
+            _statistics[i].merge(chunk.statistics[i]);
+            _outcomes[i].win.merge(chunk.outcomes[i].win);
+            _outcomes[i].attackerIPCLoss.merge(chunk.outcomes[i].attackerIPCLoss);
+            _outcomes[i].defenderIPCLoss.merge(chunk.outcomes[i].defenderIPCLoss);
+            _differences[i].win.merge(chunk.differences[i].win);
+            _differences[i].attackerIPCLoss.merge(chunk.differences[i].attackerIPCLoss);
+            _differences[i].defenderIPCLoss.merge(chunk.differences[i].defenderIPCLoss);
+        }
+    }
+    _battles = battles;
+}
+
+int ScenarioComparison::battles() const {
+    return _battles;
+}
+
+const CombatStatistics& ScenarioComparison::statistics(int i) const {
+    return _statistics.at(i);
+}
+
+ScenarioDifference ScenarioComparison::difference(int i) const {
+    const Outcome& difference = _differences.at(i);
+    ScenarioDifference result;
+    result.attackerWinProbability = difference.win.estimate(1.f);
+    result.attackerIPCLoss = difference.attackerIPCLoss.estimate(static_cast<float>(_ipcFactor));
+    result.defenderIPCLoss = difference.defenderIPCLoss.estimate(static_cast<float>(_ipcFactor));
+
+    double paired = difference.win.variance();
+    double independent = _outcomes.at(0).win.variance() + _outcomes.at(i).win.variance();
+    result.varianceReduction = (paired > 0.0) ? static_cast<float>(independent / paired) : 0.f;
+    return result;
+}
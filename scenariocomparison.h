@@ -0,0 +1,120 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_SCENARIOCOMPARISON_H
+#define BOCK_SCENARIOCOMPARISON_H
+
+#include "combatthread.h"
+#include <QString>
+#include <QVector>
+
+struct Scenario {
+    Scenario();
+    Scenario(const QString& name, const Batallion& attacker, const Batallion& defender, const CombatSettings& settings);
+
+    QString name;
+    Batallion attacker;
+    Batallion defender;
+    CombatSettings settings;
+};
+
+// Mean with a 95% confidence interval
+struct Estimate {
+    Estimate();
+
+    bool isSignificant() const; //< the interval does not contain 0
+
+    float mean;
+    float lower;
+    float upper;
+};
+
+// Difference of a scenario to the first (reference) scenario. IPC losses are in IPC
+struct ScenarioDifference {
+    Estimate attackerWinProbability;
+    Estimate attackerIPCLoss;
+    Estimate defenderIPCLoss;
+    // how many times more battles two independent runs would need for the same accuracy of the
+    // win probability difference
+    float varianceReduction;
+};
+
+// Compares scenarios with common random numbers: the n-th battle of every scenario is fought
+// with the same seed, just like the seed of a CombatThread. As the scenarios see the same dice
+// for as long as they consume them in the same order, most of the noise cancels out in the
+// per-battle differences and far fewer battles are needed to tell two options apart
+class ScenarioComparison {
+public:
+    ScenarioComparison(int ipcFactor);
+
+    void addScenario(const Scenario& scenario);
+    int scenarioCount() const;
+    const Scenario& scenario(int i) const;
+
+    void simulate(int battles);
+    int battles() const;
+
+    const CombatStatistics& statistics(int i) const;
+    // scenario 'i' minus scenario 0
+    ScenarioDifference difference(int i) const;
+
+private:
+    struct Moments {
+        Moments();
+
+        void add(double value);
+        void merge(const Moments& other);
+        double variance() const;
+        Estimate estimate(float scale) const;
+
+        qint64 count;
+        double sum;
+        double sumSquares;
+    };
+
+    struct Outcome {
+        Moments win;
+        Moments attackerIPCLoss;
+        Moments defenderIPCLoss;
+    };
+
+    struct Chunk {
+        typedef CombatStatistics StatisticsType;
+        typedef Outcome OutcomeType;
+
+        int battles;
+        int seed;
+        QVector<CombatStatistics> statistics;
+        QVector<Outcome> outcomes;      //< per scenario
+        QVector<Outcome> differences;   //< per scenario, to scenario 0
+    };
+
+    QList<Scenario> _scenarios;
+    int _ipcFactor;
+    int _battles;
+    QVector<CombatStatistics> _statistics;
+    QVector<Outcome> _outcomes;
+    QVector<Outcome> _differences;
+};
+
+#endif
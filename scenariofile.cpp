@@ -0,0 +1,355 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "scenariofile.h"
+
+#include <QtEndian>
+#include <math.h>
+
+namespace {
+    const char MAGIC[4] = { 'A', 'A', 'C', 'S' };
+    const int HEADERSIZE = 8; // magic, version and two unused bytes
+
+    enum Flag {
+        FlagLandBattle = 1 << 0,
+        FlagAmphibiousCombat = 1 << 1,
+        FlagLandUnitMustLive = 1 << 2,
+        FlagOrderOfLossIPC = 1 << 3,
+        FlagQuasiRandom = 1 << 4,
+        FlagTimeBudget = 1 << 5,
+        FlagExact = 1 << 6
+    };
+
+    class RecordWriter {
+    public:
+        RecordWriter(QByteArray& data)
+            : _data(data)
+        {}
+
+        template <typename T>
+        void write(T value) {
+            int size = _data.size();
+            _data.resize(size + sizeof(T));
+            qToLittleEndian<T>(value, reinterpret_cast<uchar*>(_data.data() + size));
+        }
+
+        void writeString(const QString& string) {
+            QByteArray utf8 = string.toUtf8();
+            write<quint16>(utf8.size());
+            _data.append(utf8.constData(), utf8.size());
+        }
+
+        void writeUnits(const QList<QPair<int, int> >& units) {
+            write<quint16>(units.size());
+            for (int i = 0; i < units.size(); ++i) {
+                write<quint16>(units[i].first);
+                write<quint32>(units[i].second);
+            }
+        }
+
+    private:
+        QByteArray& _data;
+    };
+
+    // reads zeros beyond the end, so a damaged record gives a wrong but harmless result
+    class RecordReader {
+    public:
+        RecordReader(const uchar* data, int size)
+            : _data(data)
+            , _end(data + size)
+        {}
+
+        template <typename T>
+        T read() {
+            if (_end - _data < static_cast<int>(sizeof(T))) {
+                _data = _end;
+                return 0;
+            }
+            T value = qFromLittleEndian<T>(_data);
+            _data += sizeof(T);
+            return value;
+        }
+
+        QString readString() {
+            int size = read<quint16>();
+            if (_end - _data < size) {
+                _data = _end;
+                return QString();
+            }
+            QString result = QString::fromUtf8(reinterpret_cast<const char*>(_data), size);
+            _data += size;
+            return result;
+        }
+
+        QList<QPair<int, int> > readUnits() {
+            QList<QPair<int, int> > result;
+            int size = read<quint16>();
+            for (int i = 0; (i < size) && (_data < _end); ++i) {
+                int id = read<quint16>();
+                int count = read<quint32>();
+                result.append(qMakePair(id, count));
+            }
+            return result;
+        }
+
+    private:
+        const uchar* _data;
+        const uchar* _end;
+    };
+
+    void encode(const ScenarioRecord& record, QByteArray& data) {
+        RecordWriter writer(data);
+        quint8 flags = 0;
+        if (record.isLandBattle)
+            flags |= FlagLandBattle;
+        if (record.isAmphibiousCombat)
+            flags |= FlagAmphibiousCombat;
+        if (record.landUnitMustLive)
+            flags |= FlagLandUnitMustLive;
+        if (record.orderOfLoss == OrderOfLossIPC)
+            flags |= FlagOrderOfLossIPC;
+        if (record.sampling == SamplingModeQuasiRandom)
+            flags |= FlagQuasiRandom;
+        if (record.isTimed)
+            flags |= FlagTimeBudget;
+        if (record.isExact)
+            flags |= FlagExact;
+        writer.write<quint8>(flags);
+        writer.write<quint32>(record.seed);
+
+        writer.writeString(record.map);
+        writer.writeString(record.mapVersion);
+        writer.writeString(record.attackerFaction);
+        writer.writeString(record.defenderFaction);
+        writer.writeUnits(record.attackerUnits);
+        writer.writeUnits(record.defenderUnits);
+
+        const CombatStatistics& statistics = record.statistics;
+        writer.write<qint32>(statistics.battles);
+        writer.write<qint32>(statistics.attackerWins);
+        writer.write<qint32>(statistics.defenderWins);
+        writer.write<qint32>(statistics.draws);
+        writer.write<qint64>(statistics.attackerIPCLoss);
+        writer.write<qint64>(statistics.defenderIPCLoss);
+        writer.write<qint64>(statistics.attackerUnitsLeft);
+        writer.write<qint64>(statistics.defenderUnitsLeft);
+        // in millionths
+        writer.write<quint32>(static_cast<quint32>(floor(record.attackerWinError * 1e6 + 0.5)));
+        writer.write<quint32>(static_cast<quint32>(floor(record.defenderWinError * 1e6 + 0.5)));
+        for (int outcome = BattleOutcomeAttackerWins; outcome <= BattleOutcomeDraw; ++outcome) {
+            QList<quint32> seeds = statistics.examples.seeds(static_cast<BattleOutcome>(outcome));
+            writer.write<quint8>(seeds.size());
+            foreach (quint32 seed, seeds)
+                writer.write<quint32>(seed);
+        }
+        // added later, so older records end before it and read 0
+        writer.write<quint16>(record.maxRounds);
+    }
+
+    ScenarioRecord decode(const uchar* data, int size) {
+        RecordReader reader(data, size);
+        ScenarioRecord record;
+        quint8 flags = reader.read<quint8>();
+        record.isLandBattle = (flags & FlagLandBattle) != 0;
+        record.isAmphibiousCombat = (flags & FlagAmphibiousCombat) != 0;
+        record.landUnitMustLive = (flags & FlagLandUnitMustLive) != 0;
+        record.orderOfLoss = (flags & FlagOrderOfLossIPC) ? OrderOfLossIPC : OrderOfLossValue;
+        record.sampling = (flags & FlagQuasiRandom) ? SamplingModeQuasiRandom : SamplingModePseudoRandom;
+        record.isTimed = (flags & FlagTimeBudget) != 0;
+        record.isExact = (flags & FlagExact) != 0;
+        record.seed = reader.read<quint32>();
+
+        record.map = reader.readString();
+        record.mapVersion = reader.readString();
+        record.attackerFaction = reader.readString();
+        record.defenderFaction = reader.readString();
+        record.attackerUnits = reader.readUnits();
+        record.defenderUnits = reader.readUnits();
+
+        CombatStatistics& statistics = record.statistics;
+        statistics.battles = reader.read<qint32>();
+        statistics.attackerWins = reader.read<qint32>();
+        statistics.defenderWins = reader.read<qint32>();
+        statistics.draws = reader.read<qint32>();
+        statistics.attackerIPCLoss = reader.read<qint64>();
+        statistics.defenderIPCLoss = reader.read<qint64>();
+        statistics.attackerUnitsLeft = reader.read<qint64>();
+        statistics.defenderUnitsLeft = reader.read<qint64>();
+        record.attackerWinError = reader.read<quint32>() / 1e6f;
+        record.defenderWinError = reader.read<quint32>() / 1e6f;
+        for (int outcome = BattleOutcomeAttackerWins; outcome <= BattleOutcomeDraw; ++outcome) {
+            int seeds = reader.read<quint8>();
+            for (int i = 0; i < seeds; ++i)
+                statistics.examples.add(static_cast<BattleOutcome>(outcome), reader.read<quint32>());
+        }
+        record.maxRounds = reader.read<quint16>();
+        return record;
+    }
+}
+
+ScenarioRecord::ScenarioRecord()
+    : isLandBattle(true)
+    , isAmphibiousCombat(false)
+    , landUnitMustLive(false)
+    , orderOfLoss(OrderOfLossValue)
+    , maxRounds(0)
+    , sampling(SamplingModePseudoRandom)
+    , seed(0)
+    , isTimed(false)
+    , isExact(false)
+    , attackerWinError(0.f)
+    , defenderWinError(0.f)
+{}
+
+ScenarioFile::ScenarioFile(const QString& fileName)
+    : _file(fileName)
+    , _data(0)
+    , _size(0)
+{}
+
+ScenarioFile::~ScenarioFile() {
+    close();
+}
+
+bool ScenarioFile::open(QIODevice::OpenMode mode) {
+    close();
+    if (!(mode & QIODevice::WriteOnly) && !_file.exists()) {
+        _errorString = "The file " + _file.fileName() + " does not exist";
+        return false;
+    }
+    if (!_file.open(mode)) {
+        _errorString = _file.errorString();
+        return false;
+    }
+
+    if ((_file.size() == 0) && (mode & QIODevice::WriteOnly)) {
+        QByteArray header(MAGIC, sizeof(MAGIC));
+        RecordWriter writer(header);
+        writer.write<quint16>(Version);
+        writer.write<quint16>(0);
+        if (_file.write(header) != HEADERSIZE) {
+            _errorString = _file.errorString();
+            close();
+            return false;
+        }
+        _file.flush();
+    }
+
+    _file.seek(0);
+    QByteArray header = _file.read(HEADERSIZE);
+    if ((header.size() != HEADERSIZE) || (memcmp(header.constData(), MAGIC, sizeof(MAGIC)) != 0)) {
+        _errorString = _file.fileName() + " is no scenario file";
+        close();
+        return false;
+    }
+    if (qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(header.constData()) + sizeof(MAGIC)) > Version) {
+        _errorString = _file.fileName() + " was written by a newer version of the simulator";
+        close();
+        return false;
+    }
+
+    if (!map()) {
+        close();
+        return false;
+    }
+    _size = HEADERSIZE;
+    index(HEADERSIZE);
+    return true;
+}
+
+void ScenarioFile::close() {
+    unmap();
+    _file.close();
+    _offsets.clear();
+    _size = 0;
+}
+
+const QString& ScenarioFile::errorString() const {
+    return _errorString;
+}
+
+int ScenarioFile::count() const {
+    return _offsets.size();
+}
+
+ScenarioRecord ScenarioFile::record(int i) const {
+    qint64 offset = _offsets.at(i);
+    quint32 size = qFromLittleEndian<quint32>(_data + offset - sizeof(quint32));
+    return decode(_data + offset, size);
+}
+
+bool ScenarioFile::append(const QList<ScenarioRecord>& records) {
+    QByteArray data;
+    foreach (const ScenarioRecord& record, records) {
+        int sizePosition = data.size();
+        RecordWriter(data).write<quint32>(0);
+        encode(record, data);
+        qToLittleEndian<quint32>(data.size() - sizePosition - sizeof(quint32), reinterpret_cast<uchar*>(data.data() + sizePosition));
+    }
+
+    // the file is mapped as a whole, so it has to be mapped again for the new size
+    unmap();
+    bool success = ((_file.size() == _size) || _file.resize(_size)) && _file.seek(_size) && (_file.write(data) == data.size());
+    if (success)
+        _file.flush();
+    else
+        _errorString = _file.errorString();
+
+    if (!map()) {
+        close();
+        return false;
+    }
+    index(_size);
+    return success;
+}
+
+bool ScenarioFile::append(const ScenarioRecord& record) {
+    return append(QList<ScenarioRecord>() << record);
+}
+
+bool ScenarioFile::map() {
+    _data = _file.map(0, _file.size());
+    if (!_data) {
+        _errorString = _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void ScenarioFile::unmap() {
+    if (_data)
+        _file.unmap(_data);
+    _data = 0;
+}
+
+void ScenarioFile::index(qint64 offset) {
+    qint64 size = _file.size();
+    while (size - offset >= static_cast<qint64>(sizeof(quint32))) {
+        quint32 recordSize = qFromLittleEndian<quint32>(_data + offset);
+        if (size - offset - static_cast<qint64>(sizeof(quint32)) < recordSize)
+            break;
+        _offsets.append(offset + sizeof(quint32));
+        offset += sizeof(quint32) + recordSize;
+    }
+    _size = offset;
+}
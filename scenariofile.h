@@ -0,0 +1,96 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_SCENARIOFILE_H
+#define BOCK_SCENARIOFILE_H
+
+#include "combatthread.h"
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+// A setup of the simulator together with the aggregated results of simulating it. As the
+// CombatStatisticsJob is determined by its seed, the results can be reproduced exactly as long
+// as the map did not change and the job did not run against a time budget. Exact odds from the
+// map's odds table were not simulated at all
+struct ScenarioRecord {
+    ScenarioRecord();
+
+    QString map;
+    QString mapVersion;
+    QString attackerFaction;
+    QString defenderFaction;
+    QList<QPair<int, int> > attackerUnits; //< unit id and count
+    QList<QPair<int, int> > defenderUnits; //< unit id and count
+    bool isLandBattle;
+    bool isAmphibiousCombat;
+    bool landUnitMustLive;
+    OrderOfLoss orderOfLoss;
+    int maxRounds; //< 0 for no limit
+    SamplingMode sampling;
+    quint32 seed; //< of the CombatStatisticsJob
+    bool isTimed; //< simulated with a time budget, so the seed does not reproduce the results exactly
+    bool isExact; //< looked up in the odds table, so the statistics are the exact odds scaled to a number of battles
+    CombatStatistics statistics;
+    float attackerWinError;
+    float defenderWinError;
+};
+
+// A file of ScenarioRecords. The file starts with a magic number and the format version,
+// followed by the records, each one prefixed with its size. All numbers are little endian.
+// The file is memory mapped and only the record offsets are read when it is opened, so a
+// record is decoded when it is accessed. New records are appended in one write; a record that
+// was only partially written before is ignored and overwritten. Readers skip data at the end of
+// a record that they do not know, so later versions may add fields there
+class ScenarioFile {
+public:
+    enum { Version = 1 };
+
+    ScenarioFile(const QString& fileName);
+    ~ScenarioFile();
+
+    // with QIODevice::ReadWrite the file is created if it does not exist yet
+    bool open(QIODevice::OpenMode mode);
+    void close();
+    const QString& errorString() const;
+
+    int count() const;
+    ScenarioRecord record(int i) const;
+    bool append(const QList<ScenarioRecord>& records);
+    bool append(const ScenarioRecord& record);
+
+private:
+    bool map();
+    void unmap();
+    void index(qint64 offset); //< finds the records from 'offset' on
+
+    QFile _file;
+    uchar* _data;
+    qint64 _size; //< of the part with complete records
+    QVector<qint64> _offsets; //< of the records' payloads
+    QString _errorString;
+};
+
+#endif
@@ -22,6 +22,8 @@
  *************************************************************************************************/
 
 #include "settingswidget.h"
+#include "iconcache.h"
+#include "mapdownloader.h"
 #include "simulatorapplication.h"
 
 #include <QCheckBox>
@@ -29,7 +31,6 @@
 #include <QDomDocument>
 #include <QDomElement>
 #include <QDomNode>
-#include <QEventLoop>
 #include <QFile>
 #include <QGridLayout>
 #include <QLabel>
@@ -44,20 +45,6 @@
 #define BUTTONTEXTUPDATE "Update"
 #define BUTTONTEXTREMOVE "Remove"
 
-void downloadFile(QNetworkAccessManager& manager, const QUrl& url, const QString& filename) {
-    QEventLoop loop;
-    QNetworkReply* reply = manager.get(QNetworkRequest(url));
-    QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
-
-    loop.exec();
-
-    QFile file(filename);
-    file.open(QIODevice::WriteOnly);
-    file.write(reply->readAll());
-
-    delete reply;
-}
-
 bool deleteFile(const QString& fileName) {
     if (fileName.size() < 1)
         return true;
@@ -115,13 +102,21 @@ MapEntry::~MapEntry() {
 
 SettingsWidget::SettingsWidget()
     : QWidget()
+    , _downloader(0)
     , _layout(0)
     , _nameLabel(0)
     , _localVersionLabel(0)
     , _remoteVersionLabel(0)
     , _statusText(0)
+    , _currentMapIsUpdate(false)
 {
+    _downloader = new MapDownloader(&_manager, qApp->mapsDirectory(), this);
+    connect(_downloader, SIGNAL(message(QString)), this, SLOT(showMessage(QString)));
+    connect(_downloader, SIGNAL(finished(QString, bool)), this, SLOT(downloadFinished(QString, bool)));
     connect(qApp, SIGNAL(remoteVersionFileArrived()), this, SLOT(createMapEntries()));
+    // the cached remote version file can be shown before the refreshed one arrives
+    if (qApp->remoteSettings())
+        createMapEntries();
 }
 
 void SettingsWidget::buttonClicked() {
@@ -131,10 +126,9 @@ void SettingsWidget::buttonClicked() {
             const QString& mapName = mapEntry->mapName;
             if (isMapInstalled(mapName)) {
                 if (needsUpdate(mapName)) {
-                    removeMap(mapName);
+                    // only the files which have changed are downloaded again
                     setButtonsEnabled(false);
-                    _currentMapDownload = mapName;
-                    downloadMap(mapName);
+                    downloadMap(mapName, true);
                     mapEntry->actionButton->setText(BUTTONTEXTREMOVE);
                 }
                 else {
@@ -144,10 +138,9 @@ void SettingsWidget::buttonClicked() {
                 }
             }
             else {
-                removeMap(mapName);
+                // leftovers of an interrupted download are kept to be resumed
                 setButtonsEnabled(false);
-                _currentMapDownload = mapName;
-                downloadMap(mapName);
+                downloadMap(mapName, false);
                 mapEntry->actionButton->setText(BUTTONTEXTREMOVE);
             }
             break;
@@ -207,77 +200,34 @@ void SettingsWidget::setupMapEntry(const MapEntry* mapEntry, QSettings* remote)
     remote->endGroup();
 }
 
-void SettingsWidget::downloadMap(const QString& map) {
-    QDir mapsDir = qApp->mapsDirectory();
-    downloadFile(_manager, qApp->remoteMapIndexURL(map), qApp->temporaryIndexFileString());
-
-    QDomDocument doc("document");
-    QFile file(qApp->temporaryIndexFileString());
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(0, "File Error", "Could not find the file");
-        return;
-    }
-    QString errorMessage;
-    int errorLine;
-    if (!doc.setContent(&file, &errorMessage, &errorLine)) {
-        QMessageBox::critical(0, "XML Error", errorMessage + "\n" + QString::number(errorLine));
-        file.close();
-        return;
-    }
-    file.close();
-
-    mapsDir.mkdir(map);
-    mapsDir.cd(map);
-    QDomElement docElem = doc.documentElement();
-    QDomNodeList factions = docElem.childNodes();
-    for (int i = 0; i < factions.size(); ++i) {
-        const QDomNode& faction = factions.at(i);
-        const QDomElement& factionElem = faction.toElement();
-        const QString& factionName = factionElem.nodeName();
-        mapsDir.mkdir(factionName);
-        mapsDir.cd(factionName);
-        QDomNodeList files = factionElem.childNodes();
-        for (int j = 0; j < files.size(); ++j) {
-            const QDomNode& file = files.at(j);
-            const QDomElement& fileElem = file.toElement();
-            const QString& fileName = fileElem.nodeName();
-            const QString& target = mapsDir.absolutePath() + "/" + fileName + ".png";
-            const QString& targetUrl = qApp->baseURLString() + map + "/" + factionName + "/" + fileName + ".png";
-            QNetworkReply* reply = _manager.get(QNetworkRequest(QUrl(targetUrl)));
-            _replyFileNameMap.insert(reply, target);
-            connect(reply, SIGNAL(finished()), this, SLOT(downloadFinished()));
-        }
-        mapsDir.cdUp();
-    }
-    QNetworkReply* reply = _manager.get(QNetworkRequest(QUrl(qApp->baseURLString() + map + "/" + map + ".xml")));
-    _replyFileNameMap.insert(reply, mapsDir.absolutePath() + "/" + map + ".xml");
-    connect(reply, SIGNAL(finished()), this, SLOT(downloadFinished()));
+void SettingsWidget::downloadMap(const QString& map, bool isUpdate) {
+    _currentMapDownload = map;
+    _currentMapIsUpdate = isUpdate;
 
     QSettings* remote = qApp->remoteSettings();
     remote->beginGroup("Maps");
-    QFile versionFile(qApp->localMapVersionFileString(map));
-    versionFile.open(QIODevice::WriteOnly);
-    versionFile.write(remote->value(map).toString().toLocal8Bit());
+    const QString& version = remote->value(map).toString();
     remote->endGroup();
-}
-
-void SettingsWidget::downloadFinished() {
-    QNetworkReply* reply = dynamic_cast<QNetworkReply*>(QObject::sender());
-
-    const QString& filename = _replyFileNameMap.take(reply);
-
-    QFile file(filename);
-    file.open(QIODevice::WriteOnly);
-    file.write(reply->readAll());
-    file.close();
 
-    _statusText->append("Downloaded " + filename);
+    _downloader->downloadMap(map, version, qApp->baseURLString());
+}
 
-    if (_replyFileNameMap.keys().isEmpty()) {
-        createMapEntries();
-        emit finishedDownloadingMap(_currentMapDownload);
-         setButtonsEnabled(true);
+void SettingsWidget::downloadFinished(QString map, bool success) {
+    createMapEntries();
+    if (success) {
+        // the pictures of an earlier download of the map are outdated
+        IconCache::instance()->removeMap(map);
+        if (_currentMapIsUpdate)
+            emit finishedRemovingMap(map);
+        emit finishedDownloadingMap(map);
     }
+    else
+        showMessage("Downloading '" + map + "' failed, it will be resumed with the next download");
+    setButtonsEnabled(true);
+}
+
+void SettingsWidget::showMessage(QString message) {
+    _statusText->append(message);
 }
 
 void SettingsWidget::createMapEntries() {
@@ -286,6 +236,8 @@ void SettingsWidget::createMapEntries() {
     _maps.clear();
 
     QSettings* remoteSettings = qApp->remoteSettings();
+    if (!remoteSettings)
+        return;
 
     remoteSettings->beginGroup("Maps");
     QStringList allMaps = remoteSettings->allKeys();
@@ -328,6 +280,9 @@ void SettingsWidget::createMapEntries() {
         _layout->addWidget(_statusText, i+1, 0, 3, 0);
         _layout->setRowStretch(i+1, 1);
     }
+
+    // the entries might be refreshed while a map is being downloaded
+    setButtonsEnabled(!_downloader->isRunning());
 }
 
 void SettingsWidget::setButtonsEnabled(bool enabled) {
@@ -31,14 +31,13 @@
 #include <QString>
 #include <QUrl>
 
+class MapDownloader;
 class QCheckBox;
 class QGridLayout;
 class QLabel;
 class QPushButton;
 class QTextEdit;
 
-void downloadFile(QNetworkAccessManager& manager, const QUrl& url, const QString& filename);
-
 struct MapEntry {
     QString mapName;
     QLabel* nameLabel;
@@ -64,26 +63,28 @@ public slots:
 
 private slots:
     void buttonClicked();
-    void downloadFinished();
+    void downloadFinished(QString map, bool success);
+    void showMessage(QString message);
 
 private:
     bool isMapInstalled(const QString& map);
     bool needsUpdate(const QString& map);
     void removeMap(const QString& map);
-    void downloadMap(const QString& map);
+    void downloadMap(const QString& map, bool isUpdate);
     void setupMapEntry(const MapEntry* mapEntry, QSettings* remote);
     void setButtonsEnabled(bool enabled);
 
     QNetworkAccessManager _manager;
+    MapDownloader* _downloader;
 
     QGridLayout* _layout;
     QList<MapEntry*> _maps;
-    QMap<QNetworkReply*, QString> _replyFileNameMap;
     QLabel* _nameLabel;
     QLabel* _localVersionLabel;
     QLabel* _remoteVersionLabel;
     QTextEdit* _statusText;
     QString _currentMapDownload;
+    bool _currentMapIsUpdate;
 };
 
 #endif
@@ -23,9 +23,14 @@
 
 #include "simulatorapplication.h"
 
+#include "battletrace.h"
 #include "combatwidget.h"
+#include "scenariofile.h"
 #include "settingswidget.h"
+#include "versioncheck.h"
 #include <QDir>
+#include <QInputDialog>
+#include <QMap>
 #include <QMessageBox>
 #include <QNetworkAccessManager>
 #include <QSettings>
@@ -33,12 +38,16 @@
 #include <QTabWidget>
 #include <QTextStream>
 
+namespace {
+    const int VERSIONTIMEOUT = 5000; // in milliseconds
+}
+
 SimulatorApplication::SimulatorApplication(int& argc, char** argv)
     : QApplication(argc, argv)
     , _networkManager(new QNetworkAccessManager)
     , _localSettings(new QSettings)
     , _remoteSettings(nullptr)
-    , _versionDownloadErrorOccurred(false)
+    , _versionCheck(0)
     , _mainWidget(new QTabWidget)
 {
     // Set general application information
@@ -47,16 +56,16 @@ SimulatorApplication::SimulatorApplication(int& argc, char** argv)
     setOrganizationDomain("alexbock.dyndns.org");
     setOrganizationName("Bock");
 
-    // start the download of the remote version file
-    QNetworkReply* reply = _networkManager->get(QNetworkRequest(getRemoteVersionFileUrl()));
-    QObject::connect(reply, SIGNAL(finished()), this, SLOT(remoteVersionDownloadFinished()));
-    QObject::connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(remoteVersionDownloadFailed(QNetworkReply::NetworkError)));
-
     // create the necessary directory structure (%USER%/triplea/combatsim/) if it doesn't already exist and set it as the current
     QDir dir = mapsDirectory();
     dir.mkpath(".");
     QDir::setCurrent(dir.absolutePath());
 
+    // use the last known remote version file right away and refresh it in the background
+    if (QFile::exists(getCachedVersionFileString()))
+        _remoteSettings = new QSettings(getCachedVersionFileString(), QSettings::IniFormat);
+    requestRemoteVersionFile();
+
     // create the widgets for the application
     _mainWidget->setMinimumSize(800, 640);
     foreach (const QString& dir, getListOfLocalMaps()) {
@@ -73,10 +82,35 @@ SimulatorApplication::SimulatorApplication(int& argc, char** argv)
     // lastly, select the previously selected tab and show the main widget 
     restoreState();
     _mainWidget->show();
+
+    // scenario files can be given on the command line; with --replay they are simulated again.
+    // '--trace file' traces all battles and writes them to the file when the application quits,
+    // '--odds-table map bounds' computes the odds table of a map
+    QStringList args = arguments();
+    bool replay = args.contains("--replay");
+    for (int i = 1; i < args.size(); ++i) {
+        if ((args[i] == "--trace") && (i + 1 < args.size())) {
+            _traceFile = args[++i];
+            BattleTrace::setEnabled(true);
+        }
+        else if ((args[i] == "--odds-table") && (i + 2 < args.size())) {
+            generateOddsTable(args[i + 1], args[i + 2]);
+            i += 2;
+        }
+        else if (args[i] != "--replay")
+            openScenarioFile(args[i], replay);
+    }
 }
 
 SimulatorApplication::~SimulatorApplication() {
     saveState();
+    if (!_traceFile.isEmpty()) {
+        // a .json file is written in the Chrome trace format, everything else in the binary one
+        bool isChromeTrace = _traceFile.endsWith(".json", Qt::CaseInsensitive);
+        if (!(isChromeTrace ? BattleTrace::exportChromeTrace(_traceFile) : BattleTrace::exportBinary(_traceFile)))
+            qWarning("Could not write the trace to %s", qPrintable(_traceFile));
+    }
+    delete _versionCheck; // before the manager its pending reply belongs to
     delete _networkManager;
     delete _localSettings;
     delete _remoteSettings;
@@ -121,6 +155,71 @@ void SimulatorApplication::removeTab(QString name) {
         _mainWidget->removeTab(index);
 }
 
+void SimulatorApplication::openScenarioFile(const QString& fileName, bool replay) {
+    ScenarioFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::critical(_mainWidget, "Load scenario", file.errorString());
+        return;
+    }
+    if (file.count() == 0) {
+        QMessageBox::information(_mainWidget, "Load scenario", fileName + " does not contain any scenarios");
+        return;
+    }
+
+    int index = file.count() - 1;
+    if (file.count() > 1) {
+        QStringList items;
+        for (int i = 0; i < file.count(); ++i) {
+            ScenarioRecord record = file.record(i);
+            items.append(QString::number(i + 1) + ": " + record.map + ", " + record.attackerFaction + " vs. " + record.defenderFaction +
+                " (" + QString::number(record.statistics.attackerWinProbability() * 100, 'f', 1) + "%)");
+        }
+        bool ok;
+        QString item = QInputDialog::getItem(_mainWidget, "Load scenario", "Scenario:", items, index, false, &ok);
+        if (!ok)
+            return;
+        index = items.indexOf(item);
+    }
+
+    ScenarioRecord record = file.record(index);
+    for (int i = 0; i < _mainWidget->count(); ++i) {
+        CombatWidget* widget = dynamic_cast<CombatWidget*>(_mainWidget->widget(i));
+        if (widget && (widget->directory().compare(record.map, Qt::CaseInsensitive) == 0)) {
+            _mainWidget->setCurrentIndex(i);
+            widget->openScenario(record, replay);
+            return;
+        }
+    }
+    QMessageBox::critical(_mainWidget, "Load scenario", "The scenario was saved for the map " + record.map + ", which is not installed");
+}
+
+void SimulatorApplication::generateOddsTable(const QString& map, const QString& bounds) {
+    QMap<QString, int> counts;
+    foreach (const QString& bound, bounds.split(',', QString::SkipEmptyParts)) {
+        QStringList pair = bound.split('=');
+        bool ok = (pair.size() == 2);
+        int count = ok ? pair[1].toInt(&ok) : 0;
+        if (!ok || (count < 0)) {
+            QMessageBox::critical(_mainWidget, "Odds table", "'" + bound + "' is no unit name with a maximum count");
+            return;
+        }
+        counts.insert(pair[0].trimmed(), count);
+    }
+
+    for (int i = 0; i < _mainWidget->count(); ++i) {
+        CombatWidget* widget = dynamic_cast<CombatWidget*>(_mainWidget->widget(i));
+        if (widget && (widget->directory().compare(map, Qt::CaseInsensitive) == 0)) {
+            QString error;
+            if (widget->generateOddsTable(counts, error))
+                QMessageBox::information(_mainWidget, "Odds table", "The odds table of " + widget->directory() + " was written");
+            else
+                QMessageBox::critical(_mainWidget, "Odds table", error);
+            return;
+        }
+    }
+    QMessageBox::critical(_mainWidget, "Odds table", "The map " + map + " is not installed");
+}
+
 void SimulatorApplication::restoreState() {
     // select the old tab
     QString oldTabName = _localSettings->value("oldTab").toString();
@@ -139,24 +238,29 @@ void SimulatorApplication::saveState() {
     _localSettings->setValue("oldTab", tabText);
 }
 
-void SimulatorApplication::remoteVersionDownloadFinished() {
-    if (!_versionDownloadErrorOccurred) {
-        QNetworkReply* currentReply = dynamic_cast<QNetworkReply*>(QObject::sender());
-        QFile file(getTemporaryVersionFileString());
-        file.open(QIODevice::WriteOnly);
-        file.write(currentReply->readAll());
-        file.close();
+void SimulatorApplication::requestRemoteVersionFile() {
+    _versionCheck = new VersionCheck(_networkManager, _localSettings, this);
+    QObject::connect(_versionCheck, SIGNAL(finished()), this, SLOT(remoteVersionDownloadFinished()));
+    _versionCheck->start(getRemoteVersionFileUrl(), getCachedVersionFileString(), VERSIONTIMEOUT);
+}
 
-        currentReply->deleteLater();
+void SimulatorApplication::remoteVersionDownloadFinished() {
+    VersionCheck::Result result = _versionCheck->result();
+    // offline or timed out; the cached file (if any) stays in use
+    if (result == VersionCheck::Failed)
+        return;
 
-        _remoteSettings = new QSettings(getTemporaryVersionFileString(), QSettings::IniFormat);
-        checkApplicationAndMapVersions();
-        emit remoteVersionFileArrived();
+    if (result == VersionCheck::Changed) {
+        delete _remoteSettings;
+        _remoteSettings = new QSettings(getCachedVersionFileString(), QSettings::IniFormat);
     }
-}
 
-void SimulatorApplication::remoteVersionDownloadFailed(QNetworkReply::NetworkError) {
-    _versionDownloadErrorOccurred = true;
+    if (!_remoteSettings)
+        return;
+
+    checkApplicationAndMapVersions();
+    if (result == VersionCheck::Changed)
+        emit remoteVersionFileArrived();
 }
 
 void SimulatorApplication::checkApplicationAndMapVersions() const {
@@ -285,31 +389,28 @@ QDir SimulatorApplication::mapsDirectory(const QString& subDir) const {
 }
 
 QUrl SimulatorApplication::getRemoteVersionFileUrl() const {
-    return QUrl("http://webstaff.itn.liu.se/~alebo68/TripleA/VERSION");
+    return QUrl(baseURLString() + "VERSION");
 }
 
-QString SimulatorApplication::getTemporaryVersionFileString() const {
-    return QDir::tempPath() + "/VERSION";
+QString SimulatorApplication::getCachedVersionFileString() const {
+    return mapsDirectory().absolutePath() + "/REMOTEVERSION";
 }
 
 QString SimulatorApplication::getDownloadUrlString() const {
-    return "http://webstaff.itn.liu.se/~alebo68/TripleA/AAACombatSimulator.exe";
+    return baseURLString() + "AAACombatSimulator.exe";
 }
 
 QString SimulatorApplication::getChangelogUrlString() const {
-    return "http://webstaff.itn.liu.se/~alebo68/TripleA/CHANGELOG";
+    return baseURLString() + "CHANGELOG";
 }
 
 QUrl SimulatorApplication::remoteMapIndexURL(const QString& map) const {
     return QUrl(baseURLString() + map + "/INDEX");
 }
 
-QString SimulatorApplication::temporaryIndexFileString() const {
-    return QDir::tempPath() + "/INDEX";
-}
-
 QString SimulatorApplication::baseURLString() const {
-    return "http://webstaff.itn.liu.se/~alebo68/TripleA/";
+    // the 'BaseURL' setting allows to use a different (e.g. local) server
+    return _localSettings->value("BaseURL", "http://webstaff.itn.liu.se/~alebo68/TripleA/").toString();
 }
 
 QString SimulatorApplication::localMapVersionFileString(const QString& map) const {
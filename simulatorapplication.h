@@ -31,6 +31,7 @@
 
 class CombatWidget;
 class SettingsWidget;
+class VersionCheck;
 class QNetworkAccessManager;
 class QSettings;
 class QTabWidget;
@@ -52,8 +53,11 @@ public:
     QString localMapVersion(const QString& map) const;
     QString localMapVersionFileString(const QString& map) const;
     QUrl remoteMapIndexURL(const QString& map) const;
-    QString temporaryIndexFileString() const;
     QString baseURLString() const;
+    // lets the user choose one of the file's scenarios and opens it in the tab of its map
+    void openScenarioFile(const QString& fileName, bool replay);
+    // computes the odds table of 'map' for unit bounds like "Infantry=10,Artillery=4,Armour=4"
+    void generateOddsTable(const QString& map, const QString& bounds);
 
 public slots:
     void addTab(QString);
@@ -61,7 +65,6 @@ public slots:
 
 private slots:
     void remoteVersionDownloadFinished();
-    void remoteVersionDownloadFailed(QNetworkReply::NetworkError);
 
 signals:
     void remoteVersionFileArrived();
@@ -73,11 +76,12 @@ private:
         QString remoteVersion;
     };
     
+    void requestRemoteVersionFile();
     void checkApplicationAndMapVersions() const;
     void separateVersion(QString versionString, QString& major, QString& minor, QString& release) const;
     int compareVersions(const QString& v1, const QString& v2) const; //< returns -1 if v1<v2   0 if v1==v2  and 1 if v1>v2
     QUrl getRemoteVersionFileUrl() const;
-    QString getTemporaryVersionFileString() const;
+    QString getCachedVersionFileString() const;
     QString getDownloadUrlString() const;
     QString getChangelogUrlString() const;
     QStringList getListOfLocalMaps() const;
@@ -87,9 +91,9 @@ private:
     QTabWidget* _mainWidget;
     QNetworkAccessManager* _networkManager; //< central instance to apply for downloads
     QSettings* _localSettings;
-    QSettings* _remoteSettings;
-
-    bool _versionDownloadErrorOccurred; //< will be set to true if an error occurs during the download of the remote version file
+    QSettings* _remoteSettings; //< the cached remote version file, might be null if it was never downloaded
+    VersionCheck* _versionCheck; //< refreshes the cached remote version file
+    QString _traceFile; //< the battles are traced if it is set
 };
 
 #endif
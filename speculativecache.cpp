@@ -0,0 +1,170 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "speculativecache.h"
+
+#include "combatscheduler.h"
+
+#include <QMetaObject>
+
+namespace {
+    const int CACHESIZE = 32; //< results
+    const int BATCHBATTLES = 250;
+
+    // one byte per unit for the ids of the narrow units; larger ids of wide units are preceded by
+    // their high bits with the top bit set, so they cannot be mistaken for small ids or the '|'
+    void appendID(QByteArray& key, int id) {
+        if (id > 0x3f)
+            key.append(static_cast<char>(0x80 | (id >> 8)));
+        key.append(static_cast<char>(id));
+    }
+}
+
+class SpeculativeJob : public CombatStatisticsJob {
+public:
+    SpeculativeJob(SpeculativeCache* cache, int generation, const Batallion& attacker, const Batallion& defender,
+                   const CombatSettings& settings, int battles, SamplingMode sampling)
+        : CombatStatisticsJob(attacker, defender, settings, battles, CombatPriorityBackground, BATCHBATTLES, sampling)
+        , _cache(cache)
+        , _generation(generation)
+    {}
+
+    ~SpeculativeJob() {
+        cancel();
+        waitForFinished();
+    }
+
+protected:
+    void finished() {
+        QMetaObject::invokeMethod(_cache, "jobFinished", Qt::QueuedConnection, Q_ARG(int, _generation));
+    }
+
+private:
+    SpeculativeCache* _cache;
+    int _generation;
+};
+
+SpeculativeCache::SpeculativeCache(int battles, QObject* parent)
+    : QObject(parent)
+    , _battles(battles)
+    , _sampling(SamplingModePseudoRandom)
+    , _results(CACHESIZE)
+    , _job(0)
+    , _generation(0)
+{}
+
+SpeculativeCache::~SpeculativeCache() {
+    stop();
+}
+
+void SpeculativeCache::speculate(const QList<QPair<Batallion, Batallion> >& setups, const CombatSettings& settings, SamplingMode sampling) {
+    stop();
+    _settings = settings;
+    _sampling = sampling;
+    _pending = setups;
+    startNext();
+}
+
+void SpeculativeCache::stop() {
+    ++_generation;
+    _pending.clear();
+    if (_job) {
+        _job->cancel();
+        _job->waitForFinished();
+        delete _job;
+        _job = 0;
+    }
+}
+
+bool SpeculativeCache::take(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, SamplingMode sampling,
+                            Result& result)
+{
+    QByteArray k = key(attacker, defender, settings, sampling);
+    if (_job && (_jobKey == k)) {
+        // the queued notification of the job is ignored, as the job is handled here already
+        ++_generation;
+        _job->waitForFinished();
+        finishJob();
+        startNext();
+    }
+
+    Result* cached = _results.take(k);
+    if (!cached)
+        return false;
+    result = *cached;
+    delete cached;
+    return true;
+}
+
+void SpeculativeCache::jobFinished(int generation) {
+    if (generation != _generation)
+        return;
+
+    finishJob();
+    startNext();
+}
+
+QByteArray SpeculativeCache::key(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, SamplingMode sampling) {
+    QByteArray result;
+    foreach (const UnitLite& unit, attacker)
+        appendID(result, unit.id());
+    result.append('|');
+    foreach (const UnitLite& unit, defender)
+        appendID(result, unit.id());
+    result.append('|');
+    result.append(settings.isLandBattle ? 'L' : 'S');
+    result.append(settings.isAmphibiousCombat ? 'A' : '-');
+    result.append(settings.landUnitMustLive ? 'M' : '-');
+    result.append((settings.orderOfLoss == OrderOfLossIPC) ? 'I' : 'V');
+    result.append(QByteArray::number(settings.maxRounds));
+    result.append((sampling == SamplingModeQuasiRandom) ? 'Q' : 'P');
+    return result;
+}
+
+void SpeculativeCache::startNext() {
+    while (!_pending.isEmpty()) {
+        QPair<Batallion, Batallion> setup = _pending.takeFirst();
+        QByteArray k = key(setup.first, setup.second, _settings, _sampling);
+        if (_results.contains(k))
+            continue;
+
+        _job = new SpeculativeJob(this, _generation, setup.first, setup.second, _settings, _battles, _sampling);
+        _jobKey = k;
+        _job->start();
+        return;
+    }
+}
+
+void SpeculativeCache::finishJob() {
+    _job->waitForFinished();
+    if (!_job->isCanceled()) {
+        Result* result = new Result;
+        result->seed = _job->seed();
+        result->statistics = _job->statistics();
+        result->attackerWinError = _job->winProbabilityError(true);
+        result->defenderWinError = _job->winProbabilityError(false);
+        _results.insert(_jobKey, result);
+    }
+    delete _job;
+    _job = 0;
+}
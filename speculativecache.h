@@ -0,0 +1,85 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_SPECULATIVECACHE_H
+#define BOCK_SPECULATIVECACHE_H
+
+#include <QObject>
+
+#include "combatthread.h"
+#include <QByteArray>
+#include <QCache>
+#include <QList>
+#include <QPair>
+
+class SpeculativeJob;
+
+// Simulates the setups the user is likely to fight next in the background, while the units are
+// still being entered, and keeps the results of the last few of them. The setups are simulated
+// one after the other at background priority, so an interactive job is never held up for longer
+// than one batch. A result is taken out of the cache when it is used, so fighting the same
+// setup again gives a new run
+class SpeculativeCache : public QObject {
+Q_OBJECT
+public:
+    struct Result {
+        quint32 seed; //< of the CombatStatisticsJob
+        CombatStatistics statistics;
+        float attackerWinError;
+        float defenderWinError;
+    };
+
+    SpeculativeCache(int battles, QObject* parent = 0);
+    ~SpeculativeCache();
+
+    // cancels the running simulation and simulates the setups that are not cached yet, the
+    // first one first
+    void speculate(const QList<QPair<Batallion, Batallion> >& setups, const CombatSettings& settings, SamplingMode sampling);
+    // cancels the running simulation and forgets the setups that were not simulated yet
+    void stop();
+
+    // removes the result of the setup from the cache; if the setup is being simulated right
+    // now, it waits for the simulation. Returns false if there is no result for it
+    bool take(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, SamplingMode sampling,
+        Result& result);
+
+private slots:
+    // invoked from the scheduler threads; 'generation' identifies the job that sent it
+    void jobFinished(int generation);
+
+private:
+    static QByteArray key(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, SamplingMode sampling);
+    void startNext();
+    void finishJob(); //< caches the result of the finished job and deletes it
+
+    int _battles;
+    CombatSettings _settings;
+    SamplingMode _sampling;
+    QList<QPair<Batallion, Batallion> > _pending;
+    QCache<QByteArray, Result> _results;
+    SpeculativeJob* _job;
+    QByteArray _jobKey;
+    int _generation;
+};
+
+#endif
@@ -0,0 +1,293 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "sweepwidget.h"
+
+#include "combatwidget.h"
+
+#include <QComboBox>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPushButton>
+#include <QSpinBox>
+#include <QToolTip>
+#include <QVBoxLayout>
+
+namespace {
+    const int LABELSPACE = 30; //< space for the axis labels in pixels
+}
+
+HeatmapView::HeatmapView(const ParameterSweep* sweep, int ipcFactor, QWidget* parent)
+    : QWidget(parent)
+    , _sweep(sweep)
+    , _ipcFactor(ipcFactor)
+    , _mode(ModeWinProbability)
+{
+    setMouseTracking(true);
+    setMinimumSize(200, 150);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+}
+
+void HeatmapView::setMode(Mode mode) {
+    _mode = mode;
+    update();
+}
+
+QSize HeatmapView::sizeHint() const {
+    return QSize(400, 250);
+}
+
+QRect HeatmapView::gridRect() const {
+    return rect().adjusted(LABELSPACE, 0, 0, -LABELSPACE);
+}
+
+QRect HeatmapView::cellRect(int column, int row) const {
+    QRect grid = gridRect();
+    int columns = _sweep->columns();
+    int rows = _sweep->rows();
+    int left = grid.left() + (column * grid.width()) / columns;
+    int right = grid.left() + ((column + 1) * grid.width()) / columns;
+    // the defender counts increase from bottom to top
+    int top = grid.top() + ((rows - row - 1) * grid.height()) / rows;
+    int bottom = grid.top() + ((rows - row) * grid.height()) / rows;
+    return QRect(left, top, right - left, bottom - top);
+}
+
+float HeatmapView::value(const SweepCell& cell) const {
+    const CombatStatistics& s = cell.statistics;
+    if (s.battles == 0)
+        return 0.f;
+
+    switch (_mode) {
+        case ModeWinProbability:
+            return s.attackerWinProbability();
+        case ModeAttackerIPCLoss:
+            return static_cast<float>(s.attackerIPCLoss) / _ipcFactor / s.battles;
+        case ModeDefenderIPCLoss:
+            return static_cast<float>(s.defenderIPCLoss) / _ipcFactor / s.battles;
+    }
+    return 0.f;
+}
+
+QColor HeatmapView::color(const SweepCell& cell, float maximum) const {
+    if (cell.statistics.battles == 0)
+        return Qt::lightGray;
+
+    if (_mode == ModeWinProbability) // red (defender wins) to green (attacker wins)
+        return QColor::fromHsvF(value(cell) / 3.0, 0.7, 0.9);
+    else {
+        float v = (maximum > 0.f) ? value(cell) / maximum : 0.f;
+        return QColor::fromHsvF(0.6, v, 1.0);
+    }
+}
+
+void HeatmapView::paintEvent(QPaintEvent*) {
+    int columns = _sweep->columns();
+    int rows = _sweep->rows();
+    if ((columns == 0) || (rows == 0))
+        return;
+
+    float maximum = 0.f;
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column)
+            maximum = qMax(maximum, value(_sweep->cell(column, row)));
+    }
+
+    QPainter painter(this);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            const SweepCell& cell = _sweep->cell(column, row);
+            QRect r = cellRect(column, row);
+            painter.fillRect(r, color(cell, maximum));
+            painter.setPen(Qt::white);
+            painter.drawRect(r);
+
+            if ((cell.statistics.battles > 0) && (r.width() > 30) && (r.height() > 14)) {
+                painter.setPen(Qt::black);
+                QString text = (_mode == ModeWinProbability) ? QString::number(qRound(value(cell) * 100)) + "%" : QString::number(value(cell), 'f', 1);
+                painter.drawText(r, Qt::AlignCenter, text);
+            }
+        }
+    }
+
+    painter.setPen(palette().color(QPalette::WindowText));
+    for (int column = 0; column < columns; ++column) {
+        QRect r = cellRect(column, 0);
+        painter.drawText(QRect(r.left(), r.bottom(), r.width(), LABELSPACE), Qt::AlignCenter,
+            QString::number(_sweep->cell(column, 0).attackerCount));
+    }
+    for (int row = 0; row < rows; ++row) {
+        QRect r = cellRect(0, row);
+        painter.drawText(QRect(0, r.top(), LABELSPACE, r.height()), Qt::AlignCenter,
+            QString::number(_sweep->cell(0, row).defenderCount));
+    }
+}
+
+void HeatmapView::mouseMoveEvent(QMouseEvent* event) {
+    for (int row = 0; row < _sweep->rows(); ++row) {
+        for (int column = 0; column < _sweep->columns(); ++column) {
+            if (!cellRect(column, row).contains(event->pos()))
+                continue;
+
+            const SweepCell& cell = _sweep->cell(column, row);
+            const CombatStatistics& s = cell.statistics;
+            QString text = "Attacker: " + QString::number(cell.attackerCount) + "\nDefender: " + QString::number(cell.defenderCount);
+            if (s.battles > 0) {
+                float lower, upper;
+                s.attackerWinInterval(lower, upper);
+                text += "\nWin: " + QString::number(s.attackerWinProbability() * 100, 'f', 1) + "% (" +
+                    QString::number(lower * 100, 'f', 1) + "% - " + QString::number(upper * 100, 'f', 1) + "%)" +
+                    "\nAttacker IPC loss: " + QString::number(static_cast<float>(s.attackerIPCLoss) / _ipcFactor / s.battles, 'f', 1) +
+                    "\nDefender IPC loss: " + QString::number(static_cast<float>(s.defenderIPCLoss) / _ipcFactor / s.battles, 'f', 1) +
+                    "\nBattles: " + QString::number(s.battles);
+            }
+            QToolTip::showText(event->globalPos(), text, this);
+            return;
+        }
+    }
+    QToolTip::hideText();
+}
+
+
+SweepWidget::SweepWidget(CombatWidget* parent)
+    : QGroupBox("Parameter sweep", parent)
+    , _parent(parent)
+    , _view(0)
+    , _attackerUnit(0)
+    , _attackerMin(0)
+    , _attackerMax(0)
+    , _defenderUnit(0)
+    , _defenderMin(0)
+    , _defenderMax(0)
+    , _mode(0)
+    , _startButton(0)
+    , _statusLabel(0)
+{
+    QHBoxLayout* layout = new QHBoxLayout(this);
+
+    QGridLayout* controls = new QGridLayout;
+    controls->addWidget(new QLabel("Attacking unit"), 0, 0);
+    _attackerUnit = new QComboBox;
+    initUnits(_attackerUnit);
+    controls->addWidget(_attackerUnit, 0, 1, 1, 2);
+    _attackerMin = new QSpinBox;
+    _attackerMax = new QSpinBox;
+    _attackerMax->setValue(10);
+    controls->addWidget(_attackerMin, 1, 1);
+    controls->addWidget(_attackerMax, 1, 2);
+
+    controls->addWidget(new QLabel("Defending unit"), 2, 0);
+    _defenderUnit = new QComboBox;
+    initUnits(_defenderUnit);
+    controls->addWidget(_defenderUnit, 2, 1, 1, 2);
+    _defenderMin = new QSpinBox;
+    _defenderMax = new QSpinBox;
+    _defenderMax->setValue(10);
+    controls->addWidget(_defenderMin, 3, 1);
+    controls->addWidget(_defenderMax, 3, 2);
+
+    _mode = new QComboBox;
+    _mode->addItem("Win probability");
+    _mode->addItem("Attacker IPC loss");
+    _mode->addItem("Defender IPC loss");
+    connect(_mode, SIGNAL(currentIndexChanged(int)), this, SLOT(modeChanged(int)));
+    controls->addWidget(_mode, 4, 0, 1, 3);
+
+    _startButton = new QPushButton("Start");
+    connect(_startButton, SIGNAL(clicked()), this, SLOT(startStop()));
+    controls->addWidget(_startButton, 5, 0, 1, 3);
+
+    _statusLabel = new QLabel;
+    controls->addWidget(_statusLabel, 6, 0, 1, 3);
+    controls->setRowStretch(7, 1);
+    layout->addLayout(controls);
+
+    _view = new HeatmapView(&_sweep, parent->ipcFactor());
+    layout->addWidget(_view, 1);
+
+    connect(&_sweep, SIGNAL(cellUpdated(int, int)), this, SLOT(cellUpdated()));
+    connect(&_sweep, SIGNAL(finished()), this, SLOT(sweepFinished()));
+}
+
+void SweepWidget::initUnits(QComboBox* box) {
+    foreach (const Unit* unit, _parent->units())
+        box->addItem(unit->name(), unit->id());
+}
+
+Unit* SweepWidget::selectedUnit(const QComboBox* box) const {
+    int id = box->itemData(box->currentIndex()).toInt();
+    foreach (Unit* unit, _parent->units()) {
+        if (unit->id() == id)
+            return unit;
+    }
+    return 0;
+}
+
+Batallion SweepWidget::baseBatallion(const QList<QPair<Unit*, int> >& units, const Unit* excluded) const {
+    // the swept unit type is replaced by the counts of the grid
+    QList<QPair<Unit*, int> > result;
+    QPair<Unit*, int> p;
+    foreach (p, units) {
+        if (p.first->id() != excluded->id())
+            result.append(p);
+    }
+    return _parent->batallion(result);
+}
+
+void SweepWidget::startStop() {
+    if (_sweep.isRunning()) {
+        _sweep.stop();
+        sweepFinished();
+        return;
+    }
+
+    Unit* attackerUnit = selectedUnit(_attackerUnit);
+    Unit* defenderUnit = selectedUnit(_defenderUnit);
+    if (!attackerUnit || !defenderUnit)
+        return;
+
+    _startButton->setText("Stop");
+    _statusLabel->setText("Running");
+    _sweep.start(baseBatallion(_parent->attackerUnits(), attackerUnit), attackerUnit, _attackerMin->value(), _attackerMax->value(),
+        baseBatallion(_parent->defenderUnits(), defenderUnit), defenderUnit, _defenderMin->value(), _defenderMax->value(),
+        _parent->combatSettings(), _parent->ipcFactor());
+    _view->update();
+}
+
+void SweepWidget::modeChanged(int mode) {
+    _view->setMode(static_cast<HeatmapView::Mode>(mode));
+}
+
+void SweepWidget::cellUpdated() {
+    _statusLabel->setText("Pass " + QString::number(_sweep.pass() + 1));
+    _view->update();
+}
+
+void SweepWidget::sweepFinished() {
+    _startButton->setText("Start");
+    _statusLabel->setText("Finished");
+    _view->update();
+}
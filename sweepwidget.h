@@ -0,0 +1,97 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_SWEEPWIDGET_H
+#define BOCK_SWEEPWIDGET_H
+
+#include <QGroupBox>
+
+#include "parametersweep.h"
+
+class CombatWidget;
+class QComboBox;
+class QLabel;
+class QPushButton;
+class QSpinBox;
+
+class HeatmapView : public QWidget {
+Q_OBJECT
+public:
+    enum Mode {
+        ModeWinProbability,
+        ModeAttackerIPCLoss,
+        ModeDefenderIPCLoss
+    };
+
+    HeatmapView(const ParameterSweep* sweep, int ipcFactor, QWidget* parent = 0);
+
+    void setMode(Mode mode);
+    QSize sizeHint() const;
+
+protected:
+    void paintEvent(QPaintEvent* event);
+    void mouseMoveEvent(QMouseEvent* event);
+
+private:
+    QRect gridRect() const;
+    QRect cellRect(int column, int row) const;
+    float value(const SweepCell& cell) const;
+    QColor color(const SweepCell& cell, float maximum) const;
+
+    const ParameterSweep* _sweep;
+    int _ipcFactor;
+    Mode _mode;
+};
+
+class SweepWidget : public QGroupBox {
+Q_OBJECT
+public:
+    SweepWidget(CombatWidget* parent);
+
+private slots:
+    void startStop();
+    void modeChanged(int mode);
+    void sweepFinished();
+    void cellUpdated();
+
+private:
+    void initUnits(QComboBox* box);
+    Unit* selectedUnit(const QComboBox* box) const;
+    Batallion baseBatallion(const QList<QPair<Unit*, int> >& units, const Unit* excluded) const;
+
+    CombatWidget* _parent;
+    ParameterSweep _sweep;
+    HeatmapView* _view;
+
+    QComboBox* _attackerUnit;
+    QSpinBox* _attackerMin;
+    QSpinBox* _attackerMax;
+    QComboBox* _defenderUnit;
+    QSpinBox* _defenderMin;
+    QSpinBox* _defenderMax;
+    QComboBox* _mode;
+    QPushButton* _startButton;
+    QLabel* _statusLabel;
+};
+
+#endif
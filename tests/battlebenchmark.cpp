@@ -0,0 +1,161 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "combatthread.h"
+#include "testcorpus.h"
+#include "unit.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <errno.h>
+#include <new>
+#include <stdlib.h>
+
+// Times the scenarios of a corpus file and counts the heap allocations of their battles. Every
+// scenario is simulated with 'battles' and twice as many battles after a warm-up that grows the
+// BattleArena of the thread; the difference of the two runs gives the allocations per battle
+// without the constant ones of simulateCombat itself. Once the arena is large enough, a battle
+// should not allocate anything, and the benchmark fails if one does
+namespace {
+    const int WARMUPBATTLES = 1000;
+    const int DEFAULTBATTLES = 100000;
+
+    QAtomicInt allocationCount;
+}
+
+#ifdef __GLIBC__
+// With glibc, malloc and its relatives are replaced by versions that count and forward to the
+// glibc allocator, so allocations that do not go through operator new are counted as well
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* p);
+
+    void* malloc(size_t size) {
+        allocationCount.ref();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        allocationCount.ref();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size) {
+        allocationCount.ref();
+        return __libc_realloc(p, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        allocationCount.ref();
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        allocationCount.ref();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** result, size_t alignment, size_t size) {
+        allocationCount.ref();
+        void* p = __libc_memalign(alignment, size);
+        if (!p)
+            return ENOMEM;
+        *result = p;
+        return 0;
+    }
+
+    void free(void* p) {
+        __libc_free(p);
+    }
+}
+#else
+// elsewhere only the allocations through operator new are counted
+void* operator new(size_t size) {
+    allocationCount.ref();
+    void* p = malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    free(p);
+}
+#endif
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    if ((args.size() != 2) && (args.size() != 3)) {
+        qWarning("Usage: battlebenchmark <corpus.xml> [battles]");
+        return 2;
+    }
+    int battles = (args.size() == 3) ? args[2].toInt() : DEFAULTBATTLES;
+
+    QDomDocument doc("document");
+    if (!readCorpus(args[1], doc))
+        return 2;
+    QDomElement docElem = doc.documentElement();
+    int ipcFactor = docElem.attribute("ipcFactor", "1").toInt();
+    QMap<QString, Unit*> units = readUnits(docElem);
+    // the layout that the application picks for the corpus' units
+    bool narrowUnits = NarrowUnitLite::fits(units.values(), ipcFactor);
+
+    bool allocates = false;
+    for (QDomElement scenario = docElem.firstChildElement("Scenario"); !scenario.isNull(); scenario = scenario.nextSiblingElement("Scenario")) {
+        QString name = scenario.attribute("name");
+        QString error;
+        CombatSettings settings;
+        Batallion attacker = readBatallion(scenario.firstChildElement("Attacker"), units, ipcFactor, error);
+        Batallion defender = readBatallion(scenario.firstChildElement("Defender"), units, ipcFactor, error);
+        if (!error.isEmpty() || !readSettings(scenario, settings, error)) {
+            qWarning("%s: %s", qPrintable(name), qPrintable(error));
+            continue;
+        }
+        settings.narrowUnits = narrowUnits;
+        int seed = scenario.attribute("seed").toInt();
+        simulateCombat(attacker, defender, settings, WARMUPBATTLES, seed);
+
+        int before = allocationCount;
+        simulateCombat(attacker, defender, settings, battles, seed);
+        int single = allocationCount - before;
+
+        QElapsedTimer timer;
+        timer.start();
+        before = allocationCount;
+        simulateCombat(attacker, defender, settings, 2 * battles, seed);
+        int twice = allocationCount - before;
+        qint64 time = timer.nsecsElapsed();
+
+        double perBattle = static_cast<double>(twice - single) / battles;
+        allocates |= (twice != single);
+        qWarning("%-45s %8.3f us/battle %8.3f allocations/battle", qPrintable(name), time / 2000.0 / battles, perBattle);
+    }
+    qDeleteAll(units);
+    return allocates ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "enginecomparison.h"
+#include "testcorpus.h"
+#include "unit.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+// Runs random scenarios of the corpus units through the quasi-random engine and the
+// pseudo-random reference and fails if any of their distributions differ. The seed is fixed, so
+// the scenarios and the result of a run do not change between builds unless an engine does
+namespace {
+    const int SCENARIOS = 50;
+    const int BATTLES = 4000; //< per scenario and engine
+    const double ALPHA = 0.01; //< family-wise error rate over all tests
+    const quint32 SEED = 1;
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    if (args.size() != 2) {
+        qWarning("Usage: enginecomparisontest <units.xml>");
+        return 2;
+    }
+
+    QDomDocument doc("document");
+    if (!readCorpus(args[1], doc))
+        return 2;
+    QDomElement docElem = doc.documentElement();
+    QMap<QString, Unit*> units = readUnits(docElem);
+    if (units.isEmpty()) {
+        qWarning("'%s' has no units", qPrintable(args[1]));
+        return 2;
+    }
+
+    EngineComparison comparison(units.values(), docElem.attribute("ipcFactor", "1").toInt());
+    QStringList failures = comparison.compare(pseudoRandomEngine, quasiRandomEngine, SCENARIOS, BATTLES, ALPHA, SEED);
+    foreach (const QString& failure, failures)
+        qWarning("%s", qPrintable(failure));
+    qWarning("Engine comparison: %d of %d tests failed", failures.size(), comparison.tests());
+    qDeleteAll(units);
+    return failures.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "combatthread.h"
+#include "dicegenerator.h"
+#include "testcorpus.h"
+#include "unit.h"
+
+#include <QCoreApplication>
+#include <QDomElement>
+#include <QStringList>
+
+// Checks the combat engine against the golden results of a corpus file. Every scenario is
+// simulated with its fixed seed, so a change of the rules, the dice or the order of loss changes
+// the results even if it hides in the statistical noise. Besides the wins and the IPC losses, the
+// corpus holds the distribution of the units left on either side: the number of battles which
+// ended with 0, 1, 2, ... units of the side. After an intended change, '--print' writes the
+// current results in the format of the corpus, so the expected values can be updated. If the
+// units of the corpus fit into the narrow layout, every scenario is checked in both layouts
+namespace {
+    const char* const FIELDS[] = { "attackerWins", "defenderWins", "draws", "attackerIPCLoss", "defenderIPCLoss",
+        "attackerUnitsLeft", "defenderUnitsLeft" };
+    const int FIELDCOUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+    QString histogram(const QList<int>& counts) {
+        QStringList result;
+        foreach (int count, counts)
+            result.append(QString::number(count));
+        return result.join(" ");
+    }
+
+    // the values of FIELDS of 'battles' battles, each with its own seed taken from a generator
+    // seeded with 'seed'
+    QStringList simulate(const Batallion& attacker, const Batallion& defender, const CombatSettings& settings, int battles, int seed) {
+        qint64 attackerWins = 0;
+        qint64 defenderWins = 0;
+        qint64 draws = 0;
+        qint64 attackerIPCLoss = 0;
+        qint64 defenderIPCLoss = 0;
+        QList<int> attackerUnitsLeft;
+        QList<int> defenderUnitsLeft;
+        for (int i = 0; i <= attacker.size(); ++i)
+            attackerUnitsLeft.append(0);
+        for (int i = 0; i <= defender.size(); ++i)
+            defenderUnitsLeft.append(0);
+
+        DiceGenerator seeds(seed);
+        for (int i = 0; i < battles; ++i) {
+            CombatThread combat(attacker, defender, settings, seeds.next());
+            combat.run();
+            int attackerLeft = combat.attacker().size();
+            int defenderLeft = combat.defender().size();
+            if ((attackerLeft == 0) && (defenderLeft > 0))
+                ++defenderWins;
+            else if ((defenderLeft == 0) && (attackerLeft > 0))
+                ++attackerWins;
+            else
+                ++draws;
+            ++attackerUnitsLeft[attackerLeft];
+            ++defenderUnitsLeft[defenderLeft];
+
+            int attackerIPC = 0;
+            int defenderIPC = 0;
+            foreach (const UnitLite& unit, combat.attackerCasualities())
+                attackerIPC += unit.ipcValue();
+            foreach (const UnitLite& unit, combat.defenderCasualities())
+                defenderIPC += unit.ipcValue();
+            attackerIPCLoss += attackerIPC;
+            defenderIPCLoss += defenderIPC;
+        }
+
+        QStringList result;
+        result << QString::number(attackerWins) << QString::number(defenderWins) << QString::number(draws)
+               << QString::number(attackerIPCLoss) << QString::number(defenderIPCLoss)
+               << histogram(attackerUnitsLeft) << histogram(defenderUnitsLeft);
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    bool print = args.removeAll("--print") > 0;
+    if (args.size() != 2) {
+        qWarning("Usage: goldentest [--print] <corpus.xml>");
+        return 2;
+    }
+
+    QDomDocument doc("document");
+    if (!readCorpus(args[1], doc))
+        return 2;
+
+    QDomElement docElem = doc.documentElement();
+    int ipcFactor = docElem.attribute("ipcFactor", "1").toInt();
+    QMap<QString, Unit*> units = readUnits(docElem);
+    QList<bool> layouts;
+    layouts.append(false);
+    if (NarrowUnitLite::fits(units.values(), ipcFactor))
+        layouts.append(true);
+
+    int scenarios = 0;
+    int failures = 0;
+    for (QDomElement scenario = docElem.firstChildElement("Scenario"); !scenario.isNull(); scenario = scenario.nextSiblingElement("Scenario")) {
+        ++scenarios;
+        QString name = scenario.attribute("name");
+        QString error;
+        CombatSettings s;
+        Batallion attacker = readBatallion(scenario.firstChildElement("Attacker"), units, ipcFactor, error);
+        Batallion defender = readBatallion(scenario.firstChildElement("Defender"), units, ipcFactor, error);
+        if (!error.isEmpty() || !readSettings(scenario, s, error)) {
+            qWarning("%s: %s", qPrintable(name), qPrintable(error));
+            ++failures;
+            continue;
+        }
+
+        int battles = scenario.attribute("battles").toInt();
+        int seed = scenario.attribute("seed").toInt();
+        s.narrowUnits = false;
+        QStringList actual = simulate(attacker, defender, s, battles, seed);
+
+        if (print) {
+            QString expected = "        <Expected";
+            for (int i = 0; i < FIELDCOUNT; ++i)
+                expected += QString(" %1=\"%2\"").arg(FIELDS[i]).arg(actual[i]);
+            qWarning("%s\n%s/>", qPrintable(name), qPrintable(expected));
+            continue;
+        }
+
+        QDomElement expected = scenario.firstChildElement("Expected");
+        foreach (bool narrow, layouts) {
+            if (narrow) {
+                s.narrowUnits = true;
+                actual = simulate(attacker, defender, s, battles, seed);
+            }
+            for (int i = 0; i < FIELDCOUNT; ++i) {
+                if (!expected.hasAttribute(FIELDS[i]) || (expected.attribute(FIELDS[i]) != actual[i])) {
+                    qWarning("%s (%s units): %s is '%s', expected '%s'", qPrintable(name), narrow ? "narrow" : "wide", FIELDS[i],
+                        qPrintable(actual[i]), qPrintable(expected.attribute(FIELDS[i], "nothing")));
+                    ++failures;
+                }
+            }
+        }
+    }
+    qDeleteAll(units);
+
+    if (scenarios == 0) {
+        qWarning("The corpus '%s' has no scenarios", qPrintable(args[1]));
+        return 2;
+    }
+    if (!print)
+        qWarning("%d scenarios, %d failed checks", scenarios, failures);
+    return (failures > 0) ? 1 : 0;
+}
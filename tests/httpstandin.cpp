@@ -0,0 +1,159 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "httpstandin.h"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+
+HttpStandIn::HttpStandIn(QObject* parent)
+    : QTcpServer(parent)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+}
+
+bool HttpStandIn::start() {
+    return listen(QHostAddress::LocalHost, 0);
+}
+
+QString HttpStandIn::baseURL() const {
+    return "http://127.0.0.1:" + QString::number(serverPort()) + "/";
+}
+
+void HttpStandIn::setFile(const QByteArray& path, const QByteArray& content, const QByteArray& etag, const QByteArray& lastModified) {
+    File file;
+    file.content = content;
+    file.etag = etag;
+    file.lastModified = lastModified;
+    _files.insert(path, file);
+}
+
+void HttpStandIn::removeFile(const QByteArray& path) {
+    _files.remove(path);
+}
+
+void HttpStandIn::setHanging(const QByteArray& path) {
+    _hanging.insert(path);
+}
+
+const QList<HttpStandIn::Request>& HttpStandIn::requests() const {
+    return _requests;
+}
+
+QList<HttpStandIn::Request> HttpStandIn::requests(const QByteArray& path) const {
+    QList<Request> result;
+    foreach (const Request& request, _requests) {
+        if (request.path == path)
+            result.append(request);
+    }
+    return result;
+}
+
+void HttpStandIn::clearRequests() {
+    _requests.clear();
+}
+
+void HttpStandIn::acceptConnection() {
+    while (QTcpSocket* socket = nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void HttpStandIn::readRequest() {
+    QTcpSocket* socket = static_cast<QTcpSocket*>(QObject::sender());
+    QByteArray& buffer = _buffers[socket];
+    buffer.append(socket->readAll());
+    int end = buffer.indexOf("\r\n\r\n");
+    if (end < 0)
+        return;
+
+    // the requests have no body, and as every answer closes the connection there is only one
+    QList<QByteArray> lines = buffer.left(end).split('\n');
+    _buffers.remove(socket);
+    Request request;
+    QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+    if (requestLine.size() >= 2)
+        request.path = requestLine[1];
+    foreach (const QByteArray& line, lines) {
+        int colon = line.indexOf(':');
+        if (colon > 0)
+            request.headers.insert(line.left(colon).trimmed().toLower(), line.mid(colon + 1).trimmed());
+    }
+    _requests.append(request);
+    answer(socket, request);
+}
+
+void HttpStandIn::answer(QTcpSocket* socket, const Request& request) {
+    if (_hanging.contains(request.path))
+        return;
+    if (!_files.contains(request.path)) {
+        respond(socket, "404 Not Found", QList<QByteArray>());
+        return;
+    }
+
+    const File& file = _files[request.path];
+    QList<QByteArray> headers;
+    if (!file.etag.isEmpty())
+        headers << "ETag: " + file.etag;
+    if (!file.lastModified.isEmpty())
+        headers << "Last-Modified: " + file.lastModified;
+
+    const QByteArray& ifNoneMatch = request.headers.value("if-none-match");
+    const QByteArray& ifModifiedSince = request.headers.value("if-modified-since");
+    if ((!ifNoneMatch.isEmpty() && (ifNoneMatch == file.etag))
+        || (ifNoneMatch.isEmpty() && !ifModifiedSince.isEmpty() && (ifModifiedSince == file.lastModified))) {
+        respond(socket, "304 Not Modified", headers);
+        return;
+    }
+
+    // a Range request is only honored if the If-Range validator still matches the file
+    const QByteArray& range = request.headers.value("range");
+    const QByteArray& ifRange = request.headers.value("if-range");
+    bool useRange = range.startsWith("bytes=") && range.endsWith("-")
+        && (ifRange.isEmpty() || (ifRange == file.etag) || (ifRange == file.lastModified));
+    if (useRange) {
+        qint64 size = file.content.size();
+        qint64 start = range.mid(6, range.size() - 7).toLongLong();
+        if (start >= size) {
+            headers << "Content-Range: bytes */" + QByteArray::number(size);
+            respond(socket, "416 Requested Range Not Satisfiable", headers);
+            return;
+        }
+        headers << "Content-Range: bytes " + QByteArray::number(start) + "-" + QByteArray::number(size - 1) + "/" + QByteArray::number(size);
+        respond(socket, "206 Partial Content", headers, file.content.mid(start));
+        return;
+    }
+    respond(socket, "200 OK", headers, file.content);
+}
+
+void HttpStandIn::respond(QTcpSocket* socket, const QByteArray& status, const QList<QByteArray>& headers, const QByteArray& body) {
+    QByteArray response = "HTTP/1.1 " + status + "\r\n";
+    foreach (const QByteArray& header, headers)
+        response += header + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
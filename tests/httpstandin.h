@@ -0,0 +1,83 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_HTTPSTANDIN_H
+#define BOCK_HTTPSTANDIN_H
+
+#include <QTcpServer>
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QString>
+
+class QTcpSocket;
+
+// A minimal HTTP/1.1 server on localhost which stands in for the map server in the tests. It
+// answers GET requests for the files it was given, honors Range, If-Range, If-None-Match and
+// If-Modified-Since like a real server and records the requests, so the tests can check the
+// headers the client sent. Requests for a hanging path are never answered
+class HttpStandIn : public QTcpServer {
+Q_OBJECT
+public:
+    struct Request {
+        QByteArray path;
+        QHash<QByteArray, QByteArray> headers; //< by lower case name
+    };
+
+    HttpStandIn(QObject* parent = 0);
+
+    bool start();
+    QString baseURL() const; //< 'http://127.0.0.1:<port>/'
+
+    void setFile(const QByteArray& path, const QByteArray& content, const QByteArray& etag = QByteArray(),
+                 const QByteArray& lastModified = QByteArray());
+    void removeFile(const QByteArray& path);
+    void setHanging(const QByteArray& path);
+
+    const QList<Request>& requests() const;
+    QList<Request> requests(const QByteArray& path) const;
+    void clearRequests();
+
+private slots:
+    void acceptConnection();
+    void readRequest();
+
+private:
+    struct File {
+        QByteArray content;
+        QByteArray etag;
+        QByteArray lastModified;
+    };
+
+    void answer(QTcpSocket* socket, const Request& request);
+    void respond(QTcpSocket* socket, const QByteArray& status, const QList<QByteArray>& headers, const QByteArray& body = QByteArray());
+
+    QHash<QByteArray, File> _files;
+    QSet<QByteArray> _hanging;
+    QList<Request> _requests;
+    QHash<QTcpSocket*, QByteArray> _buffers;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "httpstandin.h"
+#include "mapdownloader.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QTime>
+#include <QTimer>
+
+// Downloads a map from a local stand-in server and checks that interrupted transfers are only
+// resumed when the server or a checksum can confirm that the parts belong to the same file, and
+// that files the INDEX does not list anymore are removed
+namespace {
+    const QString MAP = "TestMap";
+    const QByteArray INDEXPATH = "/TestMap/INDEX";
+    const QByteArray XMLPATH = "/TestMap/TestMap.xml";
+    const QByteArray UNITPATH = "/TestMap/Germany/Infantry.png";
+    const QByteArray XML = "<Map/>";
+    const QByteArray UNIT = "infantry image, version 1";
+    const QByteArray CHANGEDUNIT = "infantry image, version 2 with a different size";
+    const int TIMEOUT = 10000;
+
+    int failures = 0;
+
+    void check(bool condition, const QString& what) {
+        if (!condition) {
+            qWarning("FAILED: %s", qPrintable(what));
+            ++failures;
+        }
+    }
+
+    QByteArray md5(const QByteArray& content) {
+        return QCryptographicHash::hash(content, QCryptographicHash::Md5).toHex();
+    }
+
+    // the unit image is only listed with its checksum if 'unitChecksum' is true
+    QByteArray index(const QByteArray& unit, bool unitChecksum) {
+        QByteArray unitAttribute = unitChecksum ? " md5=\"" + md5(unit) + "\"" : QByteArray();
+        return "<Map md5=\"" + md5(XML) + "\"><Germany><Infantry" + unitAttribute + "/></Germany></Map>";
+    }
+
+    QByteArray readFile(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+        return file.readAll();
+    }
+
+    void writeFile(const QString& fileName, const QByteArray& content) {
+        QFile file(fileName);
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write(content);
+    }
+
+    void removeDirectory(const QString& path) {
+        QDir dir(path);
+        foreach (const QFileInfo& info, dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden)) {
+            if (info.isDir())
+                removeDirectory(info.absoluteFilePath());
+            else
+                QFile::remove(info.absoluteFilePath());
+        }
+        dir.rmdir(path);
+    }
+
+    // runs the download to its end and returns whether it succeeded, which the downloader records
+    // by writing the VERSION file
+    bool download(MapDownloader& downloader, const QDir& mapsDir, const QString& baseURL, const QString& version) {
+        QFile::remove(mapsDir.absoluteFilePath(MAP + "/VERSION"));
+        // the timer wakes up the event loop, so a hanging download cannot block the test
+        QTimer ticker;
+        ticker.start(100);
+        QTime time;
+        time.start();
+        downloader.downloadMap(MAP, version, baseURL);
+        while (downloader.isRunning() && (time.elapsed() < TIMEOUT))
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        if (downloader.isRunning()) {
+            qWarning("Download timed out");
+            return false;
+        }
+        return readFile(mapsDir.absoluteFilePath(MAP + "/VERSION")) == version.toLatin1();
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    HttpStandIn server;
+    if (!server.start()) {
+        qWarning("Could not start the stand-in server: %s", qPrintable(server.errorString()));
+        return 2;
+    }
+    QDir mapsDir(QDir::temp().absoluteFilePath("mapdownloadertest-" + QString::number(QCoreApplication::applicationPid())));
+    removeDirectory(mapsDir.absolutePath());
+    if (!QDir::temp().mkpath(mapsDir.absolutePath())) {
+        qWarning("Could not create %s", qPrintable(mapsDir.absolutePath()));
+        return 2;
+    }
+
+    QNetworkAccessManager manager;
+    MapDownloader downloader(&manager, mapsDir);
+    const QString& unitFile = mapsDir.absoluteFilePath(MAP + "/Germany/Infantry.png");
+    const QString& partFile = unitFile + ".part";
+    const QString& validatorFile = unitFile + ".part.validator";
+
+    server.setFile(XMLPATH, XML, "\"xml1\"");
+    server.setFile(UNITPATH, UNIT, "\"unit1\"", "Sat, 01 Jan 2011 00:00:00 GMT");
+
+    // a fresh download
+    server.setFile(INDEXPATH, index(UNIT, true));
+    check(download(downloader, mapsDir, server.baseURL(), "1"), "fresh download succeeds");
+    check(readFile(unitFile) == UNIT, "fresh download has the content of the server");
+    check(readFile(mapsDir.absoluteFilePath(MAP + "/" + MAP + ".xml")) == XML, "fresh download has the map file");
+    check(!QFile::exists(partFile) && !QFile::exists(validatorFile), "fresh download leaves no '.part' files");
+
+    // files with the right checksum are not downloaded again
+    server.clearRequests();
+    check(download(downloader, mapsDir, server.baseURL(), "1"), "update succeeds");
+    check(server.requests(UNITPATH).isEmpty() && server.requests(XMLPATH).isEmpty(), "update skips unchanged files");
+
+    // the following downloads resume the unit image without a checksum, so only the validator
+    // can tell whether the '.part' file may be continued
+    server.setFile(INDEXPATH, index(UNIT, false));
+
+    // resume with the validator the '.part' file was started with
+    QFile::remove(unitFile);
+    writeFile(partFile, UNIT.left(10));
+    writeFile(validatorFile, "\"unit1\"");
+    server.clearRequests();
+    check(download(downloader, mapsDir, server.baseURL(), "2"), "resumed download succeeds");
+    QList<HttpStandIn::Request> requests = server.requests(UNITPATH);
+    check(requests.size() == 1 && requests[0].headers.value("range") == "bytes=10-" && requests[0].headers.value("if-range") == "\"unit1\"",
+          "resumed download sends Range and If-Range");
+    check(readFile(unitFile) == UNIT, "resumed download has the content of the server");
+    check(!QFile::exists(validatorFile), "resumed download removes the validator");
+
+    // the file changed on the server since the '.part' file was started, so it is sent whole
+    QFile::remove(unitFile);
+    writeFile(partFile, UNIT.left(10));
+    writeFile(validatorFile, "\"unit1\"");
+    server.setFile(UNITPATH, CHANGEDUNIT, "\"unit2\"");
+    check(download(downloader, mapsDir, server.baseURL(), "3"), "download of a changed file succeeds");
+    check(readFile(unitFile) == CHANGEDUNIT, "changed file is not mixed with the old '.part' file");
+    server.setFile(UNITPATH, UNIT, "\"unit1\"", "Sat, 01 Jan 2011 00:00:00 GMT");
+
+    // without a validator or a checksum the '.part' file is discarded
+    QFile::remove(unitFile);
+    writeFile(partFile, "stale");
+    QFile::remove(validatorFile);
+    server.clearRequests();
+    check(download(downloader, mapsDir, server.baseURL(), "4"), "download over a stale '.part' file succeeds");
+    requests = server.requests(UNITPATH);
+    check(requests.size() == 1 && !requests[0].headers.contains("range"), "stale '.part' file is not resumed");
+    check(readFile(unitFile) == UNIT, "stale '.part' file is discarded");
+
+    // a '.part' file of the size the server reports is complete
+    QFile::remove(unitFile);
+    writeFile(partFile, UNIT);
+    writeFile(validatorFile, "Sat, 01 Jan 2011 00:00:00 GMT");
+    server.clearRequests();
+    check(download(downloader, mapsDir, server.baseURL(), "5"), "download of a complete '.part' file succeeds");
+    check(server.requests(UNITPATH).size() == 1, "416 with the matching size is accepted");
+    check(readFile(unitFile) == UNIT, "complete '.part' file is kept");
+
+    // a '.part' file of another size is not, even though the server cannot send a range of it
+    QFile::remove(unitFile);
+    writeFile(partFile, UNIT + "garbage");
+    writeFile(validatorFile, "\"unit1\"");
+    server.clearRequests();
+    check(download(downloader, mapsDir, server.baseURL(), "6"), "download over an oversized '.part' file succeeds");
+    requests = server.requests(UNITPATH);
+    check(requests.size() == 2 && !requests[1].headers.contains("range"), "416 with another size starts over");
+    check(readFile(unitFile) == UNIT, "oversized '.part' file is discarded");
+
+    // files of an older version of the map are removed, the listed ones are kept
+    const QString& oldUnitFile = mapsDir.absoluteFilePath(MAP + "/Germany/Tank.png");
+    const QString& oldFactionFile = mapsDir.absoluteFilePath(MAP + "/Russia/Infantry.png");
+    mapsDir.mkpath(MAP + "/Russia");
+    writeFile(oldUnitFile, "tank image");
+    writeFile(oldUnitFile + ".part", "tank");
+    writeFile(oldFactionFile, UNIT);
+    check(download(downloader, mapsDir, server.baseURL(), "7"), "download over an older version succeeds");
+    check(!QFile::exists(oldUnitFile) && !QFile::exists(oldUnitFile + ".part"), "unlisted files are removed");
+    check(!QFile::exists(mapsDir.absoluteFilePath(MAP + "/Russia")), "unlisted faction directory is removed");
+    check(readFile(unitFile) == UNIT && readFile(mapsDir.absoluteFilePath(MAP + "/" + MAP + ".xml")) == XML, "listed files are kept");
+
+    // a missing index fails the download and leaves the files alone
+    writeFile(oldUnitFile, "tank image");
+    server.removeFile(INDEXPATH);
+    check(!download(downloader, mapsDir, server.baseURL(), "8"), "download without an index fails");
+    check(QFile::exists(oldUnitFile), "failed download removes nothing");
+
+    removeDirectory(mapsDir.absolutePath());
+    if (failures > 0)
+        qWarning("%d checks failed", failures);
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "combatthread.h"
+#include "testcorpus.h"
+#include "unit.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+// Checks that battles which end as a draw, on a stalemate or on the round limit, are recorded as
+// over in the survival curve. Every battle of a scenario has to end within the recorded rounds,
+// so the curve has no battle running in its last round and the units it expects at the end are
+// the units left of the statistics
+namespace {
+    const int BATTLES = 1000;
+    const int SEED = 1;
+
+    // the number of failed checks of 'statistics'
+    int check(const char* name, const CombatStatistics& statistics) {
+        int failures = 0;
+        const SurvivalCurve& curve = statistics.survival;
+        if (curve.battles != statistics.battles) {
+            qWarning("%s: %lld battles in the survival curve, expected %d", name, curve.battles, statistics.battles);
+            ++failures;
+        }
+        int last = SurvivalCurve::Rounds - 1;
+        if (curve.running[last] != 0) {
+            qWarning("%s: %lld battles still running in round %d", name, curve.running[last], last);
+            ++failures;
+        }
+        qint64 unitsLeft[2] = { statistics.attackerUnitsLeft, statistics.defenderUnitsLeft };
+        for (int side = 0; side < 2; ++side) {
+            qint64 units = curve.runningUnits[side][last];
+            for (int round = 0; round <= last; ++round)
+                units += curve.endedUnits[side][round];
+            if (units != unitsLeft[side]) {
+                qWarning("%s: %lld %s units left in the survival curve, expected %lld", name, units,
+                    (side == 0) ? "attacking" : "defending", unitsLeft[side]);
+                ++failures;
+            }
+        }
+        return failures;
+    }
+
+    Batallion batallion(Unit* unit, int count, int ipcFactor) {
+        Batallion result;
+        for (int i = 0; i < count; ++i)
+            result.append(UnitLite(unit, ipcFactor));
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    if (args.size() != 2) {
+        qWarning("Usage: survivaltest <units.xml>");
+        return 2;
+    }
+
+    QDomDocument doc("document");
+    if (!readCorpus(args[1], doc))
+        return 2;
+    QDomElement docElem = doc.documentElement();
+    int ipcFactor = docElem.attribute("ipcFactor", "1").toInt();
+    QMap<QString, Unit*> units = readUnits(docElem);
+    Unit* infantry = units.value("Infantry", 0);
+    Unit* transport = units.value("Transport", 0);
+    if (!infantry || !transport) {
+        qWarning("'%s' has no Infantry or Transport", qPrintable(args[1]));
+        qDeleteAll(units);
+        return 2;
+    }
+
+    int failures = 0;
+
+    // transports neither attack nor defend: every battle is a stalemate before the first round
+    CombatSettings settings;
+    settings.narrowUnits = NarrowUnitLite::fits(units.values(), ipcFactor);
+    settings.isLandBattle = false;
+    CombatStatistics stalemate = simulateCombat(batallion(transport, 2, ipcFactor), batallion(transport, 1, ipcFactor), settings, BATTLES, SEED);
+    if (stalemate.draws != BATTLES) {
+        qWarning("Stalemate: %d draws, expected %d", stalemate.draws, BATTLES);
+        ++failures;
+    }
+    failures += check("Stalemate", stalemate);
+
+    // a round limit well below the rounds the battles would otherwise last
+    settings.isLandBattle = true;
+    settings.maxRounds = 2;
+    CombatStatistics limited = simulateCombat(batallion(infantry, 6, ipcFactor), batallion(infantry, 6, ipcFactor), settings, BATTLES, SEED);
+    if (limited.draws == 0) {
+        qWarning("Round limit: no battle reached the limit");
+        ++failures;
+    }
+    failures += check("Round limit", limited);
+
+    qDeleteAll(units);
+    qWarning("Survival curve: %d failed checks", failures);
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "testcorpus.h"
+#include "unit.h"
+
+#include <QDomElement>
+#include <QFile>
+
+bool readCorpus(const QString& fileName, QDomDocument& doc) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Could not open '%s'", qPrintable(fileName));
+        return false;
+    }
+    QString errorMessage;
+    int errorLine;
+    if (!doc.setContent(file.readAll(), &errorMessage, &errorLine)) {
+        qWarning("XML Error in '%s': %s (line %d)", qPrintable(fileName), qPrintable(errorMessage), errorLine);
+        return false;
+    }
+    return true;
+}
+
+QMap<QString, Unit*> readUnits(const QDomElement& docElem) {
+    QMap<QString, Unit*> result;
+    QDomNodeList units = docElem.firstChildElement("Units").childNodes();
+    for (int i = 0; i < units.size(); ++i) {
+        QDomElement elem = units.at(i).toElement();
+        if (!elem.isNull())
+            result.insert(elem.nodeName(), new Unit(elem));
+    }
+    return result;
+}
+
+Batallion readBatallion(const QDomElement& element, const QMap<QString, Unit*>& units, int ipcFactor, QString& error) {
+    Batallion result;
+    for (QDomElement unit = element.firstChildElement(); !unit.isNull(); unit = unit.nextSiblingElement()) {
+        Unit* u = units.value(unit.nodeName(), 0);
+        if (!u) {
+            error = "Unknown unit '" + unit.nodeName() + "'";
+            return Batallion();
+        }
+        int count = unit.attribute("count", "1").toInt();
+        for (int i = 0; i < count; ++i)
+            result.append(UnitLite(u, ipcFactor));
+    }
+    return result;
+}
+
+bool readSettings(const QDomElement& scenario, CombatSettings& result, QString& error) {
+    QString battle = scenario.attribute("battle", "land");
+    QString orderOfLoss = scenario.attribute("orderOfLoss", "value");
+    if (((battle != "land") && (battle != "sea")) || ((orderOfLoss != "value") && (orderOfLoss != "ipc"))) {
+        error = "Invalid battle type or order of loss";
+        return false;
+    }
+    result.isLandBattle = (battle == "land");
+    result.isAmphibiousCombat = (scenario.attribute("amphibious", "0").toInt() != 0);
+    result.landUnitMustLive = (scenario.attribute("landUnitMustLive", "0").toInt() != 0);
+    result.orderOfLoss = (orderOfLoss == "ipc") ? OrderOfLossIPC : OrderOfLossValue;
+    return true;
+}
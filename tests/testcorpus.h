@@ -0,0 +1,45 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_TESTCORPUS_H
+#define BOCK_TESTCORPUS_H
+
+#include "combatthread.h"
+#include <QDomDocument>
+#include <QMap>
+#include <QString>
+
+class Unit;
+
+// The XML files of the tests describe their units in a 'Units' tag like the maps do. Errors are
+// reported with qWarning
+bool readCorpus(const QString& fileName, QDomDocument& doc);
+QMap<QString, Unit*> readUnits(const QDomElement& docElem); //< by name, owned by the caller
+// the units of a batallion are listed in order, like <Infantry count="3"/>, as the order of a
+// batallion matters for the results
+Batallion readBatallion(const QDomElement& element, const QMap<QString, Unit*>& units, int ipcFactor, QString& error);
+// from the attributes 'battle' (land or sea), 'orderOfLoss' (value or ipc), 'amphibious' and
+// 'landUnitMustLive' of a scenario
+bool readSettings(const QDomElement& scenario, CombatSettings& result, QString& error);
+
+#endif
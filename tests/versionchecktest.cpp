@@ -0,0 +1,154 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "httpstandin.h"
+#include "versioncheck.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkAccessManager>
+#include <QSettings>
+#include <QTime>
+#include <QTimer>
+
+// Refreshes a cached version file from a local stand-in server and checks the full transfer, the
+// conditional request which is answered with 304 and a server which does not answer at all
+namespace {
+    const QByteArray VERSIONPATH = "/VERSION";
+    const QByteArray HANGINGPATH = "/HANGING";
+    const QByteArray VERSION1 = "Version=1.0\n";
+    const QByteArray VERSION2 = "Version=1.1\nRevised World=2.0\n";
+    const int TIMEOUT = 1000; //< of the version check, in milliseconds
+    const int TESTTIMEOUT = 10000;
+
+    int failures = 0;
+
+    void check(bool condition, const QString& what) {
+        if (!condition) {
+            qWarning("FAILED: %s", qPrintable(what));
+            ++failures;
+        }
+    }
+
+    QByteArray readFile(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+        return file.readAll();
+    }
+
+    void removeDirectory(const QString& path) {
+        QDir dir(path);
+        foreach (const QFileInfo& info, dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden)) {
+            if (info.isDir())
+                removeDirectory(info.absoluteFilePath());
+            else
+                QFile::remove(info.absoluteFilePath());
+        }
+        dir.rmdir(path);
+    }
+
+    VersionCheck::Result run(VersionCheck& versionCheck, const QString& url, const QString& cacheFile) {
+        // the timer wakes up the event loop, so a broken timeout cannot block the test
+        QTimer ticker;
+        ticker.start(100);
+        QTime time;
+        time.start();
+        versionCheck.start(QUrl(url), cacheFile, TIMEOUT);
+        while (versionCheck.isRunning() && (time.elapsed() < TESTTIMEOUT))
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        if (versionCheck.isRunning()) {
+            qWarning("Version check did not finish");
+            return VersionCheck::Failed;
+        }
+        return versionCheck.result();
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+
+    HttpStandIn server;
+    if (!server.start()) {
+        qWarning("Could not start the stand-in server: %s", qPrintable(server.errorString()));
+        return 2;
+    }
+    QDir dir(QDir::temp().absoluteFilePath("versionchecktest-" + QString::number(QCoreApplication::applicationPid())));
+    removeDirectory(dir.absolutePath());
+    if (!QDir::temp().mkpath(dir.absolutePath())) {
+        qWarning("Could not create %s", qPrintable(dir.absolutePath()));
+        return 2;
+    }
+
+    QNetworkAccessManager manager;
+    QSettings settings(dir.absoluteFilePath("settings.ini"), QSettings::IniFormat);
+    VersionCheck versionCheck(&manager, &settings);
+    const QString& cacheFile = dir.absoluteFilePath("REMOTEVERSION");
+    const QString& url = server.baseURL() + "VERSION";
+
+    // 200: nothing is cached yet
+    server.setFile(VERSIONPATH, VERSION1, "\"v1\"", "Sat, 01 Jan 2011 00:00:00 GMT");
+    check(run(versionCheck, url, cacheFile) == VersionCheck::Changed, "first check transfers the file");
+    QList<HttpStandIn::Request> requests = server.requests(VERSIONPATH);
+    check(requests.size() == 1 && !requests[0].headers.contains("if-none-match"), "first check is not conditional");
+    check(readFile(cacheFile) == VERSION1, "first check caches the file");
+    check(!QFile::exists(cacheFile + ".tmp"), "first check leaves no temporary file");
+    check(settings.value("RemoteVersion/ETag").toByteArray() == "\"v1\"", "first check keeps the ETag");
+
+    // 304: the cached file is up to date
+    server.clearRequests();
+    check(run(versionCheck, url, cacheFile) == VersionCheck::NotModified, "second check is not modified");
+    requests = server.requests(VERSIONPATH);
+    check(requests.size() == 1 && requests[0].headers.value("if-none-match") == "\"v1\""
+          && requests[0].headers.value("if-modified-since") == "Sat, 01 Jan 2011 00:00:00 GMT",
+          "second check sends the validators of the cached file");
+    check(readFile(cacheFile) == VERSION1, "second check keeps the cached file");
+
+    // 200: the file changed on the server, the cached one is replaced
+    server.setFile(VERSIONPATH, VERSION2, "\"v2\"");
+    check(run(versionCheck, url, cacheFile) == VersionCheck::Changed, "check of a changed file transfers it");
+    check(readFile(cacheFile) == VERSION2, "check of a changed file replaces the cached file");
+    check(settings.value("RemoteVersion/ETag").toByteArray() == "\"v2\"", "check of a changed file keeps the new ETag");
+    check(!QFile::exists(cacheFile + ".tmp"), "check of a changed file leaves no temporary file");
+
+    // timeout: the server never answers
+    server.setHanging(HANGINGPATH);
+    QTime time;
+    time.start();
+    check(run(versionCheck, server.baseURL() + "HANGING", cacheFile) == VersionCheck::Failed, "check of a hanging server fails");
+    check(time.elapsed() < TESTTIMEOUT, "check of a hanging server is aborted after the timeout");
+    check(readFile(cacheFile) == VERSION2, "check of a hanging server keeps the cached file");
+    check(settings.value("RemoteVersion/ETag").toByteArray() == "\"v2\"", "check of a hanging server keeps the ETag");
+
+    // the new file cannot be written, so neither the cached file nor its validators change
+    server.setFile(VERSIONPATH, VERSION1, "\"v3\"");
+    check(run(versionCheck, url, dir.absoluteFilePath("missing/REMOTEVERSION")) == VersionCheck::Failed, "check into a missing directory fails");
+    check(settings.value("RemoteVersion/ETag").toByteArray() == "\"v2\"", "failed write keeps the ETag of the cached file");
+
+    removeDirectory(dir.absolutePath());
+    if (failures > 0)
+        qWarning("%d checks failed", failures);
+    return (failures > 0) ? 1 : 0;
+}
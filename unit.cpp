@@ -32,13 +32,26 @@
         return; \
     }
 
-const int ATTACKBITMASK(7);     // == 2^0 + 2^1 + 2^2
-const int DEFENSEBITMASK(56);   // == 2^3 + 2^4 + 2^5
-const int SUPPORTBITMASK(7);     // == 2^0 + 2^1 + 2^2
-const int BOMBARDMENTBITMASK(56);   // == 2^3 + 2^4 + 2^5
-const int AABITMASK(64);        // == 2^6
-const int MARINEBITMASK(64);    // == 2^6
-const int HITBITMASK(128);      // == 2^7
+namespace {
+    // the bit masks and limits of the fields of a BasicUnitLite, see the comments in unit.h
+    template <typename Layout>
+    struct Fields {
+        enum {
+            Bits = 8 * sizeof(typename Layout::Field),
+            ValueMask = (1 << Layout::ValueBits) - 1,
+            AttackMask = ValueMask,
+            DefenseMask = ValueMask << Layout::ValueBits,
+            SupportMask = ValueMask,
+            BombardmentMask = ValueMask << Layout::ValueBits,
+            AAMask = 1 << (2 * Layout::ValueBits),
+            MarineMask = 1 << (2 * Layout::ValueBits),
+            HitMask = 1 << (2 * Layout::ValueBits + 1),
+            MaxRolls = 3,
+            MaxID = (1 << (Bits - 2)) - 1,
+            MaxIPC = (1 << Bits) - 1
+        };
+    };
+}
 
 Unit::Unit(const QDomElement& element) {
     _name = element.nodeName();
@@ -179,23 +192,20 @@ QString Unit::description() const {
     return result;
 }
 
-UnitLite::UnitLite(const Unit* const unit, int ipcFactor) {
-    int id = unit->id();
-    int numRolls = unit->numRolls();
-    if (id > 63)
-        QMessageBox::critical(0, "XML Error", "A maximum number of 63 units is supported");
-    if (numRolls > 3)
-        QMessageBox::critical(0, "XML Error", "A maximum number of 3 rolls per unit is supported");
-    _numRollsAndID = numRolls + 4*id;
+template <typename Layout>
+BasicUnitLite<Layout>::BasicUnitLite(const Unit* const unit, int ipcFactor) {
+    typedef Fields<Layout> F;
+    Q_ASSERT(checkLimits(unit, ipcFactor).isEmpty());
+    _numRollsAndID = unit->numRolls() + 4*unit->id();
 
     int attackValue = unit->attackValue();
     int defenseValue = unit->defenseValue();
     
-    _combatValue = (defenseValue << 3) + attackValue;
-    _combatValue2 = (unit->bombardmentValue() << 3) + unit->numArtillery();
+    _combatValue = (defenseValue << Layout::ValueBits) + attackValue;
+    _combatValue2 = (unit->bombardmentValue() << Layout::ValueBits) + unit->numArtillery();
 
     float ipc = unit->ipcValue();
-    _ipc = static_cast<unsigned char>(ipc * ipcFactor);
+    _ipc = static_cast<Field>(ipc * ipcFactor);
 
     _features = 0;
 
@@ -206,7 +216,7 @@ UnitLite::UnitLite(const Unit* const unit, int ipcFactor) {
     if (unit->isTwoHit())
         _features |= FeaturesIsTwoHit;
     if (unit->isAA())
-        _combatValue |= AABITMASK;
+        _combatValue |= F::AAMask;
     if (unit->isAir())
         _features |= FeaturesIsAir;
     if (unit->isSea())
@@ -218,97 +228,171 @@ UnitLite::UnitLite(const Unit* const unit, int ipcFactor) {
     if (unit->isSub())
         _features |= FeaturesIsSub;
     if (unit->isMarine())
-        _combatValue2 |= MARINEBITMASK;
+        _combatValue2 |= F::MarineMask;
+}
+
+template <typename Layout>
+template <typename Other>
+BasicUnitLite<Layout>::BasicUnitLite(const BasicUnitLite<Other>& other) {
+    typedef Fields<Layout> F;
+    _numRollsAndID = other.numRolls() + 4*other.id();
+    _combatValue = (other.defenseValue() << Layout::ValueBits) + other.attackValue();
+    _combatValue2 = (other.bombardmentValue() << Layout::ValueBits) + other.numArtillery();
+    _ipc = static_cast<Field>(other._ipc);
+    _features = other._features;
+
+    if (other.isAA())
+        _combatValue |= F::AAMask;
+    if (other.isHit())
+        _combatValue |= F::HitMask;
+    if (other.isMarine())
+        _combatValue2 |= F::MarineMask;
+}
+
+template <typename Layout>
+QString BasicUnitLite<Layout>::checkLimits(const Unit* unit, int ipcFactor) {
+    typedef Fields<Layout> F;
+    if ((unit->id() < 0) || (unit->id() > F::MaxID))
+        return "A maximum number of " + QString::number(F::MaxID) + " units is supported";
+    if (unit->numRolls() > F::MaxRolls)
+        return "A maximum number of " + QString::number(F::MaxRolls) + " rolls per unit is supported";
+    const int values[] = { unit->attackValue(), unit->defenseValue(), unit->bombardmentValue(), unit->numArtillery() };
+    for (int i = 0; i < 4; ++i) {
+        if ((values[i] < 0) || (values[i] > F::ValueMask))
+            return "Attack, defense and support values of at most " + QString::number(F::ValueMask) + " are supported";
+    }
+    if ((unit->ipcValue() < 0.f) || (unit->ipcValue() * ipcFactor > F::MaxIPC))
+        return "An IPC value of at most " + QString::number(static_cast<float>(F::MaxIPC) / ipcFactor) + " is supported";
+    return QString();
+}
+
+template <typename Layout>
+bool BasicUnitLite<Layout>::fits(const QList<Unit*>& units, int ipcFactor) {
+    foreach (const Unit* unit, units) {
+        if (!checkLimits(unit, ipcFactor).isEmpty())
+            return false;
+    }
+    return true;
 }
 
-bool UnitLite::operator==(const UnitLite& rhs) const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::operator==(const BasicUnitLite& rhs) const {
     return (this->id() == rhs.id());
 }
 
-bool UnitLite::operator!=(const UnitLite& rhs) const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::operator!=(const BasicUnitLite& rhs) const {
     return !(*this == rhs);
 }
 
-int UnitLite::id() const {
+template <typename Layout>
+int BasicUnitLite<Layout>::id() const {
     return _numRollsAndID / 4;
 }
 
-int UnitLite::attackValue() const {
-    return _combatValue & ATTACKBITMASK;
+template <typename Layout>
+int BasicUnitLite<Layout>::attackValue() const {
+    return _combatValue & Fields<Layout>::AttackMask;
 }
 
-int UnitLite::defenseValue() const {
-    return (_combatValue & DEFENSEBITMASK) >> 3;
+template <typename Layout>
+int BasicUnitLite<Layout>::defenseValue() const {
+    return (_combatValue & Fields<Layout>::DefenseMask) >> Layout::ValueBits;
 }
 
-float UnitLite::ipcValue() const {
+template <typename Layout>
+float BasicUnitLite<Layout>::ipcValue() const {
     return _ipc;
 }
 
-bool UnitLite::isAA() const {
-    return _combatValue & AABITMASK;
+template <typename Layout>
+bool BasicUnitLite<Layout>::isAA() const {
+    return _combatValue & Fields<Layout>::AAMask;
 }
 
-bool UnitLite::isArtillerySupportable() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isArtillerySupportable() const {
     return _features & FeaturesIsArtillerySupportable;
 }
 
-bool UnitLite::isArtillery() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isArtillery() const {
     return _features & FeaturesIsArtillery;
 }
 
-bool UnitLite::isAir() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isAir() const {
     return _features & FeaturesIsAir;
 }
 
-bool UnitLite::isSea() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isSea() const {
     return _features & FeaturesIsSea;
 }
 
-bool UnitLite::isLand() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isLand() const {
     return !(_features & (FeaturesIsSea | FeaturesIsAir));
 }
 
-bool UnitLite::canBombard() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::canBombard() const {
     return _features & FeaturesCanBombard;
 }
 
-bool UnitLite::isTwoHit() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isTwoHit() const {
     return _features & FeaturesIsTwoHit;
 }
 
-bool UnitLite::isHit() const {
-    return _combatValue & HITBITMASK;
+template <typename Layout>
+bool BasicUnitLite<Layout>::isHit() const {
+    return _combatValue & Fields<Layout>::HitMask;
 }
 
-void UnitLite::setHit() {
-    _combatValue |= HITBITMASK;
+template <typename Layout>
+void BasicUnitLite<Layout>::setHit() {
+    _combatValue |= Fields<Layout>::HitMask;
 }
 
-bool UnitLite::isDestroyer() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isDestroyer() const {
     return _features & FeaturesIsDestroyer;
 }
 
-bool UnitLite::isSub() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::isSub() const {
     return _features & FeaturesIsSub;
 }
 
-bool UnitLite::hasTwoRolls() const {
+template <typename Layout>
+bool BasicUnitLite<Layout>::hasTwoRolls() const {
     return numRolls() == 2;
 }
 
-int UnitLite::numRolls() const {
+template <typename Layout>
+int BasicUnitLite<Layout>::numRolls() const {
     return _numRollsAndID % 4;
 }
 
-int UnitLite::bombardmentValue() const {
-    return _combatValue2 & BOMBARDMENTBITMASK;
+template <typename Layout>
+int BasicUnitLite<Layout>::bombardmentValue() const {
+    return (_combatValue2 & Fields<Layout>::BombardmentMask) >> Layout::ValueBits;
 }
 
-int UnitLite::numArtillery() const {
-    return _combatValue2 & SUPPORTBITMASK;
+template <typename Layout>
+int BasicUnitLite<Layout>::numArtillery() const {
+    return _combatValue2 & Fields<Layout>::SupportMask;
 }
 
-bool UnitLite::isMarine() const {
-    return _combatValue2 & MARINEBITMASK;
+template <typename Layout>
+bool BasicUnitLite<Layout>::isMarine() const {
+    return _combatValue2 & Fields<Layout>::MarineMask;
 }
+
+// both layouts are compiled, so a map can be checked against either of them, and the battles
+// convert their units between them
+template struct BasicUnitLite<UnitLayoutNarrow>;
+template struct BasicUnitLite<UnitLayoutWide>;
+template BasicUnitLite<UnitLayoutNarrow>::BasicUnitLite(const BasicUnitLite<UnitLayoutWide>& other);
+template BasicUnitLite<UnitLayoutWide>::BasicUnitLite(const BasicUnitLite<UnitLayoutNarrow>& other);
@@ -25,6 +25,7 @@
 #define BOCK_UNIT_H
 
 #include <QDomElement>
+#include <QList>
 #include <QMap>
 #include <QString>
 
@@ -69,12 +70,34 @@ protected:
     QMap<QString, QString> _information;
 };
 
-struct UnitLite {
+// Field widths of the BasicUnitLite representation. The narrow layout packs a unit into five
+// bytes, which keeps the unit arrays of the battles in as few cache lines as possible, but limits
+// the ids to 63, the combat values to 7 and the IPC value to 255 times the IPC factor. The wide
+// layout takes ten bytes and lifts these limits for big custom maps
+struct UnitLayoutNarrow {
+    typedef unsigned char Field;
+    enum { ValueBits = 3 };
+};
+
+struct UnitLayoutWide {
+    typedef unsigned short Field;
+    enum { ValueBits = 7 };
+};
+
+template <typename Layout>
+struct BasicUnitLite {
 public:
-    UnitLite(const Unit* const unit, int ipcFactor);
+    BasicUnitLite(const Unit* const unit, int ipcFactor);
+    // the same unit in another layout; it has to fit into this one
+    template <typename Other>
+    explicit BasicUnitLite(const BasicUnitLite<Other>& other);
 
-    bool operator==(const UnitLite& rhs) const;
-    bool operator!=(const UnitLite& rhs) const;
+    // returns an empty string if the unit can be represented with this layout
+    static QString checkLimits(const Unit* unit, int ipcFactor);
+    static bool fits(const QList<Unit*>& units, int ipcFactor); //< true if all units pass checkLimits
+
+    bool operator==(const BasicUnitLite& rhs) const;
+    bool operator!=(const BasicUnitLite& rhs) const;
 
     int id() const;
     int attackValue() const;
@@ -100,11 +123,16 @@ public:
     bool isMarine() const;
 
 private:
-    unsigned char _ipc;
+    template <typename Other>
+    friend struct BasicUnitLite;
+
+    typedef typename Layout::Field Field;
+
+    Field _ipc;
     unsigned char _features;
-    unsigned char _numRollsAndID; // bits: ididid##      id;num
-    unsigned char _combatValue;   // bits: ##defatt     isHit;isAA;defense;attack
-    unsigned char _combatValue2;  // bits: ##bomsup      ?;isMarine;bombardment value; #of supported units
+    Field _numRollsAndID; // bits: id...id##      id;num
+    Field _combatValue;   // bits: ##def...att    isHit;isAA;defense;attack
+    Field _combatValue2;  // bits: ##bom...sup    ?;isMarine;bombardment value; #of supported units
 
     enum Features {
         FeaturesIsArtillery             = 1 << 0,
@@ -118,4 +146,10 @@ private:
     };
 };
 
+// Batallions and results keep their units in the wide layout, so that every map fits. The battle
+// engine is compiled for both layouts and a battle copies its units into the narrow one if all
+// units of the map fit into it (see CombatSettings::narrowUnits)
+typedef BasicUnitLite<UnitLayoutWide> UnitLite;
+typedef BasicUnitLite<UnitLayoutNarrow> NarrowUnitLite;
+
 #endif
@@ -43,12 +43,13 @@ UnitWidget::UnitWidget(FactionWidget* parent, Unit* unit, const QPixmap& icon)
     layout->setSpacing(0);
 
     _iconLabel = new QLabel;
-    _iconLabel->setPixmap(_icon.scaledToWidth(40));
+    _iconLabel->setPixmap(_icon);
     _iconLabel->setMaximumSize(50, 50);
     layout->addWidget(_iconLabel);
 
     _amount = new QSpinBox;
     _amount->setButtonSymbols(QAbstractSpinBox::PlusMinus);
+    connect(_amount, SIGNAL(valueChanged(int)), parent, SIGNAL(unitsChanged()));
     layout->addWidget(_amount);
 
     setToolTip(unit->description());
@@ -36,7 +36,11 @@ class QSpinBox;
 class UnitWidget : public QWidget {
 Q_OBJECT
 public:
-    UnitWidget(FactionWidget* parent, Unit* unit, const QPixmap& icon);
+    enum {
+        IconWidth = 40
+    };
+
+    UnitWidget(FactionWidget* parent, Unit* unit, const QPixmap& icon); //< icon is expected in IconWidth
 
     Unit* widgetUnit() const;
     QPair<Unit*, int> units() const;
@@ -0,0 +1,143 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#include "versioncheck.h"
+
+#include <QDir>
+#include <QFile>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSettings>
+#include <QTimer>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <stdio.h>
+#endif
+
+namespace {
+    // replaces 'target' by 'source' in a single step, so 'target' is always either the old or the
+    // new file. QFile::rename refuses to overwrite a file and QSaveFile needs Qt 5
+    bool replaceFile(const QString& source, const QString& target) {
+#ifdef Q_OS_WIN
+        return MoveFileExW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(source).utf16()),
+            reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(target).utf16()),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+    }
+}
+
+VersionCheck::VersionCheck(QNetworkAccessManager* manager, QSettings* settings, QObject* parent)
+    : QObject(parent)
+    , _manager(manager)
+    , _settings(settings)
+    , _timer(new QTimer(this))
+    , _reply(0)
+    , _result(Failed)
+{
+    _timer->setSingleShot(true);
+    connect(_timer, SIGNAL(timeout()), this, SLOT(timeout()));
+}
+
+VersionCheck::~VersionCheck() {
+    if (_reply) {
+        _reply->disconnect(this);
+        _reply->abort();
+        _reply->deleteLater();
+    }
+}
+
+void VersionCheck::start(const QUrl& url, const QString& cacheFile, int timeout) {
+    if (isRunning())
+        return;
+
+    _cacheFile = cacheFile;
+    QNetworkRequest request(url);
+    // only transfer the file if it has changed since it was cached
+    if (QFile::exists(_cacheFile)) {
+        QByteArray eTag = _settings->value("RemoteVersion/ETag").toByteArray();
+        QByteArray lastModified = _settings->value("RemoteVersion/LastModified").toByteArray();
+        if (!eTag.isEmpty())
+            request.setRawHeader("If-None-Match", eTag);
+        if (!lastModified.isEmpty())
+            request.setRawHeader("If-Modified-Since", lastModified);
+    }
+
+    _reply = _manager->get(request);
+    connect(_reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+    _timer->start(timeout);
+}
+
+bool VersionCheck::isRunning() const {
+    return _reply != 0;
+}
+
+VersionCheck::Result VersionCheck::result() const {
+    return _result;
+}
+
+void VersionCheck::replyFinished() {
+    QNetworkReply* reply = _reply;
+    _reply = 0;
+    _timer->stop();
+    reply->deleteLater();
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() != QNetworkReply::NoError)
+        _result = Failed;
+    else if (status == 304)
+        _result = NotModified;
+    else if (writeCacheFile(reply->readAll())) {
+        // the validators only describe the cached copy once it was replaced
+        _settings->setValue("RemoteVersion/ETag", reply->rawHeader("ETag"));
+        _settings->setValue("RemoteVersion/LastModified", reply->rawHeader("Last-Modified"));
+        _result = Changed;
+    }
+    else
+        _result = Failed;
+
+    emit finished();
+}
+
+void VersionCheck::timeout() {
+    if (_reply)
+        _reply->abort();
+}
+
+bool VersionCheck::writeCacheFile(const QByteArray& content) const {
+    const QString& tempName = _cacheFile + ".tmp";
+    QFile file(tempName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    bool written = (file.write(content) == content.size()) && file.flush();
+    file.close();
+    if (!written || !replaceFile(tempName, _cacheFile)) {
+        QFile::remove(tempName);
+        return false;
+    }
+    return true;
+}
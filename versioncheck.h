@@ -0,0 +1,77 @@
+/**************************************************************************************************
+ *                                                                                                *
+ * AAA Combat Simulator                                                                           *
+ *                                                                                                *
+ * Copyright (c) 2011 Alexander Bock                                                              *
+ *                                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software  *
+ * and associated documentation files (the "Software"), to deal in the Software without           *
+ * restriction, including without limitation the rights to use, copy, modify, merge, publish,     *
+ * distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  *
+ * Software is furnished to do so, subject to the following conditions:                           *
+ *                                                                                                *
+ * The above copyright notice and this permission notice shall be included in all copies or       *
+ * substantial portions of the Software.                                                          *
+ *                                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  *
+ * BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     *
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        *
+ *                                                                                                *
+ *************************************************************************************************/
+
+#ifndef BOCK_VERSIONCHECK_H
+#define BOCK_VERSIONCHECK_H
+
+#include <QObject>
+
+#include <QString>
+#include <QUrl>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QSettings;
+class QTimer;
+
+// Refreshes a cached copy of a remote file with a conditional request, so the file is only
+// transferred if it has changed since it was cached. The ETag and Last-Modified date of the cached
+// copy are kept in 'RemoteVersion/' of the given settings. A new copy is written to a temporary
+// file first, which then atomically replaces the cached copy, so a crash or a failed write
+// always leaves either the old or the new copy
+class VersionCheck : public QObject {
+Q_OBJECT
+public:
+    enum Result {
+        Changed,     //< the cached copy was replaced by a new version
+        NotModified, //< the cached copy is up to date
+        Failed       //< offline, timed out or the copy could not be written; the cached copy is kept
+    };
+
+    VersionCheck(QNetworkAccessManager* manager, QSettings* settings, QObject* parent = 0);
+    ~VersionCheck();
+
+    // the request is aborted if it did not finish within 'timeout' milliseconds
+    void start(const QUrl& url, const QString& cacheFile, int timeout);
+    bool isRunning() const;
+    Result result() const; //< of the last finished check
+
+signals:
+    void finished();
+
+private slots:
+    void replyFinished();
+    void timeout();
+
+private:
+    bool writeCacheFile(const QByteArray& content) const;
+
+    QNetworkAccessManager* _manager;
+    QSettings* _settings;
+    QTimer* _timer;
+    QNetworkReply* _reply;
+    QString _cacheFile;
+    Result _result;
+};
+
+#endif